@@ -1,5 +1,20 @@
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Same layout as MLang structs, fields in declaration order and one word
+// each. Nested structs are pointers.
+struct TestPoint {
+    long long x;
+    long long y;
+};
+
+struct TestLine {
+    TestPoint* begin;
+    long long width;
+    TestPoint* end;
+};
 
 // To avoid renaming the function in the exported symbols
 extern "C" {
@@ -15,6 +30,36 @@ extern "C" {
     bool test_ii_b(int a, int b);
     bool test_bb_b(bool a, bool b);
     const char* test_pp_p(char* a, char* b);
+    int test_blob_sum(const unsigned char* data, int length);
+    void test_blob_iota(unsigned char* data, int length);
+    int test_str_len(const char* str);
+    int test_add(int a, int b);
+    int test_7i_i(int a, int b, int c, int d, int e, int f, int g);
+    int test_8i_i(int a, int b, int c, int d, int e, int f, int g, int h);
+    int test_9i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i);
+    int test_10i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j);
+    int test_11i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k);
+    int test_12i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k, int l);
+    int test_va_sum(int count, ...);
+    int test_va_strlen(int count, ...);
+    int test_stack_alignment(int a, int b, int c, int d, int e, int f, int g);
+    double test_dd_d(double a, double b);
+    double test_idid_d(int a, double b, int c, double d);
+    double test_10d_d(double a, double b, double c, double d, double e, double f, double g, double h, double i, double j);
+    double test_mixed_stack(int a, double b, int c, double d, int e, double f, int g, double h,
+                            int i, double j, int k, double l, int m, double n);
+    double test_va_dsum(int count, ...);
+    int test_point_sum(const TestPoint* points, int count);
+    void test_point_scale(TestPoint* point, int factor);
+    int test_line_length(const TestLine* line);
+    // MLang Int parameters are 64 bit
+    int test_callback_ii(long long (*fn)(long long, long long), int a, int b);
+    double test_callback_dd(double (*fn)(double, long long), double x, int n);
+    int test_callback_8i(long long (*fn)(long long, long long, long long, long long,
+                                         long long, long long, long long, long long));
+    double test_callback_mixed(double (*fn)(long long, double, long long, double, long long,
+                                            double, long long, double, long long, double));
+    int test_apply(long long (*fn)(long long), int x);
 }
 
 void printNoArgs() { printf("It's working!\n"); }
@@ -80,4 +125,166 @@ bool test_bb_b(bool a, bool b) {
 const char* test_pp_p(char* a, char* b) {
     printf("Test (%s, %s)\n", a, b);
     return "Hello from C!";
-}
\ No newline at end of file
+}
+
+int test_blob_sum(const unsigned char* data, int length) {
+    int r = 0;
+    for (int i = 0; i < length; ++i) {
+        r += data[i];
+    }
+    printf("Test blob sum (%d bytes) -> %d\n", length, r);
+    return r;
+}
+
+void test_blob_iota(unsigned char* data, int length) {
+    for (int i = 0; i < length; ++i) {
+        data[i] = static_cast<unsigned char>(i);
+    }
+}
+
+int test_str_len(const char* str) {
+    int length = 0;
+    while (str[length] != '\0') {
+        ++length;
+    }
+    return length;
+}
+
+// Without printing, for benchmarks
+int test_add(int a, int b) { return a + b; }
+
+// Parameters are weighted by their position, so swapped arguments change
+// the result. The ones after the sixth are passed on the stack.
+int test_7i_i(int a, int b, int c, int d, int e, int f, int g) {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g;
+}
+
+int test_8i_i(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return test_7i_i(a, b, c, d, e, f, g) + 8 * h;
+}
+
+int test_9i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i) {
+    return test_8i_i(a, b, c, d, e, f, g, h) + 9 * i;
+}
+
+int test_10i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j) {
+    return test_9i_i(a, b, c, d, e, f, g, h, i) + 10 * j;
+}
+
+int test_11i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k) {
+    return test_10i_i(a, b, c, d, e, f, g, h, i, j) + 11 * k;
+}
+
+int test_12i_i(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k, int l) {
+    return test_11i_i(a, b, c, d, e, f, g, h, i, j, k) + 12 * l;
+}
+
+int test_va_sum(int count, ...) {
+    va_list args;
+    va_start(args, count);
+    int r = 0;
+    for (int i = 0; i < count; ++i) {
+        r += va_arg(args, int);
+    }
+    va_end(args);
+    return r;
+}
+
+int test_va_strlen(int count, ...) {
+    va_list args;
+    va_start(args, count);
+    int r = 0;
+    for (int i = 0; i < count; ++i) {
+        r += static_cast<int>(strlen(va_arg(args, const char*)));
+    }
+    va_end(args);
+    return r;
+}
+
+// Returns 1 if the stack was 16 byte aligned at the call, as the ABI
+// requires. The frame address is the stack pointer after pushing the
+// return address and the frame pointer, so it is aligned as well.
+int test_stack_alignment(int, int, int, int, int, int, int) {
+    auto frame = reinterpret_cast<unsigned long long>(__builtin_frame_address(0));
+    return frame % 16 == 0;
+}
+
+double test_dd_d(double a, double b) { return a * b; }
+
+// Integer and float registers are assigned independently
+double test_idid_d(int a, double b, int c, double d) { return a + b * c - d; }
+
+// The ninth and tenth are passed on the stack
+double test_10d_d(double a, double b, double c, double d, double e, double f, double g, double h, double i, double j) {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h + 9 * i + 10 * j;
+}
+
+// Seven ints and seven doubles, only the last int goes to the stack
+double test_mixed_stack(int a, double b, int c, double d, int e, double f, int g, double h,
+                        int i, double j, int k, double l, int m, double n) {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h + 9 * i + 10 * j +
+           11 * k + 12 * l + 13 * m + 14 * n;
+}
+
+// Reads the doubles from the registers saved according to al
+double test_va_dsum(int count, ...) {
+    va_list args;
+    va_start(args, count);
+    double r = 0;
+    for (int i = 0; i < count; ++i) {
+        r += va_arg(args, double);
+    }
+    va_end(args);
+    return r;
+}
+
+// Points are passed as a pointer to MLang struct memory, no copies
+int test_point_sum(const TestPoint* points, int count) {
+    long long r = 0;
+    for (int i = 0; i < count; ++i) {
+        r += points[i].x + points[i].y;
+    }
+    return static_cast<int>(r);
+}
+
+void test_point_scale(TestPoint* point, int factor) {
+    point->x *= factor;
+    point->y *= factor;
+}
+
+// Manhattan distance times width
+int test_line_length(const TestLine* line) {
+    long long dx = line->end->x - line->begin->x;
+    long long dy = line->end->y - line->begin->y;
+    if (dx < 0) dx = -dx;
+    if (dy < 0) dy = -dy;
+    return static_cast<int>((dx + dy) * line->width);
+}
+
+// Both argument orders, so swapped arguments show
+int test_callback_ii(long long (*fn)(long long, long long), int a, int b) {
+    return static_cast<int>(fn(a, b) * 100 + fn(b, a));
+}
+
+double test_callback_dd(double (*fn)(double, long long), double x, int n) {
+    double r = 0;
+    for (int i = 0; i < n; ++i) {
+        r += fn(x, i);
+    }
+    return r;
+}
+
+// The last two arguments are on the stack for System V
+int test_callback_8i(long long (*fn)(long long, long long, long long, long long,
+                                     long long, long long, long long, long long)) {
+    return static_cast<int>(fn(1, 2, 3, 4, 5, 6, 7, 8));
+}
+
+double test_callback_mixed(double (*fn)(long long, double, long long, double, long long,
+                                        double, long long, double, long long, double)) {
+    return fn(1, 0.5, 2, 0.25, 3, 0.125, 4, 2.0, 5, 4.0);
+}
+
+int test_apply(long long (*fn)(long long), int x) {
+    return static_cast<int>(fn(x) + 1);
+}
@@ -0,0 +1,15 @@
+# expect_result=24
+let a = alloc8(16);
+let b = alloc8(16);
+
+fill(a, 0, 16, 7);
+copy(b, 4, a, 0, 8);
+let same = compare(a, 0, b, 4, 8);
+
+b[9] = 3;
+let idx = find_byte(b, 0, length(b), 3);
+
+if (same == 0) {
+    ret idx + b[4] + b[11] + length(a) - length(b) + 1;
+}
+ret 0;
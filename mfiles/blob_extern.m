@@ -0,0 +1,7 @@
+# expect_result=45
+let iota = extern test::test_blob_iota(data: Blob, length: Int): Void;
+let sum = extern test::test_blob_sum(data: Blob, length: Int): Int;
+
+let b = alloc8(10);
+iota(b, length(b));
+ret sum(b, length(b));
@@ -0,0 +1,5 @@
+# expect_result=42
+let b = alloc8(4);
+b[0] = 40;
+b[1] = b[0] + 2;
+ret b[1];
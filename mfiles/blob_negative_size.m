@@ -0,0 +1,6 @@
+# failure=true
+# Negative sizes wrap around to huge ones and are rejected
+let b = alloc8(0 - 8);
+b[100000] = 1;
+b[5000000] = 1;
+ret 7;
@@ -0,0 +1,17 @@
+# expect_result=43206
+# Evaluated by the compiler, the program only stores the results
+let k = 60 * 60 * 24;
+let big = k > 1000;
+let half = toFloat(k) / 2.0;
+let n = 0;
+if (big) {
+    n = toInt(half);
+} else {
+    n = 1;
+}
+while (false) {
+    n = n + 1;
+}
+let flag = 1 == 2;
+if (flag) { n = 0; }
+ret n + (k % 7);
@@ -0,0 +1,14 @@
+# expect_result=4317
+# MLang functions passed to C are called back from native code
+let twoArgs = extern test::test_callback_ii(fn: Fn<Int,Int,Int>, a: Int, b: Int): Int;
+let eightArgs = extern test::test_callback_8i(fn: Fn<Int,Int,Int,Int,Int,Int,Int,Int,Int>): Int;
+let floats = extern test::test_callback_dd(fn: Fn<Float,Int,Float>, x: Float, n: Int): Float;
+let mixed = extern test::test_callback_mixed(fn: Fn<Int,Float,Int,Float,Int,Float,Int,Float,Int,Float,Float>): Float;
+
+let sub(a: Int, b: Int) = a - b;
+let weighted(a: Int, b: Int, c: Int, d: Int, e: Int, f: Int, g: Int, h: Int) = a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h;
+let scaled(x: Float, i: Int) = x * toFloat(i);
+let combine(a: Int, b: Float, c: Int, d: Float, e: Int, f: Float, g: Int, h: Float, i: Int, j: Float) = toFloat(a + c + e + g + i) * (b + d + f + h + j);
+
+# 7 * 100 - 7 = 693, 204, 1.5 * 6 = 9, 15 * 6.875 = 103.125
+ret twoArgs(sub, 9, 2) + eightArgs(weighted) + toInt(floats(scaled, 1.5, 4)) + toInt(mixed(combine)) + 3308;
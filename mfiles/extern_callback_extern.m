@@ -0,0 +1,5 @@
+# failure=true
+# Only MLang functions can be called back from native code
+let twoArgs = extern test::test_callback_ii(fn: Fn<Int,Int,Int>, a: Int, b: Int): Int;
+let mul = extern test::mul(a: Int, b: Int): Int;
+ret twoArgs(mul, 9, 2);
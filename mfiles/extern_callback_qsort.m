@@ -0,0 +1,18 @@
+# expect_result=13579
+# C sorts MLang memory with an MLang comparator
+struct Element {
+    let v: Int;
+}
+
+let qsort = extern c::qsort(base: Blob, count: Int, size: Int, compare: Fn<Element,Element,Int>): Void;
+let compare(a: Element, b: Element) = a.v - b.v;
+
+let b = alloc8(40);
+set(b, 0, 7);
+set(b, 8, 3);
+set(b, 16, 9);
+set(b, 24, 1);
+set(b, 32, 5);
+qsort(b, 5, 8, compare);
+
+ret get(b, 0) * 10000 + get(b, 8) * 1000 + get(b, 16) * 100 + get(b, 24) * 10 + get(b, 32);
@@ -0,0 +1,10 @@
+# expect_result=15
+# A callback calls into C again, which calls back into the VM
+let outer(x: Int) = {
+    let apply = extern test::test_apply(fn: Fn<Int,Int>, x: Int): Int;
+    let twice(y: Int) = y * 2;
+    ret apply(twice, x) + 3;
+};
+
+let apply = extern test::test_apply(fn: Fn<Int,Int>, x: Int): Int;
+ret apply(outer, 5);
@@ -0,0 +1,7 @@
+# expect_result=18
+let sqrt = extern m::sqrt(x: Float): Float;
+let pow = extern m::pow(x: Float, y: Float): Float;
+let mix = extern test::test_idid_d(a: Int, b: Float, c: Int, d: Float): Float;
+let dsum = extern test::test_va_dsum(count: Int, ...): Float;
+
+ret toInt(sqrt(16.0) + pow(2.0, 3.0) + mix(3, 0.5, 4, 0.25) + dsum(2, 0.5, 1.5));
@@ -0,0 +1,14 @@
+# expect_result=30
+# Imported once, no matter how often the declaration runs
+let addTwice(a, b) = {
+    let add = extern test::test_add(a: Int, b: Int): Int;
+    ret add(add(a, b), b);
+};
+
+let sum = 0;
+let i = 0;
+while (i < 5) {
+    sum = addTwice(sum, 3);
+    i = i + 1;
+}
+ret sum;
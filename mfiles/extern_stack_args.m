@@ -0,0 +1,4 @@
+# expect_result=650
+let sum12 = extern test::test_12i_i(a: Int, b: Int, c: Int, d: Int, e: Int, f: Int, g: Int, h: Int, i: Int, j: Int, k: Int, l: Int): Int;
+
+ret sum12(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12);
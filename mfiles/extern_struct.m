@@ -0,0 +1,31 @@
+# expect_result=121
+struct Point {
+    let x: Int;
+    let y: Int;
+}
+
+struct Line {
+    let begin: Point;
+    let width: Int;
+    let end: Point;
+}
+
+let sum = extern test::test_point_sum(points: Point, count: Int): Int;
+let scale = extern test::test_point_scale(point: Point, factor: Int): Void;
+let lineLength = extern test::test_line_length(line: Line): Int;
+
+let p: Point;
+p.x = 3;
+p.y = 4;
+
+# C writes into the struct, MLang sees the change
+scale(p, 10);
+
+let l: Line;
+l.begin.x = 1;
+l.begin.y = 2;
+l.end.x = 4;
+l.end.y = 6;
+l.width = 7;
+
+ret sum(p, 1) + lineLength(l) + p.x - 28;
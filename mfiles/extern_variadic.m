@@ -0,0 +1,7 @@
+# expect_result=24
+let sum = extern test::test_va_sum(count: Int, ...): Int;
+let lengths = extern test::test_va_strlen(count: Int, ...): Int;
+
+let many = sum(8, 1, 2, 3, 4, 5, 6, 7, 8);
+let few = sum(0);
+ret many - 36 + few + lengths(3, "a", "bc" + "d", "longer than seven") + sum(2, 1, 2);
@@ -0,0 +1,13 @@
+# expect_result=7
+let a = 1.5;
+let b = 2.25;
+let c = a * b + 0.625;
+let d = c / 0.5 - 1.0;
+let e = toFloat(3) - 10.0;
+if (e < 0.0) {
+    if (d == 7.0) {
+        # toInt truncates towards zero, -3.5 becomes -3
+        ret toInt(d) + toInt(e / 2.0) + 3;
+    }
+}
+ret 0;
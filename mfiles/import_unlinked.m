@@ -0,0 +1,4 @@
+# failure=true
+# Functions of other modules need the linker, see Runner
+let add = import math::add(a: Int, b: Int): Int;
+ret add(1, 2);
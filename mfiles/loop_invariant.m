@@ -0,0 +1,21 @@
+# expect_result=84
+# n * 2 and k * k are computed once, before the loops
+struct Config {
+    let limit: Int;
+}
+let sum(cfg: Config, n: Int, k: Int) = {
+    let i = 0;
+    let s = 0;
+    while (i < n * 2) {
+        let j = 0;
+        while (j < cfg.limit) {
+            s = s + k * k;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    ret s;
+};
+let cfg: Config;
+cfg.limit = 3;
+ret sum(cfg, 2, 7) - 504;
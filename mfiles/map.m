@@ -0,0 +1,15 @@
+# expect_result=42
+let m: Map<Int, Int>;
+let i = 0;
+while (i < 20) {
+    put(m, i, i * 2);
+    i = i + 1;
+}
+put(m, 5, 100);
+remove(m, 7);
+remove(m, 99);
+
+if (contains(m, 7)) {
+    ret 0;
+}
+ret get(m, 5) - get(m, 19) - size(m) - 1;
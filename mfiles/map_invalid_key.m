@@ -0,0 +1,3 @@
+# failure=true
+let m: Map<Bool, Int>;
+ret 0;
@@ -0,0 +1,17 @@
+# expect_result=11
+let count(m: Map<String, Int>, word) = {
+    if (contains(m, word)) {
+        m[word] = m[word] + 1;
+    } else {
+        m[word] = 1;
+    }
+};
+
+let m: Map<String, Int>;
+count(m, "apple");
+count(m, "pear");
+count(m, "app" + "le");
+count(m, "a longer key than seven");
+count(m, "a longer key " + "than seven");
+
+ret m["apple"] * 5 + m["a longer key than seven"] - size(m) + 2;
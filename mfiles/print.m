@@ -0,0 +1,9 @@
+# expect_result=3
+let i = 0;
+while (i < 3) {
+    print(i);
+    i = i + 1;
+}
+print("done");
+flush();
+ret i;
@@ -0,0 +1,11 @@
+# expect_result=7
+# Returns before the local of the branch is on the stack
+let pick(x: Int) = {
+    if (x > 100) {
+        let z = 1;
+        print(z);
+    }
+    ret 7;
+};
+
+ret pick(5);
@@ -0,0 +1,12 @@
+# expect_result=20
+# Each branch declares its own a
+let pick(c: Int) = {
+    if (c > 0) {
+        let a = 10;
+        ret a;
+    } else {
+        let a = 20;
+        ret a;
+    }
+};
+ret pick(0);
@@ -0,0 +1,13 @@
+# expect_result=42
+let short = "abc" + "def";
+let long = concat(short, "-ghijklmnop");
+let part = substring(long, 7, 5);
+
+if (equals(part, "ghijk")) {
+    if (equals(short, "abcdef")) {
+        if (hash(short) == hash("abcdef")) {
+            ret length(long) + length(part) + length(short) + length("") + 14;
+        }
+    }
+}
+ret 0;
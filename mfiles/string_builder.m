@@ -0,0 +1,14 @@
+# expect_result=31
+let sb = builder();
+let i = 0;
+while (i < 10) {
+    append(sb, "ab");
+    i = i + 1;
+}
+append(sb, "!");
+let s = build(sb);
+
+if (equals(substring(s, 18, 3), "ab!")) {
+    ret length(s) + 10;
+}
+ret 0;
@@ -0,0 +1,17 @@
+# expect_result=7
+let greet(name) = "Hello " + name;
+
+let result = 0;
+if ("abc" == "abc") {
+    result = result + 1;
+}
+if (greet("World") == "Hello World") {
+    result = result + 2;
+}
+if (greet("you") != "Hello World") {
+    result = result + 4;
+}
+if ("abc" == "abd") {
+    result = result + 8;
+}
+ret result;
@@ -0,0 +1,6 @@
+# expect_result=11
+let len = extern test::test_str_len(s: String): Int;
+
+let inline = "ab" + "cd";
+let heap = inline + "efghijk";
+ret len(inline) + len(heap) - length(inline);
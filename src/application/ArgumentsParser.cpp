@@ -1,12 +1,22 @@
 #include "ArgumentsParser.h"
 #include <iostream>
 
-ArgumentsParser::ArgumentsParser(int argc, char** argv)
-    : arguments{}, flags{}, options{}, success{true}, program{} {
+ArgumentsParser::ArgumentsParser(int argc, char** argv, const std::set<std::string>& commands)
+    : arguments{}, flags{}, options{}, success{true}, program{}, command{} {
     if (argc > 0) {
         program = std::string(argv[0]);
     }
 
+    auto addOption = [this](const std::string& key, const std::string& value) {
+        if (options.find(key) != options.end()) {
+            std::cerr << "Warning: Option '" << key << "' set multiple times"
+                      << std::endl;
+            return false;
+        }
+        options.emplace(key, value);
+        return true;
+    };
+
     for (int i = 1; i < argc; ++i) {
         const auto& arg = std::string(argv[i]);
         // std::string::starts_with is C++20, so we implement it manually
@@ -15,18 +25,27 @@ ArgumentsParser::ArgumentsParser(int argc, char** argv)
             if (eqPos != std::string::npos) {
                 auto key = arg.substr(2, eqPos - 2);
                 auto value = arg.substr(eqPos + 1);
-                if (options.find(key) != options.end()) {
-                    std::cerr << "Warning: Option '" << key << "' set multiple times"
-                              << std::endl;
+                if (!addOption(key, value)) {
                     success = false;
                     return;
-                } else {
-                    options.emplace(key, value);
                 }
             } else {
                 auto key = arg.substr(2);
                 flags.insert(key);
             }
+        } else if (arg.size() == 2 && arg[0] == '-') {
+            // Short option, the value is the next argument
+            if (i + 1 >= argc) {
+                std::cerr << "Warning: Option '" << arg << "' needs a value" << std::endl;
+                success = false;
+                return;
+            }
+            if (!addOption(arg.substr(1), argv[++i])) {
+                success = false;
+                return;
+            }
+        } else if (arguments.empty() && command.empty() && commands.count(arg) > 0) {
+            command = arg;
         } else {
             arguments.push_back(arg);
         }
@@ -53,6 +72,10 @@ const std::string& ArgumentsParser::getProgram() const {
     return program;
 }
 
+const std::string& ArgumentsParser::getCommand() const {
+    return command;
+}
+
 bool ArgumentsParser::hasFlag(const std::string& flag) const {
     return flags.find(flag) != flags.end();
 }
@@ -9,13 +9,17 @@
 
 class ArgumentsParser {
 public:
-    ArgumentsParser(int argc, char** argv);
+    // The first argument is taken as the command if it is one of commands.
+    // Options are --key=value or -k value, flags --key.
+    ArgumentsParser(int argc, char** argv, const std::set<std::string>& commands = {});
 
     bool isSuccess() const;
     const std::vector<std::string>& getArguments() const;
     const std::set<std::string>& getFlags() const;
     const std::map<std::string, std::string>& getOptions() const;
     const std::string& getProgram() const;
+    // Empty if no command was given
+    const std::string& getCommand() const;
 
     bool hasFlag(const std::string& flag) const;
     std::string getOption(const std::string& option,
@@ -27,6 +31,7 @@ private:
     std::map<std::string, std::string> options;
     bool success;
     std::string program;
+    std::string command;
 };
 
 #endif // ARGUMENT_PARSER_H
@@ -0,0 +1,174 @@
+#include "BuiltIns.h"
+
+#include <set>
+
+namespace builtins {
+
+const std::vector<Signature>& getSignatures() {
+    using P = DataType::Primitive;
+
+    static const std::vector<Signature> signatures{
+        // Arithmetic
+        {"+", DataType({P::Int, P::Int}, P::Int)},
+        {"-", DataType({P::Int, P::Int}, P::Int)},
+        {"*", DataType({P::Int, P::Int}, P::Int)},
+        {"/", DataType({P::Int, P::Int}, P::Int)},
+        {"%", DataType({P::Int, P::Int}, P::Int)},
+        {"+", DataType({P::Float, P::Float}, P::Float)},
+        {"-", DataType({P::Float, P::Float}, P::Float)},
+        {"*", DataType({P::Float, P::Float}, P::Float)},
+        {"/", DataType({P::Float, P::Float}, P::Float)},
+
+        // Comparison
+        {"<", DataType({P::Int, P::Int}, P::Bool)},
+        {">", DataType({P::Int, P::Int}, P::Bool)},
+        {">=", DataType({P::Int, P::Int}, P::Bool)},
+        {"<=", DataType({P::Int, P::Int}, P::Bool)},
+
+        {"==", DataType({P::Int, P::Int}, P::Bool)},
+        {"!=", DataType({P::Int, P::Int}, P::Bool)},
+        {"<", DataType({P::Float, P::Float}, P::Bool)},
+        {">", DataType({P::Float, P::Float}, P::Bool)},
+        {">=", DataType({P::Float, P::Float}, P::Bool)},
+        {"<=", DataType({P::Float, P::Float}, P::Bool)},
+        {"==", DataType({P::Float, P::Float}, P::Bool)},
+        {"!=", DataType({P::Float, P::Float}, P::Bool)},
+        {"==", DataType({P::Bool, P::Bool}, P::Bool)},
+        {"!=", DataType({P::Bool, P::Bool}, P::Bool)},
+        {"==", DataType({P::String, P::String}, P::Bool)},
+        {"!=", DataType({P::String, P::String}, P::Bool)},
+
+        // Conversion, toInt truncates towards zero
+        {"toFloat", DataType({P::Int}, P::Float)},
+        {"toInt", DataType({P::Float}, P::Int)},
+
+        // Boolean
+        {"||", DataType({P::Bool, P::Bool}, P::Bool)},
+        {"&&", DataType({P::Bool, P::Bool}, P::Bool)},
+
+        // Blob (raw memory)
+        {"alloc8", DataType({P::Int}, P::Blob)},
+        {"length", DataType({P::Blob}, P::Int)},
+        {"get", DataType({P::Blob, P::Int}, P::Int)},
+        {"set", DataType({P::Blob, P::Int, P::Int}, P::Void)},
+        // copy(dst, dstOffset, src, srcOffset, length)
+        {"copy", DataType({P::Blob, P::Int, P::Blob, P::Int, P::Int}, P::Void)},
+        // fill(blob, offset, length, byte)
+        {"fill", DataType({P::Blob, P::Int, P::Int, P::Int}, P::Void)},
+        // compare(a, aOffset, b, bOffset, length) -> -1, 0, 1
+        {"compare", DataType({P::Blob, P::Int, P::Blob, P::Int, P::Int}, P::Int)},
+        // find_byte(blob, offset, length, byte) -> index or -1
+        {"find_byte", DataType({P::Blob, P::Int, P::Int, P::Int}, P::Int)},
+
+        // String
+        {"+", DataType({P::String, P::String}, P::String)},
+        {"length", DataType({P::String}, P::Int)},
+        {"concat", DataType({P::String, P::String}, P::String)},
+        // substring(string, start, length)
+        {"substring", DataType({P::String, P::Int, P::Int}, P::String)},
+        {"equals", DataType({P::String, P::String}, P::Bool)},
+        {"hash", DataType({P::String}, P::Int)},
+        {"builder", DataType(std::vector<DataType>{}, P::StringBuilder)},
+        {"append", DataType({P::StringBuilder, P::String}, P::Void)},
+        {"build", DataType({P::StringBuilder}, P::String)},
+
+        // Output, buffered until flush() or the end of the program
+        {"print", DataType({P::Int}, P::Void)},
+        {"print", DataType({P::Bool}, P::Void)},
+        {"print", DataType({P::String}, P::Void)},
+        {"print", DataType({P::Float}, P::Void)},
+        {"flush", DataType(std::vector<DataType>{}, P::Void)},
+    };
+
+    return signatures;
+}
+
+bool isBuiltIn(const std::string& name) {
+    const auto& signatures = getSignatures();
+    return std::any_of(signatures.begin(), signatures.end(),
+                       [&name](const Signature& s) { return s.name == name; });
+}
+
+bool isPure(const std::string& name) {
+    static const std::set<std::string> pure = {"+", "-", "*", "<", ">", "<=", ">=", "==", "!=", "toFloat"};
+    return pure.count(name) > 0;
+}
+
+bool isReadOnly(const std::string& name) {
+    static const std::set<std::string> readOnly = {"/", "%", "toInt", "print", "length", "get", "contains",
+                                                   "size", "compare", "find_byte", "equals", "hash",
+                                                   "substring", "concat"};
+    return isPure(name) || readOnly.count(name) > 0;
+}
+
+// Map functions are generic over the key and value type of their first
+// argument: get, put (or set), contains, remove and size
+static DataType resolveMap(const std::string& name,
+                           const std::vector<DataType>& argumentTypes) {
+    using P = DataType::Primitive;
+    const auto& map = argumentTypes.front();
+    const auto& key = *map.getMap().key;
+    const auto& value = *map.getMap().value;
+
+    std::vector<DataType> params;
+    DataType ret;
+    if (name == "get") {
+        params = {map, key};
+        ret = value;
+    } else if (name == "put" || name == "set") {
+        params = {map, key, value};
+        ret = P::Void;
+    } else if (name == "contains" || name == "remove") {
+        params = {map, key};
+        ret = P::Bool;
+    } else if (name == "size") {
+        params = {map};
+        ret = P::Int;
+    } else {
+        return P::Unknown;
+    }
+
+    if (params.size() != argumentTypes.size()) return P::Unknown;
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (argumentTypes[i] != P::Unknown && argumentTypes[i] != params[i]) {
+            return P::Unknown;
+        }
+    }
+    return DataType(params, ret);
+}
+
+DataType resolve(const std::string& name,
+                 const std::vector<DataType>& argumentTypes) {
+    if (!argumentTypes.empty() && argumentTypes.front().isMap()) {
+        return resolveMap(name, argumentTypes);
+    }
+
+    // Unknown arguments match every parameter, known ones only their own type
+    auto isCompatible = [&argumentTypes](const Signature& signature) {
+        const auto& params = *signature.type.getParams();
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (argumentTypes[i] != DataType::Primitive::Unknown &&
+                argumentTypes[i] != params[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const Signature* match = nullptr;
+    for (const auto& signature : getSignatures()) {
+        if (signature.name == name &&
+            signature.type.getParams()->size() == argumentTypes.size() &&
+            isCompatible(signature)) {
+            if (match) {
+                // Ambiguous until more argument types are known
+                return DataType::Primitive::Unknown;
+            }
+            match = &signature;
+        }
+    }
+
+    return match ? match->type : DataType(DataType::Primitive::Unknown);
+}
+
+}  // namespace builtins
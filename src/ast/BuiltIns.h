@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "DataType.h"
+
+namespace builtins {
+
+/*
+ * Central place for the signatures of build-in functions. Names may be
+ * overloaded, the fitting signature is chosen by the argument types.
+ */
+struct Signature {
+    std::string name;
+    DataType type;
+};
+
+const std::vector<Signature>& getSignatures();
+
+bool isBuiltIn(const std::string& name);
+
+// Only computes a value from the arguments and can not fail, calls may be
+// moved and duplicated
+bool isPure(const std::string& name);
+
+// Does not write memory, but may fail or print
+bool isReadOnly(const std::string& name);
+
+/**
+ * Finds the build-in function type for a call. Functions on maps are
+ * resolved from the map type of the first argument.
+ * @param name of the called function
+ * @param argumentTypes of the call, may contain unknown types
+ * @return the function type or Unknown if no unambiguous signature fits
+ */
+DataType resolve(const std::string& name,
+                 const std::vector<DataType>& argumentTypes);
+
+}  // namespace builtins
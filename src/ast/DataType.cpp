@@ -14,17 +14,22 @@ DataType::DataType(const std::string& str) // TODO, maybe remove
 DataType::DataType(const std::vector<DataType>& params, DataType ret)
     : impl(Function{
           std::make_shared<const std::vector<DataType>>(params),
-          std::make_shared<const DataType>(ret), false /*isExtern*/}) {}
+          std::make_shared<const DataType>(ret), false /*isExtern*/,
+          false /*isVariadic*/}) {}
 
-DataType::DataType(const std::vector<DataType>& params, DataType ret, bool isExtern)
+DataType::DataType(const std::vector<DataType>& params, DataType ret, bool isExtern,
+                   bool isVariadic)
     : impl(Function{
           std::make_shared<const std::vector<DataType>>(params),
           std::make_shared<const DataType>(ret), 
-          isExtern}) {}
+          isExtern, isVariadic}) {}
 
 DataType::DataType(DataType::Struct structType)
     : impl(structType) {}
 
+DataType::DataType(DataType::Map mapType)
+    : impl(mapType) {}
+
 DataType::DataType(const DataType& other)
     : impl(other.impl) {}
 
@@ -46,9 +51,14 @@ bool DataType::operator==(const DataType& other) const {
         const auto& otherFunc = std::get<Function>(other.impl);
         return *thisFunc.ret == *otherFunc.ret &&
                *thisFunc.params == *otherFunc.params &&
-               thisFunc.isExtern == otherFunc.isExtern;
+               thisFunc.isExtern == otherFunc.isExtern &&
+               thisFunc.isVariadic == otherFunc.isVariadic;
     } else if (std::holds_alternative<Struct>(impl)) {
         return std::get<Struct>(impl).name == std::get<Struct>(other.impl).name;
+    } else if (std::holds_alternative<Map>(impl)) {
+        const auto& thisMap = std::get<Map>(impl);
+        const auto& otherMap = std::get<Map>(other.impl);
+        return *thisMap.key == *otherMap.key && *thisMap.value == *otherMap.value;
     }
     throwConstraintViolated("Unknown DataType variant in comparison");
 }
@@ -81,6 +91,8 @@ size_t DataType::getMemorySize() const {
         return 1ull;
     } else if (std::holds_alternative<Struct>(impl)) {
         return getStruct().getMemorySize();
+    } else if (std::holds_alternative<Map>(impl)) {
+        return 1ull; // Pointer to the map
     }
     throwConstraintViolated("Unknown DataType variant in getMemorySize");
     return 0; // Should never reach here
@@ -112,6 +124,12 @@ DataType::Primitive DataType::getPrimitive() const {
     return std::get<Simple>(impl).simple;
 }
 
+DataType::Primitive DataType::getKind() const {
+    if (isStruct()) return Primitive::Struct;
+    if (isMap()) return Primitive::Map;
+    return getPrimitive();
+}
+
 std::string DataType::toString() const {
     if (std::holds_alternative<Simple>(impl)) {
         const auto& simple = std::get<Simple>(impl).simple;
@@ -133,11 +151,15 @@ std::string DataType::toString() const {
             }
         }
         if (params->size() >= 1u) stream << "]";
+        if (func.isVariadic) stream << "...";
         stream << " -> " << ret->toString();
         return stream.str();
     } else if (std::holds_alternative<Struct>(impl)) {
         const auto& structType = std::get<Struct>(impl);
         return "struct " + structType.name;
+    } else if (std::holds_alternative<Map>(impl)) {
+        const auto& mapType = std::get<Map>(impl);
+        return "map<" + mapType.key->toString() + ", " + mapType.value->toString() + ">";
     }
     throwConstraintViolated("Unknown DataType variant in toString");
     return "Unexpected DataType variant";
@@ -162,10 +184,16 @@ std::string DataType::toString(DataType::Primitive type) {
             return "string";
         case DataType::Primitive::Bool:
             return "bool";
+        case DataType::Primitive::Blob:
+            return "blob";
+        case DataType::Primitive::StringBuilder:
+            return "stringbuilder";
         case DataType::Primitive::Void:
             return "void";
         case DataType::Primitive::Struct:
             return "struct";
+        case DataType::Primitive::Map:
+            return "map";
         case DataType::Primitive::Unknown:
             return "unknown";
         case DataType::Primitive::Conflict:
@@ -185,6 +213,8 @@ DataType::Primitive DataType::toPrimitive(const std::string& str) {
     if (lowerStr == "float") return DataType::Primitive::Float;
     if (lowerStr == "string") return DataType::Primitive::String;
     if (lowerStr == "bool") return DataType::Primitive::Bool;
+    if (lowerStr == "blob") return DataType::Primitive::Blob;
+    if (lowerStr == "stringbuilder") return DataType::Primitive::StringBuilder;
     if (lowerStr == "void") return DataType::Primitive::Void;
     if (lowerStr == "conflict") return DataType::Primitive::Conflict;
     if (lowerStr == "none") return DataType::Primitive::None;
@@ -204,6 +234,10 @@ size_t DataType::getHashNum() const {
     } else if (std::holds_alternative<Struct>(impl)) {
         const auto& structType = std::get<Struct>(impl);
         return std::hash<std::string>()(structType.name);
+    } else if (std::holds_alternative<Map>(impl)) {
+        const auto& mapType = std::get<Map>(impl);
+        return static_cast<size_t>(Primitive::Map) + 31u * mapType.key->getHashNum() +
+               961u * mapType.value->getHashNum();
     }
     throwConstraintViolated("Unknown DataType variant in getHashNum");
 }
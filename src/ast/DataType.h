@@ -21,8 +21,11 @@ class DataType {
         Float,
         String,
         Bool,
+        Blob,
+        StringBuilder,
         Void,
         Struct,
+        Map,
         Unknown,
         Conflict,
         None
@@ -31,7 +34,13 @@ class DataType {
     struct Struct{
         std::string name;
         std::map<std::string, StructMember> fields;
-        size_t getMemorySize() const;
+        size_t getMemorySize() const; // In words
+    };
+
+    struct Map{
+        // Keys are Int or String
+        std::shared_ptr<const DataType> key;
+        std::shared_ptr<const DataType> value;
     };
 
    private:
@@ -44,9 +53,10 @@ class DataType {
         std::shared_ptr<const std::vector<DataType>> params;
         std::shared_ptr<const DataType> ret;
         bool isExtern;
+        bool isVariadic; // Extern only, extra arguments are passed as they are
     };
 
-    std::variant<Simple, Function, Struct> impl;
+    std::variant<Simple, Function, Struct, Map> impl;
 
    public:
     // Simple type constructors
@@ -55,11 +65,15 @@ class DataType {
 
     // Function type constructor
     DataType(const std::vector<DataType>& params, DataType ret);
-    DataType(const std::vector<DataType>& params, DataType ret, bool isExtern);
+    DataType(const std::vector<DataType>& params, DataType ret, bool isExtern,
+             bool isVariadic = false);
 
     // Struct
     DataType(Struct structType);
 
+    // Map
+    DataType(Map mapType);
+
     DataType(const DataType& other);
 
     DataType();
@@ -110,6 +124,20 @@ class DataType {
         return std::get<Function>(impl);
     }
 
+    bool isMap() const {
+        return std::holds_alternative<Map>(impl);
+    }
+
+    const Map& getMap() const {
+        if (!isMap()) {
+            throwConstraintViolated("DataType is not a map");
+        }
+        return std::get<Map>(impl);
+    }
+
+    // Primitive of simple types, Struct and Map for these, None otherwise
+    Primitive getKind() const;
+
     bool isPrimitive() const {
         return std::holds_alternative<Simple>(impl);
     }
@@ -140,9 +168,11 @@ class DataType {
 };
 
 
-const size_t INVALID_OFFSET = std::numeric_limits<size_t>::max();
-
+// Structs live in native memory with the fields in declaration order.
+// Every field is one word: Int is int64_t, Float is double, Bool a 64 bit
+// integer and strings, blobs and nested structs are pointers. So the
+// layout matches a C struct of these types.
 struct StructMember {
     DataType type;
-    size_t offset; // Offset in bytes from the start of the struct
+    size_t offset; // Offset in words from the start of the struct
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -107,7 +108,7 @@ class Identifier : public Node {
     Identifier(const std::string& id, const SourcePosition& thePosition)
         : Node(thePosition), id(id), typeAnnotation{} {}
 
-    std::string getName() { return id; }
+    const std::string& getName() const { return id; }
 
     void setTypeAnnotation(const std::string& type) {
         typeAnnotation = type;
@@ -285,6 +286,7 @@ class Ret : public Node {
     }
 
     std::shared_ptr<Node> getExpr() { return expr; }
+    void setExpr(std::shared_ptr<Node> node) { expr = node; }
 
     virtual DataType getDataType() override {
         return DataType::Primitive::None;
@@ -445,13 +447,15 @@ class ExternFn : public Node {
     std::string library;
     std::vector<std::shared_ptr<Identifier>> parameters;
     std::string typeAnnotation;
+    bool variadic;
+    bool import;
 
    public:
     ExternFn(std::shared_ptr<Identifier> name,
            std::shared_ptr<Identifier> library,
            std::vector<std::shared_ptr<Identifier>> parameters,
            const SourcePosition& thePosition)
-        : Node(thePosition), name(name->getName()), library(library->getName()), parameters(), typeAnnotation{} {
+        : Node(thePosition), name(name->getName()), library(library->getName()), parameters(), typeAnnotation{}, variadic(false), import(false) {
         for (auto& p : parameters) {
             this->parameters.push_back(p);
         }
@@ -464,6 +468,14 @@ class ExternFn : public Node {
     const std::string& getName() { return name; }
     const std::string& getLibrary() { return library; }
 
+    // Accepts more arguments than parameters, like printf
+    void setVariadic(bool value) { variadic = value; }
+    bool isVariadic() const { return variadic; }
+
+    // Function of another module, library is the module, see Runner
+    void setImport(bool value) { import = value; }
+    bool isImport() const { return import; }
+
     void setTypeAnnotation(const std::string& type) {
         typeAnnotation = type;
     }
@@ -477,7 +489,7 @@ class ExternFn : public Node {
     }
 
     virtual void toString(std::stringstream& stream) override {
-        stream << getDataTypeString() << "externfn(";
+        stream << getDataTypeString() << (import ? "importfn(" : "externfn(");
         stream << getLibrary() << "::" << getName();
         stream << ", params(";
         for (auto it = parameters.begin(); it != parameters.end(); ++it) {
@@ -486,6 +498,9 @@ class ExternFn : public Node {
                 stream << ", ";
             }
         }
+        if (variadic) {
+            stream << (parameters.empty() ? "..." : ", ...");
+        }
         stream << "))";
     }
 
@@ -538,6 +553,9 @@ class If : public Node {
     std::shared_ptr<Node> getCondition() { return condition; }
     std::shared_ptr<Node> getPositive() { return bodyPositive; }
     std::shared_ptr<Node> getNegative() { return bodyNegative; }
+    void setCondition(std::shared_ptr<Node> node) { condition = node; }
+    void setPositive(std::shared_ptr<Node> node) { bodyPositive = node; }
+    void setNegative(std::shared_ptr<Node> node) { bodyNegative = node; }
 
     virtual void toString(std::stringstream& stream) override {
         stream << "if(";
@@ -579,6 +597,8 @@ class While : public Node {
 
     std::shared_ptr<Node> getCondition() { return condition; }
     std::shared_ptr<Node> getBody() { return body; }
+    void setCondition(std::shared_ptr<Node> node) { condition = node; }
+    void setBody(std::shared_ptr<Node> node) { body = node; }
 
     virtual void toString(std::stringstream& stream) override {
         stream << "while(";
@@ -632,8 +652,8 @@ class Literal : public Node {
         return {};
     }
 
-    int getIntValue() { return std::stoi(value); }
-    int getFloatValue() { return std::stof(value); }
+    std::int64_t getIntValue() { return std::stoll(value); }
+    double getFloatValue() { return std::stod(value); }
     bool getBoolValue() { return value == "true"; }
     std::string getStringValue() { return value; }
 };
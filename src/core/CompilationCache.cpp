@@ -0,0 +1,52 @@
+#include "CompilationCache.h"
+
+#include <cstdio>
+#include <filesystem>
+
+#include "../error/Exceptions.h"
+
+namespace core {
+
+CompilationCache::CompilationCache(std::string directory) : directory(std::move(directory)) {}
+
+std::string CompilationCache::path(std::uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mbc", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+std::shared_ptr<const executor::image::MappedImage> CompilationCache::find(std::uint64_t key) const {
+    auto file = path(key);
+    std::error_code error;
+    if (!std::filesystem::exists(file, error)) {
+        return nullptr;
+    }
+    try {
+        return std::make_shared<const executor::image::MappedImage>(file);
+    } catch (const ConstraintViolatedException&) {
+        return nullptr; // Unreadable entries are compiled and written again
+    }
+}
+
+bool CompilationCache::store(std::uint64_t key, const executor::Program& program) const {
+    try {
+        std::filesystem::create_directories(directory);
+        // Replaces the entry atomically
+        executor::image::save(program, path(key));
+        return true;
+    } catch (const std::filesystem::filesystem_error&) {
+        return false;
+    } catch (const ConstraintViolatedException&) {
+        return false;
+    }
+}
+
+std::uint64_t CompilationCache::hash(const std::string& text, std::uint64_t hash) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}  // namespace core
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "../executer/ByteCode.h"
+#include "../executer/Image.h"
+
+namespace core {
+
+/*
+ * Bytecode images of compiled programs in a directory, one file per key.
+ * The key is a hash of everything the compiler output depends on, see
+ * Mlang::cacheKey. Entries are written to a temporary file and renamed,
+ * so concurrent processes never see a partial image.
+ */
+class CompilationCache {
+   private:
+    std::string directory;
+
+   public:
+    explicit CompilationCache(std::string directory);
+
+    // The mapped image, nullptr if there is no usable entry
+    std::shared_ptr<const executor::image::MappedImage> find(std::uint64_t key) const;
+    // Best effort, false if the entry could not be written
+    bool store(std::uint64_t key, const executor::Program& program) const;
+
+    std::string path(std::uint64_t key) const;
+
+    // FNV-1a, continues from hash to combine several parts
+    static std::uint64_t hash(const std::string& text,
+                              std::uint64_t hash = 14695981039346656037ull);
+};
+
+}  // namespace core
@@ -0,0 +1,34 @@
+#include "CompiledProgram.h"
+
+namespace core {
+
+CompiledProgram::CompiledProgram(const executor::Program& program,
+                                 const ffi::LibraryOptions& libraryOptions, size_t maxInstructions)
+    : vm(std::make_unique<executor::ByteCodeVM>(program, libraryOptions)),
+      maxInstructions(maxInstructions) {
+    vm->setDebug(false);
+}
+
+const executor::Export& CompiledProgram::find(const std::string& name,
+                                              const std::vector<executor::ValueType>& params,
+                                              executor::ValueType result) const {
+    for (const auto& exported : vm->getExports()) {
+        if (exported.name == name) {
+            ASSURE(exported.params == params && exported.result == result,
+                   "CompiledProgram: Function has other parameter or result types");
+            return exported;
+        }
+    }
+    throwConstraintViolated("CompiledProgram: No function of that name");
+}
+
+bool CompiledProgram::hasFunction(const std::string& name) const {
+    for (const auto& exported : vm->getExports()) {
+        if (exported.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace core
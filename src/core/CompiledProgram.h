@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "../error/Exceptions.h"
+#include "../executer/ByteCode.h"
+
+namespace core {
+
+/*
+ * A compiled program for hosts which call its functions many times.
+ * Functions declared at the top level are looked up by name and called
+ * with native values, see Mlang::compileProgram:
+ *
+ *   auto add = program->getFunction<std::int64_t(std::int64_t, std::int64_t)>("add");
+ *   std::int64_t sum = add(1, 2);
+ *
+ * Int maps to std::int64_t, Float to double, Bool to bool and Void to void.
+ * Calls are not thread safe, they share the VM of the program.
+ */
+class CompiledProgram {
+   private:
+    std::unique_ptr<executor::ByteCodeVM> vm;
+    size_t maxInstructions;
+
+    // The export with the parameter and result types, throws otherwise
+    const executor::Export& find(const std::string& name, const std::vector<executor::ValueType>& params,
+                                 executor::ValueType result) const;
+
+    template <typename T>
+    static constexpr executor::ValueType valueType() {
+        if constexpr (std::is_same_v<T, std::int64_t>) {
+            return executor::ValueType::Int;
+        } else if constexpr (std::is_same_v<T, double>) {
+            return executor::ValueType::Float;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return executor::ValueType::Bool;
+        } else {
+            static_assert(std::is_void_v<T>, "Use std::int64_t, double, bool or void");
+            return executor::ValueType::Void;
+        }
+    }
+
+    template <typename T>
+    static executor::word_t toWord(T value) {
+        if constexpr (std::is_same_v<T, double>) {
+            return executor::fromFloat(value);
+        } else {
+            return static_cast<executor::word_t>(value);
+        }
+    }
+
+    template <typename T>
+    static T fromWord(executor::word_t word) {
+        if constexpr (std::is_same_v<T, double>) {
+            return executor::toFloat(word);
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return word != 0;
+        } else {
+            return static_cast<T>(word);
+        }
+    }
+
+   public:
+    template <typename Signature>
+    class Function;
+
+    // Handle of an exported function, valid as long as the program
+    template <typename Ret, typename... Args>
+    class Function<Ret(Args...)> {
+       private:
+        executor::ByteCodeVM* vm;
+        executor::word_t address;
+        size_t maxInstructions;
+
+       public:
+        Function(executor::ByteCodeVM* vm, executor::word_t address, size_t maxInstructions)
+            : vm(vm), address(address), maxInstructions(maxInstructions) {}
+
+        Ret operator()(Args... args) const {
+            // One more element, arrays can not be empty
+            const ffi::qword_t words[sizeof...(Args) + 1] = {toWord<Args>(args)..., 0};
+            [[maybe_unused]] auto result = vm->call(address, words, sizeof...(Args), maxInstructions);
+            if constexpr (!std::is_void_v<Ret>) {
+                return fromWord<Ret>(result);
+            }
+        }
+    };
+
+   private:
+    template <typename Ret, typename... Args>
+    Function<Ret(Args...)> lookup(const std::string& name, Ret (*)(Args...)) const {
+        const auto& exported = find(name, {valueType<Args>()...}, valueType<Ret>());
+        return Function<Ret(Args...)>(vm.get(), exported.address, maxInstructions);
+    }
+
+   public:
+    // maxInstructions limits each call, 0 means no limit
+    CompiledProgram(const executor::Program& program, const ffi::LibraryOptions& libraryOptions,
+                    size_t maxInstructions);
+
+    // Throws if there is no function of that name and type
+    template <typename Signature>
+    Function<Signature> getFunction(const std::string& name) const {
+        return lookup(name, static_cast<Signature*>(nullptr));
+    }
+
+    bool hasFunction(const std::string& name) const;
+
+    executor::ByteCodeVM& getVM() { return *vm; }
+};
+
+}  // namespace core
@@ -12,17 +12,24 @@
 #include "../transformer/HasUnknownTypes.h"
 #include "../transformer/ImplicitReturn.h"
 #include "../transformer/CollectTypes.h"
-#include "../transformer/UpdateOffsets.h"
 #include "../transformer/InfereIdentifierTypes.h"
 #include "../transformer/ApplyTypeAnnotations.h"
 #include "../transformer/InfereParameterTypes.h"
 #include "../transformer/InstantiateFunctions.h"
 #include "../transformer/AddVoidReturn.h"
+#include "../transformer/ConstantFolding.h"
+#include "../transformer/DeadCodeElimination.h"
+#include "../transformer/Inlining.h"
+#include "../transformer/LoopInvariantCodeMotion.h"
 #include "../validator/AllPathsReturn.h"
+#include "../validator/ExternCallbacks.h"
 #include "../emitter/Emitter.h"
 #include "../emitter/Python.h"
 #include "../emitter/ByteCodeEmitter.h"
 #include "../executer/ByteCode.h"
+#include "../executer/Image.h"
+#include "CompilationCache.h"
+#include "CompiledProgram.h"
 
 namespace core {
 
@@ -34,19 +41,44 @@ Mlang::Result Mlang::executeString(const std::string& theCode) {
     return execute("internal", theCode);
 }
 
+Mlang::Result Mlang::compileProgram(const std::string& theCode,
+                                    std::unique_ptr<CompiledProgram>& theProgram) {
+    executor::Program program;
+    auto rs = compile("internal", theCode, program, Target::Library);
+    if (rs != Mlang::Result::Signal::Success) {
+        return rs;
+    }
+    theProgram = std::make_unique<CompiledProgram>(program, settings.libraries,
+                                                   settings.maxInstructions);
+    if (settings.outputSink) {
+        theProgram->getVM().setOutputSink(settings.outputSink);
+    }
+    return rs;
+}
+
 Mlang::Result Mlang::execute(const std::string& theFile,
                              const std::string& theCode) {
+    executor::Program program;
+    auto rs = compile(theFile, theCode, program);
+    if (rs != Mlang::Result::Signal::Success) {
+        return rs;
+    }
+    executor::ByteCodeVM runner(program, settings.libraries);
+    return run(runner);
+}
+
+Mlang::Result Mlang::compile(const std::string& theFile, const std::string& theCode,
+                             executor::Program& program, Target target) {
     Tokenizer tokenizer(theFile, theCode);
 
-    std::cout << "Tokens:" << std::endl;
     auto tokens = tokenizer.getTokens();
     if (settings.showTokens) {
+        std::cout << "Tokens:" << std::endl;
         for (auto token : tokens) {
             std::cout << token << " ";
         }
-        std::cout << std::endl;
+        std::cout << std::endl << std::endl;
     }
-    std::cout << std::endl;
 
     Parser parser(std::move(tokens));
     auto ast = parser.getAst();
@@ -85,7 +117,6 @@ Mlang::Result Mlang::execute(const std::string& theFile,
 
             applyTypeAnnotationsWalker.process(ast);
             collectTypesWalker.process(ast);
-            updateOffsets(structs);
 
             // Identifier types
             InfereIdentifierTypes identTypesWalker;
@@ -165,11 +196,49 @@ Mlang::Result Mlang::execute(const std::string& theFile,
         }
     }
 
+    // Native code can only call back MLang functions
+    {
+        validator::ExternCallbacks callbackValidator;
+        for (auto& fn : fns) {
+            callbackValidator.validate(fn.second);
+            if (callbackValidator.hasErrors()) {
+                return Mlang::Result(Mlang::Result::Signal::Failure)
+                    .addError("Extern call validation failed:\n" +
+                              callbackValidator.getErrors().front().generateString(theCode));
+            }
+        }
+    }
+
     for (auto& fn : fns) {
         transformer::AddVoidReturn addVoidReturn;
         fn.second = addVoidReturn.process(fn.second);
     }
 
+    if (settings.inlineFunctions) {
+        transformer::Inlining inlining;
+        inlining.run(fns);
+    }
+
+    if (settings.foldConstants) {
+        transformer::ConstantFolding folding;
+        for (auto& fn : fns) {
+            folding.process(fn.second);
+        }
+    }
+
+    if (settings.hoistInvariants) {
+        transformer::LoopInvariantCodeMotion motion;
+        for (auto& fn : fns) {
+            motion.process(fn.second);
+        }
+    }
+
+    auto exports = instantiator.getExports();
+    if (settings.eliminateDeadCode) {
+        transformer::DeadCodeElimination elimination;
+        elimination.run(fns, exports, target != Target::Program);
+    }
+
     if (settings.showFunctions) {
         for (auto& fn : fns) {
             std::cout << "### " << fn.first << " ###" << std::endl;
@@ -178,9 +247,7 @@ Mlang::Result Mlang::execute(const std::string& theFile,
         }
     }
 
-    // TODO: Make sure after a return no other statements exist, otherwise create error
-
-    emitter::ByteCodeEmitter byteCodeEmitter(fns);
+    emitter::ByteCodeEmitter byteCodeEmitter(fns, exports, settings.reuseLocalSlots);
     byteCodeEmitter.run();
 
     if (settings.showEmission) {
@@ -188,32 +255,123 @@ Mlang::Result Mlang::execute(const std::string& theFile,
         std::cout << byteCodeEmitter.toString() << std::endl;
     }
 
-    auto program = byteCodeEmitter.getProgram();
-    executor::ByteCodeVM runner(program);
+    program = byteCodeEmitter.getProgram();
+    if (target != Target::Module && !program.links.empty()) {
+        const auto& link = program.links.front();
+        return Mlang::Result(Mlang::Result::Signal::Failure)
+            .addError("Unresolved import " + link.module + "::" + link.name +
+                      ", modules are linked by Runner");
+    }
+    return Mlang::Result(Mlang::Result::Signal::Success);
+}
+
+Mlang::Result Mlang::run(executor::ByteCodeVM& runner) {
     runner.setDebug(settings.showExecution);
+    if (settings.outputSink) {
+        runner.setOutputSink(settings.outputSink);
+    }
+    runner.setFfiProfiling(settings.profileFfi);
     auto result = runner.execute(settings.maxInstructions);
+    if (settings.profileFfi) {
+        std::cerr << runner.ffiReport() << std::endl;
+    }
 
     return Mlang::Result(Mlang::Result::Signal::Success, result);
 }
 
 Mlang::Result Mlang::executeFile(std::string thePath) {
+    std::string fileContent;
+    auto rs = readSource(thePath, fileContent);
+    if (rs != Mlang::Result::Signal::Success) {
+        return rs;
+    }
+    if (settings.cacheDirectory.empty()) {
+        return execute(thePath, fileContent);
+    }
+
+    CompilationCache cache(settings.cacheDirectory);
+    auto key = cacheKey(fileContent);
+    if (auto image = cache.find(key)) {
+        ++cacheStatistics.hits;
+        executor::ByteCodeVM runner(image, settings.libraries);
+        return run(runner);
+    }
+
+    ++cacheStatistics.misses;
+    executor::Program program;
+    rs = compile(thePath, fileContent, program);
+    if (rs != Mlang::Result::Signal::Success) {
+        return rs;
+    }
+    if (!cache.store(key, program)) {
+        ++cacheStatistics.failedStores;
+    }
+    executor::ByteCodeVM runner(program, settings.libraries);
+    return run(runner);
+}
+
+std::uint64_t Mlang::cacheKey(const std::string& theCode, std::uint32_t version) const {
+    // The compiler, the image format and the settings which change the
+    // output of the compiler
+    auto key = CompilationCache::hash(std::to_string(version));
+    key = CompilationCache::hash(std::to_string(executor::image::version), key);
+    key = CompilationCache::hash(settings.inlineFunctions ? "inline" : "", key);
+    key = CompilationCache::hash(settings.foldConstants ? "fold" : "", key);
+    key = CompilationCache::hash(settings.hoistInvariants ? "licm" : "", key);
+    key = CompilationCache::hash(settings.eliminateDeadCode ? "dce" : "", key);
+    key = CompilationCache::hash(settings.reuseLocalSlots ? "slots" : "", key);
+    return CompilationCache::hash(theCode, key);
+}
+
+Mlang::Result Mlang::compileFile(const std::string& thePath, const std::string& theImagePath) {
+    std::string fileContent;
+    auto rs = readSource(thePath, fileContent);
+    if (rs != Mlang::Result::Signal::Success) {
+        return rs;
+    }
+
+    executor::Program program;
+    rs = compile(thePath, fileContent, program);
+    if (rs != Mlang::Result::Signal::Success) {
+        return rs;
+    }
+    executor::image::save(program, theImagePath);
+    return rs;
+}
+
+Mlang::Result Mlang::executeImage(const std::string& theImagePath) {
+    if (settings.showEmission) {
+        std::cout << "Image: " << theImagePath << std::endl;
+    }
+    // Code and data are used from the mapping, not copied
+    auto image = std::make_shared<const executor::image::MappedImage>(theImagePath);
+    if (settings.showEmission) {
+        const auto& sections = image->getSections();
+        std::cout << executor::instructionsToString(std::vector<executor::Instruction>(
+                         sections.code, sections.code + sections.codeSize))
+                  << std::endl;
+    }
+    executor::ByteCodeVM runner(image, settings.libraries);
+    return run(runner);
+}
+
+Mlang::Result Mlang::readSource(const std::string& thePath, std::string& theContent) {
     std::ifstream stream(thePath);
     std::stringstream strBuffer;
     strBuffer << stream.rdbuf();
 
-    auto fileContent = strBuffer.str();
+    theContent = strBuffer.str();
 
     if (settings.showFileContent) {
         std::cout << "File: " << thePath << std::endl
-                  << fileContent << std::endl;
+                  << theContent << std::endl;
     }
 
-    if (!fileContent.empty()) {
-        return execute(thePath, fileContent);
-    } else {
+    if (theContent.empty()) {
         return Mlang::Result(Mlang::Result::Signal::Failure)
             .addError("File at " + thePath + " is empty");
     }
+    return Mlang::Result(Mlang::Result::Signal::Success);
 }
 
 Mlang::Result::Result(Mlang::Result::Signal signal, const std::string& content)
@@ -1,10 +1,22 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "../executer/Libraries.h"
+
+namespace executor {
+struct Program;
+class ByteCodeVM;
+}
+
 namespace core {
 
+class CompiledProgram;
+
 class Mlang {
    public:
     Mlang();
@@ -46,16 +58,61 @@ class Mlang {
         bool showTypeInference = false;
         bool showExecution = false;
         size_t maxInstructions = 0; // 0 means no limit
+        // Receives the output of print instead of stdout if set
+        std::function<void(const char* data, size_t length)> outputSink;
+        // Where extern libraries are searched and how they are bound
+        ffi::LibraryOptions libraries;
+        // Times calls of external functions, reported after execution
+        bool profileFfi = false;
+        // Compiled programs are cached in this directory if set
+        std::string cacheDirectory;
+        // Substitutes small functions into their call sites
+        bool inlineFunctions = true;
+        // Evaluates constant expressions and branches at compile time
+        bool foldConstants = true;
+        // Moves computations which do not change out of while loops
+        bool hoistInvariants = true;
+        // Removes unreachable statements and functions main does not use
+        bool eliminateDeadCode = true;
+        // Locals which are not live at the same time share a stack slot
+        bool reuseLocalSlots = true;
+    };
+
+    // What a compiled program is used for
+    enum class Target {
+        Program, // Runs main, imports are an error
+        Library, // Functions are called by the host, exports are kept
+        Module   // Linked by Runner, exports are kept and imports allowed
     };
 
     Settings settings;
 
+    // Changes with every change of the code the compiler generates, so the
+    // compilation cache does not return images of an older compiler.
+    // testCompilationCache fails when the output changes without a bump.
+    static constexpr std::uint32_t compilerVersion = 2;
+
+    struct CacheStatistics {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t failedStores = 0; // Compiled programs which could not be cached
+    };
+    // Lookups of executeFile in the compilation cache
+    const CacheStatistics& getCacheStatistics() const { return cacheStatistics; }
+
     /**
      * Execute mlang source code
      * @param mlang source code
      */
     Result executeString(const std::string& theCode);
 
+    /**
+     * Compiles mlang source code once, for calling its functions many times
+     * @param mlang source code
+     * @param receives the program on success
+     */
+    Result compileProgram(const std::string& theCode, std::unique_ptr<CompiledProgram>& theProgram);
+
     /**
      * Loads a source code file and executes it
      * @param path to the file
@@ -63,8 +120,43 @@ class Mlang {
      */
     Result executeFile(std::string thePath);
 
+    /**
+     * Compiles a source code file into a bytecode image
+     * @param path to the source file
+     * @param path of the image to write
+     */
+    Result compileFile(const std::string& thePath, const std::string& theImagePath);
+
+    /**
+     * Executes a bytecode image, without compiling anything
+     * @param path to the image
+     */
+    Result executeImage(const std::string& theImagePath);
+
+    /**
+     * Compiles mlang source code into a program
+     * @param file name for errors
+     * @param mlang source code
+     * @param receives the program on success
+     * @param what the program is used for
+     */
+    Result compile(const std::string& theFile, const std::string& theCode,
+                   executor::Program& program, Target target = Target::Program);
+
+    /**
+     * Runs a loaded program with the settings
+     * @param the VM of the program
+     */
+    Result run(executor::ByteCodeVM& runner);
+
+    // Identifies the output of the compiler of that version for the source
+    std::uint64_t cacheKey(const std::string& theCode, std::uint32_t version = compilerVersion) const;
+
    private:
+    CacheStatistics cacheStatistics;
+
     Result execute(const std::string& theFile, const std::string& theCode);
+    Result readSource(const std::string& thePath, std::string& theContent);
 };
 
 }
\ No newline at end of file
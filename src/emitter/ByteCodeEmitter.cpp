@@ -1,22 +1,107 @@
 #include "ByteCodeEmitter.h"
+#include "Peephole.h"
 
 #include "../error/Exceptions.h"
 #include "../core/Logger.h"
 
+#include <algorithm>
+#include <functional>
+
 
 namespace emitter {
 
-ByteCodeEmitter::ByteCodeEmitter(const std::map<std::string, std::shared_ptr<AST::Function>> &functions)
-    : functions(functions), program{}, backpatches{}, localNames{} {}
+namespace {
+struct BuildInOp {
+    std::string name;
+    // Type of the first parameter to tell overloads apart, Unknown matches all
+    DataType::Primitive firstParam;
+    executor::Op op;
+};
+}  // namespace
+
+// Build-in functions which are implemented by a single instruction
+static const std::vector<BuildInOp> buildInOps{
+    {"+", DataType::Primitive::Int, executor::Op::ADD},
+    {"+", DataType::Primitive::String, executor::Op::STR_CONCAT},
+    {"+", DataType::Primitive::Float, executor::Op::FADD},
+    {"-", DataType::Primitive::Float, executor::Op::FSUB},
+    {"*", DataType::Primitive::Float, executor::Op::FMUL},
+    {"/", DataType::Primitive::Float, executor::Op::FDIV},
+    {"<", DataType::Primitive::Float, executor::Op::FLT},
+    {">", DataType::Primitive::Float, executor::Op::FGT},
+    {"==", DataType::Primitive::Float, executor::Op::FEQ},
+    {"<=", DataType::Primitive::Float, executor::Op::FLTE},
+    {">=", DataType::Primitive::Float, executor::Op::FGTE},
+    {"!=", DataType::Primitive::Float, executor::Op::FNEQ},
+    {"toFloat", DataType::Primitive::Unknown, executor::Op::I2F},
+    {"toInt", DataType::Primitive::Unknown, executor::Op::F2I},
+    {"-", DataType::Primitive::Unknown, executor::Op::SUB},
+    {"*", DataType::Primitive::Unknown, executor::Op::MUL},
+    {"/", DataType::Primitive::Unknown, executor::Op::DIV},
+    {"%", DataType::Primitive::Unknown, executor::Op::MOD},
+    {"<", DataType::Primitive::Unknown, executor::Op::LT},
+    {">", DataType::Primitive::Unknown, executor::Op::GT},
+    {"==", DataType::Primitive::String, executor::Op::STR_EQ},
+    {"==", DataType::Primitive::Unknown, executor::Op::EQ},
+    {"<=", DataType::Primitive::Unknown, executor::Op::LTE},
+    {">=", DataType::Primitive::Unknown, executor::Op::GTE},
+    {"!=", DataType::Primitive::String, executor::Op::STR_NEQ},
+    {"!=", DataType::Primitive::Unknown, executor::Op::NEQ},
+    {"alloc8", DataType::Primitive::Unknown, executor::Op::ALLOC8},
+    {"length", DataType::Primitive::Blob, executor::Op::SIZE8},
+    {"length", DataType::Primitive::String, executor::Op::STR_LEN},
+    {"get", DataType::Primitive::Blob, executor::Op::LOADB},
+    {"set", DataType::Primitive::Blob, executor::Op::STOREB},
+    {"copy", DataType::Primitive::Unknown, executor::Op::MEMCPY},
+    {"fill", DataType::Primitive::Unknown, executor::Op::MEMSET},
+    {"compare", DataType::Primitive::Unknown, executor::Op::MEMCMP},
+    {"find_byte", DataType::Primitive::Unknown, executor::Op::MEMCHR},
+    {"concat", DataType::Primitive::Unknown, executor::Op::STR_CONCAT},
+    {"substring", DataType::Primitive::Unknown, executor::Op::STR_SUB},
+    {"equals", DataType::Primitive::Unknown, executor::Op::STR_EQ},
+    {"hash", DataType::Primitive::Unknown, executor::Op::STR_HASH},
+    {"builder", DataType::Primitive::Unknown, executor::Op::SB_NEW},
+    {"append", DataType::Primitive::Unknown, executor::Op::SB_APPEND},
+    {"build", DataType::Primitive::Unknown, executor::Op::SB_BUILD},
+    {"get", DataType::Primitive::Map, executor::Op::MAP_GET},
+    {"put", DataType::Primitive::Map, executor::Op::MAP_PUT},
+    {"set", DataType::Primitive::Map, executor::Op::MAP_PUT},
+    {"contains", DataType::Primitive::Map, executor::Op::MAP_HAS},
+    {"remove", DataType::Primitive::Map, executor::Op::MAP_DEL},
+    {"size", DataType::Primitive::Map, executor::Op::MAP_SIZE},
+    {"print", DataType::Primitive::String, executor::Op::PRINT_STR},
+    {"print", DataType::Primitive::Float, executor::Op::PRINT_FLOAT},
+    {"print", DataType::Primitive::Unknown, executor::Op::PRINTS},
+    {"flush", DataType::Primitive::Unknown, executor::Op::FLUSH},
+};
+
+static const BuildInOp* findBuildInOp(const std::string& name, const DataType& fnDataType) {
+    const auto& params = *fnDataType.getParams();
+    for (const auto& buildIn : buildInOps) {
+        if (buildIn.name == name &&
+            (buildIn.firstParam == DataType::Primitive::Unknown ||
+             (!params.empty() && params.front().getKind() == buildIn.firstParam))) {
+            return &buildIn;
+        }
+    }
+    return nullptr;
+}
+
+ByteCodeEmitter::ByteCodeEmitter(const std::map<std::string, std::shared_ptr<AST::Function>> &functions,
+                                 const std::map<std::string, std::string> &exports,
+                                 bool reuseSlots)
+    : functions(functions), exports(exports), program{}, backpatches{}, localIdxs{},
+      numLocalIdxs(0), num_params(0), reuseSlots(reuseSlots) {}
 
 
 executor::Program  ByteCodeEmitter::getProgram() {
-    return executor::Program{program.data, program.code};
+    return program;
 }
 
 void ByteCodeEmitter::run() {
     std::map<std::string, size_t> function_idxs;
 
+    program.codeRefs.push_back(code().size());
     code().push_back(executor::Instruction(executor::Op::PUSH, 0));
     code().push_back(executor::Instruction(executor::Op::CALL, 0)); // Call main
     code().push_back(executor::Instruction(executor::Op::TERM)); // We finish when we are back
@@ -25,13 +110,15 @@ void ByteCodeEmitter::run() {
         // TODO: All functions need to have unique names. If that is not a given,
         // we have to ensure this before with some kind of tree walker
 
-        localNames.clear();
+        localIdxs.assign(1, {});
+        numLocalIdxs = 0;
         for(const auto& param : fn.second->getHead()->getParameters()) {
-            localNames.push_back(param->getName());
+            declareLocal(param);
         }
-        num_params = localNames.size();  // Remember parameter count
+        num_params = numLocalIdxs;  // Remember parameter count
         function_idxs[fn.first] = code().size();
         process(fn.second->getBody(), false);
+        allocateSlots(function_idxs[fn.first]);
     }
 
     code().front().arg1 = function_idxs["main"]; // Set the call to main
@@ -46,39 +133,238 @@ void ByteCodeEmitter::run() {
         // Must be a push
         code()[bp.instruction_idx].arg1 = function_idxs[bp.label];
     }
+
+    for (const auto& [name, label] : exports) {
+        const auto& fnDataType = functions.at(label)->getHead()->getIdentifier()->getDataType();
+        executor::Export exported;
+        exported.name = name;
+        exported.address = function_idxs.at(label);
+        for (const auto& param : *fnDataType.getParams()) {
+            exported.params.push_back(valueType(param));
+        }
+        exported.result = valueType(*fnDataType.getReturn());
+        exported.type = typeName(fnDataType);
+        program.exports.push_back(std::move(exported));
+    }
+
+    Peephole peephole;
+    peephole.run(program);
+}
+
+void ByteCodeEmitter::allocateSlots(size_t functionStart) {
+    struct Range {
+        size_t start;
+        size_t end;
+    };
+
+    // Live ranges of the locals as instruction indices, parameters keep their slots
+    auto& instructions = code();
+    std::map<executor::word_t, Range> ranges;
+    std::vector<Range> loops;
+    for (size_t i = functionStart; i < instructions.size(); ++i) {
+        const auto& inst = instructions[i];
+        if ((inst.op == executor::Op::LOCALS || inst.op == executor::Op::LOCALL) &&
+            inst.arg1 >= num_params) {
+            auto it = ranges.find(inst.arg1);
+            if (it == ranges.end()) {
+                ranges.emplace(inst.arg1, Range{i, i});
+            } else {
+                it->second.end = i;
+            }
+        } else if (inst.op == executor::Op::JUMP && inst.arg1 <= i) {
+            loops.push_back(Range{inst.arg1, i}); // Back to the condition of a while
+        }
+    }
+
+    // Locals used in and outside of a loop live through the whole loop.
+    // Locals of the loop body are declared again in every iteration.
+    bool extended = true;
+    while (extended) {
+        extended = false;
+        for (auto& [local, range] : ranges) {
+            for (const auto& loop : loops) {
+                bool overlaps = range.start <= loop.end && loop.start <= range.end;
+                if (overlaps && (range.start > loop.start || range.end < loop.end) &&
+                    (range.start < loop.start || range.end > loop.end)) {
+                    range.start = std::min(range.start, loop.start);
+                    range.end = std::max(range.end, loop.end);
+                    extended = true;
+                }
+            }
+        }
+    }
+
+    // Each local takes the first slot which is free at its start
+    std::vector<std::pair<size_t, executor::word_t>> starts;
+    for (const auto& [local, range] : ranges) {
+        starts.emplace_back(range.start, local);
+    }
+    std::sort(starts.begin(), starts.end());
+    std::vector<size_t> slotEnds;
+    std::map<executor::word_t, executor::word_t> slots;
+    for (const auto& [start, local] : starts) {
+        size_t slot = 0;
+        while (reuseSlots && slot < slotEnds.size() && slotEnds[slot] >= start) {
+            ++slot;
+        }
+        if (!reuseSlots || slot == slotEnds.size()) {
+            slot = slotEnds.size();
+            slotEnds.push_back(0);
+        }
+        slotEnds[slot] = ranges.at(local).end;
+        slots[local] = num_params + slot;
+    }
+
+    size_t numLocals = reuseSlots ? slotEnds.size() : numLocalIdxs - num_params;
+    for (size_t i = functionStart; i < instructions.size(); ++i) {
+        auto& inst = instructions[i];
+        if (inst.op == executor::Op::RET) {
+            inst.arg2 = numLocals;
+        } else if (reuseSlots && (inst.op == executor::Op::LOCALS || inst.op == executor::Op::LOCALL) &&
+                   inst.arg1 >= num_params) {
+            inst.arg1 = slots.at(inst.arg1);
+        }
+    }
+}
+
+executor::ValueType ByteCodeEmitter::valueType(const DataType& dataType) {
+    switch (dataType.getKind()) {
+        case DataType::Primitive::Int: return executor::ValueType::Int;
+        case DataType::Primitive::Float: return executor::ValueType::Float;
+        case DataType::Primitive::Bool: return executor::ValueType::Bool;
+        case DataType::Primitive::Void:
+        case DataType::Primitive::None: return executor::ValueType::Void;
+        default: return executor::ValueType::Other;
+    }
+}
+
+std::string ByteCodeEmitter::typeName(const DataType& fnDataType) {
+    std::function<std::string(const DataType&)> name = [&name](const DataType& dataType) -> std::string {
+        if (dataType.isFunction()) {
+            return (dataType.getFunction().isExtern ? "extern " : "") + typeName(dataType);
+        } else if (dataType.isStruct()) {
+            const auto& structType = dataType.getStruct();
+            // In memory order, the layout has to match as well
+            std::vector<std::pair<size_t, std::string>> fields;
+            for (const auto& [field, member] : structType.fields) {
+                fields.emplace_back(member.offset, field + ": " + name(member.type));
+            }
+            std::sort(fields.begin(), fields.end());
+            std::string result = "struct " + structType.name + " {";
+            for (const auto& field : fields) {
+                result += (result.back() == '{' ? "" : ", ") + field.second;
+            }
+            return result + "}";
+        } else if (dataType.isMap()) {
+            const auto& mapType = dataType.getMap();
+            return "map<" + name(*mapType.key) + ", " + name(*mapType.value) + ">";
+        } else if (dataType.getKind() == DataType::Primitive::None) {
+            return DataType::toString(DataType::Primitive::Void);
+        }
+        return dataType.toString();
+    };
+
+    const auto& function = fnDataType.getFunction();
+    std::string result = "(";
+    for (const auto& param : *function.params) {
+        result += (result.back() == '(' ? "" : ", ") + name(param);
+    }
+    return result + ") -> " + name(*function.ret);
 }
 
 std::string ByteCodeEmitter::toString() {
-    return instructionsToString(code(), false);
+    std::string result = instructionsToString(code(), false) + "\nData: " +
+                         std::to_string(program.data.size()) + " bytes";
+    for (size_t i = 0; i < program.imports.size(); ++i) {
+        const auto& import = program.imports[i];
+        result += "\nImport " + std::to_string(i) + ": " + import.library +
+                  "::" + import.symbol;
+    }
+    for (const auto& exported : program.exports) {
+        result += "\nExport " + exported.name + ": " + std::to_string(exported.address);
+    }
+    for (const auto& link : program.links) {
+        result += "\nLink " + std::to_string(link.instruction) + ": " + link.module +
+                  "::" + link.name;
+    }
+    return result;
 }
 
-void ByteCodeEmitter::loadIdentifier(const std::shared_ptr<AST::Identifier>& identifier) {
+ffi::Signature ByteCodeEmitter::externSignature(const DataType& fnDataType,
+                                                const std::vector<DataType>& argTypes) {
+    ffi::qword_t returnTypeCode = 0;
+    switch(fnDataType.getReturn()->getPrimitive()){
+        case DataType::Primitive::Int:
+            returnTypeCode = ffi::ret_type::Number;
+            break;
+        case DataType::Primitive::Float:
+            returnTypeCode = ffi::ret_type::Float;
+            break;
+        case DataType::Primitive::Bool:
+            returnTypeCode = ffi::ret_type::Bool;
+            break;
+        case DataType::Primitive::Void:
+            returnTypeCode = ffi::ret_type::Void;
+            break;
+        default:
+            throwConstraintViolated("Unsupported extern function return type.");
+    }
+
+    std::vector<ffi::arg_types::type> types;
+    for (const auto& type : argTypes) {
+        types.push_back(type == DataType::Primitive::Float
+                            ? ffi::arg_types::Float
+                            : ffi::arg_types::QWord);
+    }
+    return ffi::Signature(returnTypeCode, types);
+}
+
+bool ByteCodeEmitter::isLocal(const std::string& name) const {
+    for (const auto& scope : localIdxs) {
+        if (scope.count(name) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    auto it = std::find(localNames.begin(), localNames.end(), identifier->getName());
-    if (it == localNames.end()) {
-        throwConstraintViolated("Identifier not found in local names.");
+size_t ByteCodeEmitter::declareLocal(const std::shared_ptr<AST::Identifier>& identifier) {
+    localIdxs.back().emplace(identifier->getName(), numLocalIdxs);
+    return numLocalIdxs++;
+}
+
+size_t ByteCodeEmitter::findLocal(const std::shared_ptr<AST::Identifier>& identifier) const {
+    for (auto scope = localIdxs.rbegin(); scope != localIdxs.rend(); ++scope) {
+        auto it = scope->find(identifier->getName());
+        if (it != scope->end()) {
+            return it->second;
+        }
     }
-    auto localIdx = std::distance(localNames.begin(), it);
+    throwConstraintViolated("Identifier not found in local names.");
+}
+
+void ByteCodeEmitter::processScoped(const std::shared_ptr<AST::Node>& node) {
+    localIdxs.emplace_back();
+    process(node, false);
+    localIdxs.pop_back();
+}
+
+void ByteCodeEmitter::loadIdentifier(const std::shared_ptr<AST::Identifier>& identifier) {
+    auto localIdx = findLocal(identifier);
     code().push_back(executor::Instruction(executor::Op::LOCALL, localIdx)); // Bring it on the stack
 }
 
 void ByteCodeEmitter::storeLocalInto(const std::shared_ptr<AST::Node>& node){
     switch(node->getType()) {
         case AST::NodeType::Identifier: {
-            auto identifier = std::dynamic_pointer_cast<AST::Identifier>(node);
-            auto it = std::find(localNames.begin(), localNames.end(), identifier->getName());
-            if (it == localNames.end()) {
-                throwConstraintViolated("Identifier not found in local names.");
-            }
-            auto localIdx = std::distance(localNames.begin(), it);
+            auto localIdx = findLocal(std::dynamic_pointer_cast<AST::Identifier>(node));
             code().push_back(executor::Instruction(executor::Op::LOCALS, localIdx));
             break;
         }
         case AST::NodeType::Declvar: {
             auto declvar = std::dynamic_pointer_cast<AST::Declvar>(node);
-            auto localIdx = localNames.size();
+            auto localIdx = declareLocal(declvar->getIdentifier());
             code().push_back(executor::Instruction(executor::Op::LOCALS, localIdx));
-            localNames.push_back(declvar->getIdentifier()->getName());
             break;
         }
         case AST::NodeType::StructAccess: {
@@ -92,11 +378,7 @@ void ByteCodeEmitter::storeLocalInto(const std::shared_ptr<AST::Node>& node){
                    "StructAccess must have at least one identifier.");
 
             // Load address in first identifier, it is a local variable
-            auto it = std::find(localNames.begin(), localNames.end(), (*identifierIt)->getName()); // TODO: This repeats, make function
-            if (it == localNames.end()) {
-                throwConstraintViolated("Identifier not found in local names.");
-            }
-            auto localIdx = std::distance(localNames.begin(), it);
+            auto localIdx = findLocal(*identifierIt);
             code().push_back(executor::Instruction(executor::Op::LOCALL, localIdx));
             // We got the address of the first struct on the stack
 
@@ -158,35 +440,33 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
         case AST::NodeType::ExternFn: {
             auto externFn = std::dynamic_pointer_cast<AST::ExternFn>(node);
 
-            // Add strings into the program data
-            auto aLibIdx = program.data.addString(externFn->getLibrary());
-            auto aNameIdx = program.data.addString(externFn->getName());
-
-            ffi::qword_t returnTypeCode = 0;
-            switch(externFn->getDataType().getReturn()->getPrimitive()){
-                case DataType::Primitive::Int:
-                    returnTypeCode = ffi::ret_type::Number;
-                    break;
-                case DataType::Primitive::Float:
-                    returnTypeCode = ffi::ret_type::Float;
-                    break;
-                case DataType::Primitive::Bool:
-                    returnTypeCode = ffi::ret_type::Bool;
-                    break;
-                case DataType::Primitive::Void:
-                    returnTypeCode = ffi::ret_type::Void;
-                    break;
-                default:
-                    throwConstraintViolated("Unsupported extern function return type.");
+            const auto& fnDataType = externFn->getDataType();
+            if (externFn->isImport()) {
+                // The linker puts in the address, also without consumer so
+                // a missing function is reported
+                executor::Link link;
+                link.instruction = code().size();
+                link.module = externFn->getLibrary();
+                link.name = externFn->getName();
+                link.type = typeName(fnDataType);
+                program.links.push_back(std::move(link));
+                code().push_back(executor::Instruction(executor::Op::PUSH, 0));
+                if (!hasConsumer) {
+                    code().push_back(executor::Instruction(executor::Op::POP));
+                }
+                break;
             }
 
-            // Register the external function
-            // This brings the function address on the stack
-            code().push_back(executor::Instruction(executor::Op::REG_FFI, aLibIdx, aNameIdx, returnTypeCode));
+            auto signature = externSignature(fnDataType, *fnDataType.getParams());
 
-            if(!hasConsumer) {
-                // TODO: We might just skip creating the function at all
-                code().push_back(executor::Instruction(executor::Op::POP));
+            // Resolved when the program is loaded, the import index is the
+            // function id. Imported even without consumer, so a missing
+            // symbol is reported.
+            auto importIdx = program.addImport(externFn->getLibrary(), externFn->getName(),
+                                               signature.encode());
+            if(hasConsumer) {
+                program.importRefs.push_back(code().size());
+                code().push_back(executor::Instruction(executor::Op::PUSH, importIdx));
             }
             break;
         }
@@ -197,9 +477,11 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
             break;
         }
         case AST::NodeType::Block: {
+            localIdxs.emplace_back();
             for(const auto& child : std::dynamic_pointer_cast<AST::Block>(node)->getChildren()) {
                 process(child, false);
             }
+            localIdxs.pop_back();
             break;
         }
         case AST::NodeType::Ret: {
@@ -207,9 +489,10 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
             if (ret->getExpr()) {
                 process(ret->getExpr(), true);
             }
-            // RET arg1=num_params, arg2=num_locals
-            size_t num_locals = localNames.size() - num_params;
-            code().push_back(executor::Instruction(executor::Op::RET, num_params, num_locals));
+            // RET arg1=num_params, arg2=num_locals, set by allocateSlots, arg3=has value
+            bool hasValue = ret->getExpr() &&
+                            valueType(ret->getExpr()->getDataType()) != executor::ValueType::Void;
+            code().push_back(executor::Instruction(executor::Op::RET, num_params, 0, hasValue));
             break;
         }
         case AST::NodeType::Assign: {
@@ -223,12 +506,12 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
             process(ifNode->getCondition(), true);
             auto jumpIfIdx = code().size();
             code().push_back(executor::Instruction(executor::Op::JUMP_IF, 0)); // Go to else or end
-            process(ifNode->getPositive(), false);
+            processScoped(ifNode->getPositive());
 
             if (ifNode->getNegative()) {
                 auto jumpEndIdx = code().size();
                 code().push_back(executor::Instruction(executor::Op::JUMP, 0)); // Go to end
-                process(ifNode->getNegative(), false);
+                processScoped(ifNode->getNegative());
                 auto endIdx = code().size();
                 code().push_back(executor::Instruction(executor::Op::NOP));
                 code()[jumpIfIdx].arg1 = jumpEndIdx + 1; // Backpatch the jump if, skip to end
@@ -246,7 +529,7 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
             process(whileNode->getCondition(), true);
             auto jumpIfIdx = code().size();
             code().push_back(executor::Instruction(executor::Op::JUMP_IF, 0)); // Go to end if false
-            process(whileNode->getBody(), false);
+            processScoped(whileNode->getBody());
             code().push_back(executor::Instruction(executor::Op::JUMP, startIdx)); // Jump back to condition
             auto endIdx = code().size();
             code().push_back(executor::Instruction(executor::Op::NOP));
@@ -263,36 +546,49 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
             ASSURE(fnDataType.isFunction(), "Call identifier must be a function type.");
             const auto& functionType = fnDataType.getFunction();
 
-            for(const auto& arg : call->getArguments()) {
-               process(arg, true);
-               if(functionType.isExtern){
-                    code().push_back(executor::Instruction(executor::Op::PUSH_FFI_QWORD));
+            const auto& params = *fnDataType.getParams();
+            const auto& args = call->getArguments();
+
+            // Types as the callee sees them, the extra arguments of variadic
+            // functions are passed with their own types
+            std::vector<DataType> argTypes(params.begin(), params.end());
+            if (functionType.isExtern) {
+                ASSURE(args.size() == params.size() ||
+                           (functionType.isVariadic && args.size() > params.size()),
+                       "Unexpected number of arguments for extern function");
+                for (size_t i = params.size(); i < args.size(); ++i) {
+                    argTypes.push_back(args[i]->getDataType());
+                }
+            }
+
+            for(size_t i = 0; i < args.size(); ++i) {
+               process(args[i], true);
+               if(functionType.isExtern && argTypes[i] == DataType::Primitive::String){
+                    // Inline strings have no address
+                    code().push_back(executor::Instruction(executor::Op::STR_CPTR));
+               }
+               if(functionType.isExtern && argTypes[i].isFunction()){
+                    // Native code gets a function pointer which calls back into the VM
+                    // Rejected before by validator::ExternCallbacks
+                    const auto& argType = args[i]->getDataType();
+                    ASSURE(!argType.isFunction() || !argType.getFunction().isExtern,
+                           "Extern functions can not be passed to extern functions");
+                    auto callbackSignature = externSignature(argTypes[i], *argTypes[i].getParams());
+                    code().push_back(executor::Instruction(executor::Op::FN_NATIVE,
+                                                           callbackSignature.encode()));
                }
             }
 
             const auto& fnName = identifier->getName();
-            if(fnName == "+"){
-                code().push_back(executor::Instruction(executor::Op::ADD));
-            } else if (fnName == "-") {
-                code().push_back(executor::Instruction(executor::Op::SUB));
-            } else if (fnName == "*") {
-                code().push_back(executor::Instruction(executor::Op::MUL));
-            } else if (fnName == "/") {
-                code().push_back(executor::Instruction(executor::Op::DIV));
-            } else if (fnName == "%") {
-                code().push_back(executor::Instruction(executor::Op::MOD));
-            } else if (fnName == "<") {
-                code().push_back(executor::Instruction(executor::Op::LT));
-            } else if (fnName == ">") {
-                code().push_back(executor::Instruction(executor::Op::GT));
-            } else if (fnName == "==") {
-                code().push_back(executor::Instruction(executor::Op::EQ));
-            } else if (fnName == "<=") {
-                code().push_back(executor::Instruction(executor::Op::LTE));
-            } else if (fnName == ">=") {
-                code().push_back(executor::Instruction(executor::Op::GTE));
-            } else if (fnName == "!=") {
-                code().push_back(executor::Instruction(executor::Op::NEQ));
+            const auto* buildIn = isLocal(fnName) ? nullptr : findBuildInOp(fnName, fnDataType);
+            if (buildIn) {
+                code().push_back(executor::Instruction(buildIn->op));
+
+                const auto& returnType = fnDataType.getReturn();
+                ASSURE_NOT_NULL(returnType);
+                if(!hasConsumer && *returnType != DataType::Primitive::Void) {
+                    code().push_back(executor::Instruction(executor::Op::POP));
+                }
             } else {
                 loadIdentifier(call->getIdentifier()); // Bring the function addr on the stack
 
@@ -303,7 +599,13 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
                 // If we don't have a consumer, we have to pop the result. We assume only one result.
                 // Only if the function is not void, of course.
                 if (functionType.isExtern) {
-                    code().push_back(executor::Instruction(executor::Op::CALL_FFI));
+                    // The arguments stay on the stack, the stub reads them from there.
+                    // Variadic calls need a stub for the signature of the call site.
+                    executor::word_t callSignature = 0;
+                    if (functionType.isVariadic) {
+                        callSignature = externSignature(fnDataType, argTypes).encode();
+                    }
+                    code().push_back(executor::Instruction(executor::Op::CALL_FFI, args.size(), callSignature));
 
                     // CALL_FFI always pushes a result, so we need to get rid of it
                     // if we don't have a consumer or the return type is None.
@@ -336,7 +638,7 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
                         executor::Op::PUSH, literal->getIntValue()));
                 } else if (literal->getDataType() == DataType::Primitive::Float) {
                     code().push_back(executor::Instruction(
-                        executor::Op::PUSH, literal->getFloatValue()));
+                        executor::Op::PUSH, executor::fromFloat(literal->getFloatValue())));
                 }
             }
             break;
@@ -346,6 +648,7 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
                 auto fnPtr = std::dynamic_pointer_cast<AST::FnPtr>(node);
                 // Later backpatch the address
                 backpatches.push_back(Backpatch{code().size(), fnPtr->getId()});
+                program.codeRefs.push_back(code().size());
                 code().push_back(executor::Instruction(executor::Op::PUSH, 0));
             }
             break;
@@ -359,8 +662,7 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
         case AST::NodeType::Declvar: {
             // Declare new variable with inital value 0
             auto declvar = std::dynamic_pointer_cast<AST::Declvar>(node);
-            auto localIdx = localNames.size();
-            localNames.push_back(declvar->getIdentifier()->getName());
+            auto localIdx = declareLocal(declvar->getIdentifier());
 
             const auto& dataType = declvar->getIdentifier()->getDataType();
 
@@ -371,6 +673,12 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
                 const auto& structType = dataType.getStruct();
                 allocStructs(structType);
                 code().push_back(executor::Instruction(executor::Op::LOCALS, localIdx));
+            } else if(dataType.isMap()) {
+                auto keyKind = *dataType.getMap().key == DataType::Primitive::String
+                    ? executor::HashMap::KeyKind::String
+                    : executor::HashMap::KeyKind::Int;
+                code().push_back(executor::Instruction(executor::Op::MAP_NEW, static_cast<executor::word_t>(keyKind)));
+                code().push_back(executor::Instruction(executor::Op::LOCALS, localIdx));
             }
             break;
         }
@@ -389,11 +697,7 @@ void ByteCodeEmitter::process(const std::shared_ptr<AST::Node>& node, bool hasCo
                    "StructAccess must have at least one identifier.");
 
             // Load address in first identifier, it is a local variable
-            auto it = std::find(localNames.begin(), localNames.end(), (*identifierIt)->getName()); // TODO: This repeats, make function
-            if (it == localNames.end()) {
-                throwConstraintViolated("Identifier not found in local names.");
-            }
-            auto localIdx = std::distance(localNames.begin(), it);
+            auto localIdx = findLocal(*identifierIt);
             code().push_back(executor::Instruction(executor::Op::LOCALL, localIdx));
             // We got the address of the first struct on the stack
 
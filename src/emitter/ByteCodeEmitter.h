@@ -4,6 +4,7 @@
 #include <memory>
 #include <sstream>
 #include <map>
+#include <unordered_map>
 
 #include "../ast/DataType.h"
 #include "../ast/Node.h"
@@ -19,6 +20,7 @@ class ByteCodeEmitter {
 
     private:
     std::map<std::string, std::shared_ptr<AST::Function>> functions;
+    std::map<std::string, std::string> exports; // Name -> function
     executor::Program program;
 
     struct Backpatch {
@@ -26,11 +28,18 @@ class ByteCodeEmitter {
         std::string label;
     };
     std::vector<Backpatch> backpatches;
-    std::vector<std::string> localNames; // Id is idx
+    // Name -> idx of the locals of the current function by block, inner
+    // blocks first. In one block the first declaration of a name wins.
+    std::vector<std::unordered_map<std::string, size_t>> localIdxs;
+    size_t numLocalIdxs; // Parameters and declarations, redeclarations too
     size_t num_params;  // Number of parameters for current function
+    bool reuseSlots;
 
     public:
-    ByteCodeEmitter(const std::map<std::string, std::shared_ptr<AST::Function>> &functions);
+    // With reuseSlots locals which are not live at the same time share a slot
+    ByteCodeEmitter(const std::map<std::string, std::shared_ptr<AST::Function>> &functions,
+                    const std::map<std::string, std::string> &exports = {},
+                    bool reuseSlots = true);
 
     virtual void run();
     virtual std::string toString();
@@ -43,9 +52,26 @@ class ByteCodeEmitter {
     }
 
     void process(const std::shared_ptr<AST::Node>& node, bool hasConsumer);
+    bool isLocal(const std::string& name) const;
+    size_t declareLocal(const std::shared_ptr<AST::Identifier>& identifier);
+    size_t findLocal(const std::shared_ptr<AST::Identifier>& identifier) const;
+    // Locals declared in node are not visible after it
+    void processScoped(const std::shared_ptr<AST::Node>& node);
     void loadIdentifier(const std::shared_ptr<AST::Identifier>& identifier);
     void storeLocalInto(const std::shared_ptr<AST::Node>& node);
     size_t allocStructs(const DataType::Struct& structType);
+    // Maps the locals of the function emitted from functionStart on to
+    // slots and sets the frame size of its RETs
+    void allocateSlots(size_t functionStart);
+
+    // Native signature of an extern function called with arguments of the
+    // given types. More arguments than parameters only for variadic ones.
+    static executor::ValueType valueType(const DataType& dataType);
+    // Canonical name of a function type, with the fields of structs, so
+    // the linker can compare the types of different modules
+    static std::string typeName(const DataType& fnDataType);
+    static ffi::Signature externSignature(const DataType& fnDataType,
+                                          const std::vector<DataType>& argTypes);
 };
 
 } // namespace emitter
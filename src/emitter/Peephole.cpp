@@ -0,0 +1,149 @@
+#include "Peephole.h"
+
+namespace emitter {
+
+using executor::Instruction;
+using executor::Op;
+using executor::word_t;
+
+Peephole::Peephole() : removed(0) {}
+
+std::vector<bool> Peephole::findTargets(const executor::Program& program) {
+    const auto& code = program.code;
+    std::vector<bool> targets(code.size() + 1, false);
+    auto mark = [&](word_t idx) {
+        if (idx < targets.size()) {
+            targets[idx] = true;
+        }
+    };
+
+    mark(0);
+    for (const auto& inst : code) {
+        if (inst.op == Op::JUMP || inst.op == Op::JUMP_IF) {
+            mark(inst.arg1);
+        }
+    }
+    for (auto ref : program.codeRefs) {
+        mark(code[ref].arg1);
+    }
+    for (const auto& exported : program.exports) {
+        mark(exported.address);
+    }
+    return targets;
+}
+
+word_t Peephole::resolve(const std::vector<Instruction>& code, word_t idx) {
+    // Bounded, loops without body jump to themselves
+    for (size_t steps = 0; steps < code.size() && idx < code.size(); ++steps) {
+        if (code[idx].op == Op::NOP) {
+            ++idx;
+        } else if (code[idx].op == Op::JUMP && code[idx].arg1 != idx) {
+            idx = code[idx].arg1;
+        } else {
+            break;
+        }
+    }
+    return idx;
+}
+
+void Peephole::compact(executor::Program& program, const std::vector<bool>& remove) {
+    auto& code = program.code;
+
+    // Removed instructions map to the next kept one
+    std::vector<word_t> newIdx(code.size() + 1);
+    word_t next = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        newIdx[i] = next;
+        if (!remove[i]) {
+            ++next;
+        }
+    }
+    newIdx[code.size()] = next;
+
+    auto remap = [&](word_t idx) { return idx < newIdx.size() ? newIdx[idx] : idx; };
+    for (auto& inst : code) {
+        if (inst.op == Op::JUMP || inst.op == Op::JUMP_IF) {
+            inst.arg1 = remap(inst.arg1);
+        }
+    }
+    for (auto& ref : program.codeRefs) {
+        code[ref].arg1 = remap(code[ref].arg1);
+        ref = newIdx[ref];
+    }
+    for (auto& ref : program.importRefs) {
+        ref = newIdx[ref];
+    }
+    for (auto& link : program.links) {
+        link.instruction = newIdx[link.instruction];
+    }
+    for (auto& exported : program.exports) {
+        exported.address = remap(exported.address);
+    }
+
+    std::vector<Instruction> kept;
+    kept.reserve(next);
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (!remove[i]) {
+            kept.push_back(code[i]);
+        }
+    }
+    code = std::move(kept);
+}
+
+void Peephole::run(executor::Program& program) {
+    auto& code = program.code;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        // Pushes of addresses and imports are changed by the linker
+        std::vector<bool> pinned(code.size(), false);
+        for (auto ref : program.codeRefs) {
+            pinned[ref] = true;
+        }
+        for (auto ref : program.importRefs) {
+            pinned[ref] = true;
+        }
+        for (const auto& link : program.links) {
+            pinned[link.instruction] = true;
+        }
+
+        for (auto& inst : code) {
+            if (inst.op == Op::JUMP || inst.op == Op::JUMP_IF) {
+                inst.arg1 = resolve(code, inst.arg1);
+            }
+        }
+        auto targets = findTargets(program);
+
+        std::vector<bool> remove(code.size(), false);
+        for (size_t i = 0; i < code.size(); ++i) {
+            auto& inst = code[i];
+            if (inst.op == Op::NOP || (inst.op == Op::JUMP && inst.arg1 == i + 1)) {
+                remove[i] = true;
+            } else if (i + 1 < code.size() && !targets[i + 1]) {
+                auto& following = code[i + 1];
+                if (inst.op == Op::PUSH && following.op == Op::POP && !pinned[i]) {
+                    remove[i] = remove[i + 1] = true;
+                    ++i;
+                } else if (inst.op == Op::LOCALS && following.op == Op::LOCALL &&
+                           inst.arg1 == following.arg1) {
+                    inst.op = Op::LOCALT;
+                    remove[i + 1] = true;
+                    ++i;
+                }
+            }
+        }
+
+        for (bool r : remove) {
+            if (r) {
+                ++removed;
+                changed = true;
+            }
+        }
+        if (changed) {
+            compact(program, remove);
+        }
+    }
+}
+
+}  // namespace emitter
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "../executer/ByteCode.h"
+
+namespace emitter {
+
+/*
+ * Cleans up emitted code, until nothing changes any more:
+ * - NOPs and jumps to the next instruction are removed
+ * - jumps to jumps go to the final target
+ * - PUSH x; POP pairs are removed
+ * - LOCALS n; LOCALL n become LOCALT n
+ * Jumps, function addresses, exports and the instructions which imports
+ * and links refer to are remapped. Runs after backpatching.
+ */
+class Peephole {
+   private:
+    size_t removed;
+
+    // Indices code jumps to or calls, pairs must not be split there
+    static std::vector<bool> findTargets(const executor::Program& program);
+    // Follows NOPs and jumps from idx
+    static executor::word_t resolve(const std::vector<executor::Instruction>& code,
+                                    executor::word_t idx);
+    // Removes the marked instructions and remaps all references
+    static void compact(executor::Program& program, const std::vector<bool>& remove);
+
+   public:
+    Peephole();
+
+    void run(executor::Program& program);
+
+    // Instructions removed so far
+    size_t getRemoved() const { return removed; }
+};
+
+}  // namespace emitter
@@ -0,0 +1,33 @@
+#include "Blob.h"
+
+#include "../error/Exceptions.h"
+
+namespace executor {
+namespace blob {
+
+word_t allocate(NativeHeap& heap, word_t size) {
+    ASSURE(size <= maxSize && size <= ~word_t(0) - sizeof(word_t), "Blob: Invalid size");
+    auto* memory =
+        static_cast<word_t*>(heap.allocate(sizeof(word_t) + size));
+    memory[0] = size;
+    return reinterpret_cast<word_t>(memory + 1);
+}
+
+word_t size(word_t blob) {
+    ASSURE(blob != 0, "Blob: Access to uninitialized blob");
+    return reinterpret_cast<const word_t*>(blob)[-1];
+}
+
+byte_t* bytes(word_t blob) {
+    ASSURE(blob != 0, "Blob: Access to uninitialized blob");
+    return reinterpret_cast<byte_t*>(blob);
+}
+
+void checkRange(word_t blob, word_t offset, word_t length) {
+    auto blobSize = size(blob);
+    ASSURE(offset <= blobSize && length <= blobSize - offset,
+           "Blob: Index out of bounds");
+}
+
+}  // namespace blob
+}  // namespace executor
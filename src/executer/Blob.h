@@ -0,0 +1,29 @@
+#pragma once
+
+#include "NativeHeap.h"
+#include "Types.h"
+
+namespace executor {
+namespace blob {
+
+// Memory layout: [size: word_t][bytes...]
+// A blob value is the address of its first byte. That way it can be handed
+// to external functions as a plain pointer.
+
+using byte_t = unsigned char;
+
+// Larger sizes are rejected, also negative ones which wrap around
+constexpr word_t maxSize = word_t(1) << 32;
+
+// Throws if size is above maxSize or can not be allocated
+word_t allocate(NativeHeap& heap, word_t size);
+
+word_t size(word_t blob);
+
+byte_t* bytes(word_t blob);
+
+// Throws if [offset, offset + length) is not inside the blob
+void checkRange(word_t blob, word_t offset, word_t length);
+
+}  // namespace blob
+}  // namespace executor
@@ -1,18 +1,37 @@
 #include "ByteCode.h"
 
+#include <chrono>
 #include <iostream>
 #include <list>
 #include <vector>
 #include <map>
 #include <sstream>
+#include <utility>
+
+#include <cstring>
 
 #include "../error/Exceptions.h"
+#include "Blob.h"
+#include "Image.h"
 
 namespace executor {
 
 Instruction::Instruction(Op op, word_t arg1, word_t arg2, word_t arg3)
         : op(op), arg1(arg1), arg2(arg2), arg3(arg3) {}
 
+size_t Program::addImport(const std::string& library, const std::string& symbol,
+                          ffi::qword_t signature) {
+    for (size_t i = 0; i < imports.size(); ++i) {
+        if (imports[i].library == library && imports[i].symbol == symbol) {
+            ASSURE(imports[i].signature == signature,
+                   "Extern function declared with different signatures");
+            return i;
+        }
+    }
+    imports.push_back(Import{library, symbol, signature});
+    return imports.size() - 1;
+}
+
 std::string instructionsToString(const std::vector<Instruction>& instructions, bool named_args) {
 
     static std::map<Op, OpCodeMetadata> opCodeMetadata {
@@ -20,7 +39,7 @@ std::string instructionsToString(const std::vector<Instruction>& instructions, b
         { Op::LOCALS, { "LOCALS", { "ID" } } },
         { Op::LOCALL, { "LOCALL", { "ID" } } },
         { Op::CALL, { "CALL", { "NUM_ARGS" } } },
-        { Op::RET, { "RET", { "NUM_PARAMS", "NUM_LOCALS" } } },
+        { Op::RET, { "RET", { "NUM_PARAMS", "NUM_LOCALS", "HAS_VALUE" } } },
         { Op::PUSH, { "PUSH", { "VALUE" } } },
         { Op::POP, { "POP", {} } },
         { Op::ADD, { "ADD", {} } },
@@ -42,13 +61,50 @@ std::string instructionsToString(const std::vector<Instruction>& instructions, b
         { Op::GTE, {"GTE", {}} },
         { Op::NEQ, {"NEQ", {}} },
         { Op::DUB, {"DUB", {"LOOKBACK"}} },
-        { Op::REG_FFI, {"REG_FFI", { "LIB_DATA_IDX", "NAME_DATA_IDX", "RETURN" }} },
-        { Op::PUSH_FFI_WORD, {"PUSH_FFI_WORD", {}} },
-        { Op::PUSH_FFI_DWORD, {"PUSH_FFI_DWORD", {}} },
-        { Op::PUSH_FFI_QWORD, {"PUSH_FFI_QWORD", {}} },
-        { Op::PUSH_FFI_XWORD, {"PUSH_FFI_XWORD", {}} },
-        { Op::CALL_FFI, {"CALL_FFI", {}} },
-        { Op::DATA_ADDR, {"DATA_ADDR", {"DATA_IDX"}} }
+        { Op::CALL_FFI, {"CALL_FFI", { "NUM_ARGS", "CALL_SIGNATURE" }} },
+        { Op::DATA_ADDR, {"DATA_ADDR", {"DATA_IDX"}} },
+        { Op::ALLOC8, {"ALLOC8", {}} },
+        { Op::SIZE8, {"SIZE8", {}} },
+        { Op::LOADB, {"LOADB", {}} },
+        { Op::STOREB, {"STOREB", {}} },
+        { Op::MEMCPY, {"MEMCPY", {}} },
+        { Op::MEMSET, {"MEMSET", {}} },
+        { Op::MEMCMP, {"MEMCMP", {}} },
+        { Op::MEMCHR, {"MEMCHR", {}} },
+        { Op::STR_LEN, {"STR_LEN", {}} },
+        { Op::STR_CONCAT, {"STR_CONCAT", {}} },
+        { Op::STR_SUB, {"STR_SUB", {}} },
+        { Op::STR_EQ, {"STR_EQ", {}} },
+        { Op::STR_NEQ, {"STR_NEQ", {}} },
+        { Op::STR_HASH, {"STR_HASH", {}} },
+        { Op::STR_CPTR, {"STR_CPTR", {}} },
+        { Op::SB_NEW, {"SB_NEW", {}} },
+        { Op::SB_APPEND, {"SB_APPEND", {}} },
+        { Op::SB_BUILD, {"SB_BUILD", {}} },
+        { Op::MAP_NEW, {"MAP_NEW", {"KEY_KIND"}} },
+        { Op::MAP_GET, {"MAP_GET", {}} },
+        { Op::MAP_PUT, {"MAP_PUT", {}} },
+        { Op::MAP_HAS, {"MAP_HAS", {}} },
+        { Op::MAP_DEL, {"MAP_DEL", {}} },
+        { Op::MAP_SIZE, {"MAP_SIZE", {}} },
+        { Op::PRINT_STR, {"PRINT_STR", {}} },
+        { Op::FLUSH, {"FLUSH", {}} },
+        { Op::FADD, {"FADD", {}} },
+        { Op::FSUB, {"FSUB", {}} },
+        { Op::FMUL, {"FMUL", {}} },
+        { Op::FDIV, {"FDIV", {}} },
+        { Op::FLT, {"FLT", {}} },
+        { Op::FGT, {"FGT", {}} },
+        { Op::FEQ, {"FEQ", {}} },
+        { Op::FLTE, {"FLTE", {}} },
+        { Op::FGTE, {"FGTE", {}} },
+        { Op::FNEQ, {"FNEQ", {}} },
+        { Op::I2F, {"I2F", {}} },
+        { Op::F2I, {"F2I", {}} },
+        { Op::PRINT_FLOAT, {"PRINT_FLOAT", {}} },
+        { Op::FN_NATIVE, {"FN_NATIVE", { "SIGNATURE" }} },
+        { Op::LOCALT, {"LOCALT", {"ID"}} },
+        { Op::CALL_FFI_PROFILED, {"CALL_FFI_PROFILED", { "NUM_ARGS", "CALL_SIGNATURE" }} }
     };
 
     std::stringstream ss;
@@ -88,10 +144,10 @@ std::string instructionsToString(const std::vector<Instruction>& instructions, b
 
 ProgramState ByteCodeVM::run(size_t maxInstructions) {
     for (size_t instructionCount = 0; instructionCount < maxInstructions || maxInstructions == 0; ++instructionCount) {
-        if (idx >= program.code.size()) {
+        if (idx >= codeSize) {
             throwConstraintViolated("ByteCodeVM: Instruction index out of bounds");
         }
-        const Instruction& inst = program.code[idx++];
+        const Instruction& inst = code[idx++];
 
         if(debug) {
             std::cout << "Executing instruction: " << instructionsToString({inst}, true);
@@ -130,31 +186,17 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
                 break;
             }
             case Op::RET: {
-                word_t num_params = inst.arg1;
-                word_t num_locals = inst.arg2;
-
+                // RET NUM_PARAMS NUM_LOCALS HAS_VALUE
                 //                                           function_stack_base
                 //                                                   |
                 // Stack layout: [ret_addr][prev_function_stack_base]^[params...][locals...][return_value?]
 
-                word_t expected_stack_size = function_stack_base + num_params + num_locals;
-                bool has_return_value = false;
-                if (stack.size() > expected_stack_size) {
-                    return_value = stack.pop();
-                    has_return_value = true;
-                } else {
-                    return_value = 0;
-                }
+                bool has_return_value = inst.arg3 != 0;
+                return_value = has_return_value ? stack.pop() : 0;
 
-                // Pop locals
-                while (stack.size() > function_stack_base + num_params) {
-                    stack.pop();
-                }
-
-                // Pop parameters
-                for (word_t i = 0; i < num_params; ++i) {
-                    stack.pop();
-                }
+                // Pop locals and parameters, locals the function did not
+                // reach are not on the stack
+                stack.drop(stack.size() - function_stack_base);
 
                 // Check if this is the main function return
                 if (function_stack_base == 0) {
@@ -168,6 +210,10 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
                     stack.push(return_value);
                 }
 
+                if (idx == returnToNative) {
+                    return ProgramState::Returned;
+                }
+
                 break;
             }
             case Op::LOCALS: {
@@ -184,6 +230,19 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
                 stack.set(localIndex, value);
                 break;
             }
+            case Op::LOCALT: {
+                // LOCALT n: Store stack top into local n and keep it on the stack
+                word_t value = stack.pop();
+
+                word_t localIndex = function_stack_base + inst.arg1;
+                while (stack.size() <= localIndex) {
+                    stack.push(0);
+                }
+
+                stack.set(localIndex, value);
+                stack.push(value);
+                break;
+            }
             case Op::LOCALL: {
                 // LOCALL n: Load local variable/parameter n onto stack
                 word_t localIndex = function_stack_base + inst.arg1;
@@ -196,7 +255,22 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
                 break;
             }
             case Op::PRINTS: {
-                std::cout << stack.pop() << std::endl;
+                output.writeInt(stack.pop());
+                output.writeLine();
+                break;
+            }
+            case Op::PRINT_STR: {
+                output.writeString(stack.pop());
+                output.writeLine();
+                break;
+            }
+            case Op::PRINT_FLOAT: {
+                output.writeFloat(toFloat(stack.pop()));
+                output.writeLine();
+                break;
+            }
+            case Op::FLUSH: {
+                output.flush();
                 break;
             }
             case Op::PUSH: {
@@ -274,6 +348,77 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
                 stack.push(b != a ? 1 : 0);
                 break;
             }
+            case Op::FADD: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(fromFloat(b + a));
+                break;
+            }
+            case Op::FSUB: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(fromFloat(b - a));
+                break;
+            }
+            case Op::FMUL: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(fromFloat(b * a));
+                break;
+            }
+            case Op::FDIV: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(fromFloat(b / a));
+                break;
+            }
+            case Op::FLT: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(b < a ? 1 : 0);
+                break;
+            }
+            case Op::FGT: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(b > a ? 1 : 0);
+                break;
+            }
+            case Op::FEQ: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(b == a ? 1 : 0);
+                break;
+            }
+            case Op::FLTE: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(b <= a ? 1 : 0);
+                break;
+            }
+            case Op::FGTE: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(b >= a ? 1 : 0);
+                break;
+            }
+            case Op::FNEQ: {
+                auto a = toFloat(stack.pop());
+                auto b = toFloat(stack.pop());
+                stack.push(b != a ? 1 : 0);
+                break;
+            }
+            case Op::I2F: {
+                auto value = static_cast<int64_t>(stack.pop());
+                stack.push(fromFloat(static_cast<double>(value)));
+                break;
+            }
+            case Op::F2I: {
+                // Truncates towards zero
+                auto value = static_cast<int64_t>(toFloat(stack.pop()));
+                stack.push(static_cast<word_t>(value));
+                break;
+            }
             case Op::JUMP: {
                 idx = inst.arg1; // Jump to address
                 break;
@@ -287,34 +432,33 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
             }
             case Op::ALLOC: {
                 // ALLOC SIZE
+                // Pushes the address of SIZE zeroed words. Structs are real
+                // pointers, external functions can use them without copies.
                 if (inst.arg1 <= 0) {
                     throwConstraintViolated("ByteCodeVM: Invalid allocation size");
                 }
-                // auto parentObj = stack.pop(); // TODO: Also have a parent object and garbage collection
-                auto addr = heap.size();
-                stack.push(addr + 1);
-                auto idx = addr + inst.arg1 + 1;
-                if(heap.size() <= idx) {
-                    heap.resize(idx);
-                }
-                // heap[addr] = parentObj; // Store parent object for garbage collection
+                // TODO: Also have a parent object and garbage collection
+                auto* memory = nativeHeap.allocate(inst.arg1 * sizeof(word_t));
+                stack.push(reinterpret_cast<word_t>(memory));
                 break;
             }
             case Op::LOADW: {
                 // LOADW OFFSET
-                // Read from heap at stack top + offset
+                // Read the word at stack top + offset words
                 auto offset = inst.arg1;
-                auto addr = stack.pop();
-                stack.push(heap.at(addr + offset));
+                auto* fields = reinterpret_cast<const word_t*>(stack.pop());
+                ASSURE(fields != nullptr, "ByteCodeVM: Access to uninitialized struct");
+                stack.push(fields[offset]);
                 break;
             }
             case Op::STOREW: {
                 // STOREW OFFSET
-                // Write to heap at stack top + offset
+                // Write to the word at stack top + offset words
                 auto offset = inst.arg1;
-                auto addr = stack.pop();
+                auto* fields = reinterpret_cast<word_t*>(stack.pop());
                 auto value = stack.pop();
-                heap.at(addr + offset) = value;
+                ASSURE(fields != nullptr, "ByteCodeVM: Access to uninitialized struct");
+                fields[offset] = value;
                 break;
             }
             case Op::DUB: {
@@ -327,56 +471,429 @@ ProgramState ByteCodeVM::run(size_t maxInstructions) {
             case Op::TERM: {
                 return ProgramState::Finished;
             }
-            case Op::REG_FFI: {
-                // Register FFI function
-                auto lib = program.data.getString(inst.arg1); // Library name
-                auto name = program.data.getString(inst.arg2); // Function name
-                auto retType = inst.arg3;
-                auto id = ffiFunctions.add(lib, name, retType);
-                stack.push(id);
-                break;
-            }
-            case Op::PUSH_FFI_WORD:
-            case Op::PUSH_FFI_DWORD:
-            case Op::PUSH_FFI_QWORD: 
-            case Op::PUSH_FFI_XWORD: // TODO: Distinguish between these types
-            {
-                auto value = stack.pop();
-                ffiArgs.addQWord(value);
+            case Op::CALL_FFI: {
+                // CALL_FFI NUM_ARGS CALL_SIGNATURE
+                // Stack: args..., function id (the import index). The stub reads the arguments
+                // directly from the stack. Calls to variadic functions carry
+                // the signature of the actual arguments, 0 otherwise.
+                // External functions may print themselves, keep the order
+                output.flush();
+                auto id = stack.pop();
+                static_assert(sizeof(word_t) == sizeof(ffi::qword_t));
+                auto args = reinterpret_cast<const ffi::qword_t*>(stack.top(inst.arg1));
+                auto result = inst.arg2 == 0
+                                  ? ffiFunctions.call(id, args)
+                                  : ffiFunctions.call(id, args, inst.arg2);
+                stack.drop(inst.arg1);
+                stack.push(result);
+                if (callbackError) {
+                    std::rethrow_exception(std::exchange(callbackError, nullptr));
+                }
                 break;
             }
-            case Op::CALL_FFI: {
+            case Op::CALL_FFI_PROFILED: {
+                // Same as CALL_FFI, also records the time of the call
+                output.flush();
                 auto id = stack.pop();
-                auto result = ffiFunctions.call(id, ffiArgs);
+                auto args = reinterpret_cast<const ffi::qword_t*>(stack.top(inst.arg1));
+                auto start = std::chrono::steady_clock::now();
+                auto result = inst.arg2 == 0
+                                  ? ffiFunctions.call(id, args)
+                                  : ffiFunctions.call(id, args, inst.arg2);
+                auto duration = std::chrono::steady_clock::now() - start;
+                ffiStatistics[id].record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+                stack.drop(inst.arg1);
                 stack.push(result);
-                ffiArgs.clear();
+                if (callbackError) {
+                    std::rethrow_exception(std::exchange(callbackError, nullptr));
+                }
+                break;
+            }
+            case Op::FN_NATIVE: {
+                // FN_NATIVE SIGNATURE
+                // Replaces the function address on the stack by a native
+                // function pointer, which runs the function in this VM
+                auto address = stack.pop();
+                auto& callback = callbacks[{address, inst.arg1}];
+                if (!callback) {
+                    auto signature = ffi::Signature::decode(inst.arg1);
+                    callback = std::make_unique<Callback>(
+                        Callback{this, address, signature.args.size(), nullptr});
+                    callback->thunk = ffiFunctions.thunk(signature, callback.get(),
+                                                         &ByteCodeVM::dispatchCallback);
+                }
+                stack.push(reinterpret_cast<word_t>(callback->thunk));
                 break;
             }
             case Op::DATA_ADDR: {
                 // DATA_ADDR DATA_IDX
                 auto dataIdx = inst.arg1;
-                void* addr = program.data.getAddr(dataIdx);
+                ASSURE(dataIdx < dataSize, "Data: Index out of bounds");
+                const void* addr = data + dataIdx;
                 static_assert(sizeof(word_t) == sizeof(void*));
                 stack.push(reinterpret_cast<word_t>(addr));
                 break;
             }
+            case Op::ALLOC8: {
+                // Allocate a zeroed blob, size is on the stack
+                auto size = stack.pop();
+                stack.push(blob::allocate(nativeHeap, size));
+                break;
+            }
+            case Op::SIZE8: {
+                auto b = stack.pop();
+                stack.push(blob::size(b));
+                break;
+            }
+            case Op::LOADB: {
+                // Stack: blob, index
+                auto index = stack.pop();
+                auto b = stack.pop();
+                blob::checkRange(b, index, 1);
+                stack.push(blob::bytes(b)[index]);
+                break;
+            }
+            case Op::STOREB: {
+                // Stack: blob, index, value
+                auto value = stack.pop();
+                auto index = stack.pop();
+                auto b = stack.pop();
+                blob::checkRange(b, index, 1);
+                blob::bytes(b)[index] = static_cast<blob::byte_t>(value);
+                break;
+            }
+            case Op::MEMCPY: {
+                // Stack: dst, dstOffset, src, srcOffset, length
+                auto length = stack.pop();
+                auto srcOffset = stack.pop();
+                auto src = stack.pop();
+                auto dstOffset = stack.pop();
+                auto dst = stack.pop();
+                blob::checkRange(src, srcOffset, length);
+                blob::checkRange(dst, dstOffset, length);
+                // Source and destination may be the same blob
+                std::memmove(blob::bytes(dst) + dstOffset,
+                             blob::bytes(src) + srcOffset, length);
+                break;
+            }
+            case Op::MEMSET: {
+                // Stack: blob, offset, length, byte
+                auto value = stack.pop();
+                auto length = stack.pop();
+                auto offset = stack.pop();
+                auto b = stack.pop();
+                blob::checkRange(b, offset, length);
+                std::memset(blob::bytes(b) + offset,
+                            static_cast<blob::byte_t>(value), length);
+                break;
+            }
+            case Op::MEMCMP: {
+                // Stack: a, aOffset, b, bOffset, length
+                auto length = stack.pop();
+                auto bOffset = stack.pop();
+                auto b = stack.pop();
+                auto aOffset = stack.pop();
+                auto a = stack.pop();
+                blob::checkRange(a, aOffset, length);
+                blob::checkRange(b, bOffset, length);
+                auto cmp = std::memcmp(blob::bytes(a) + aOffset,
+                                       blob::bytes(b) + bOffset, length);
+                stack.push(static_cast<word_t>(cmp < 0 ? -1 : (cmp > 0 ? 1 : 0)));
+                break;
+            }
+            case Op::MEMCHR: {
+                // Stack: blob, offset, length, byte
+                auto value = stack.pop();
+                auto length = stack.pop();
+                auto offset = stack.pop();
+                auto b = stack.pop();
+                blob::checkRange(b, offset, length);
+                const auto* begin = blob::bytes(b);
+                const auto* found = static_cast<const blob::byte_t*>(
+                    std::memchr(begin + offset, static_cast<int>(value & 0xFF), length));
+                stack.push(found ? static_cast<word_t>(found - begin)
+                                 : static_cast<word_t>(-1));
+                break;
+            }
+            case Op::STR_LEN: {
+                auto s = stack.pop();
+                stack.push(strings::length(s));
+                break;
+            }
+            case Op::STR_CONCAT: {
+                // Stack: a, b
+                auto b = stack.pop();
+                auto a = stack.pop();
+                stack.push(strings::concat(nativeHeap, a, b));
+                break;
+            }
+            case Op::STR_SUB: {
+                // Stack: string, start, length
+                auto length = stack.pop();
+                auto start = stack.pop();
+                auto s = stack.pop();
+                stack.push(strings::substring(nativeHeap, s, start, length));
+                break;
+            }
+            case Op::STR_EQ:
+            case Op::STR_NEQ: {
+                auto b = stack.pop();
+                auto a = stack.pop();
+                bool equal;
+                if (a == b) {
+                    equal = true;
+                } else if (isData(a) && isData(b)) {
+                    // Both interned, different addresses mean different content
+                    equal = false;
+                } else {
+                    equal = strings::equals(a, b);
+                }
+                stack.push(equal == (inst.op == Op::STR_EQ));
+                break;
+            }
+            case Op::STR_HASH: {
+                auto s = stack.pop();
+                stack.push(strings::hash(s));
+                break;
+            }
+            case Op::STR_CPTR: {
+                // External functions expect a pointer to the characters.
+                // Inline strings get one copy per distinct value, so calling
+                // in a loop does not allocate again.
+                auto s = stack.pop();
+                if (strings::isInline(s)) {
+                    auto it = inlineStringPointers.find(s);
+                    if (it == inlineStringPointers.end()) {
+                        it = inlineStringPointers
+                                 .emplace(s, strings::toPointer(nativeHeap, s))
+                                 .first;
+                    }
+                    s = it->second;
+                }
+                stack.push(s);
+                break;
+            }
+            case Op::SB_NEW: {
+                stringBuilders.push_back(std::make_unique<strings::StringBuilder>());
+                stack.push(reinterpret_cast<word_t>(stringBuilders.back().get()));
+                break;
+            }
+            case Op::SB_APPEND: {
+                // Stack: builder, string
+                auto s = stack.pop();
+                auto builder = stack.pop();
+                ASSURE(builder != 0, "StringBuilder: Access to uninitialized builder");
+                reinterpret_cast<strings::StringBuilder*>(builder)->append(s);
+                break;
+            }
+            case Op::SB_BUILD: {
+                auto builder = stack.pop();
+                ASSURE(builder != 0, "StringBuilder: Access to uninitialized builder");
+                stack.push(reinterpret_cast<strings::StringBuilder*>(builder)->build(nativeHeap));
+                break;
+            }
+            case Op::MAP_NEW: {
+                // MAP_NEW KEY_KIND
+                maps.push_back(std::make_unique<HashMap>(static_cast<HashMap::KeyKind>(inst.arg1)));
+                stack.push(reinterpret_cast<word_t>(maps.back().get()));
+                break;
+            }
+            case Op::MAP_GET: {
+                // Stack: map, key
+                auto key = stack.pop();
+                auto map = stack.pop();
+                ASSURE(map != 0, "Map: Access to uninitialized map");
+                stack.push(reinterpret_cast<HashMap*>(map)->get(key));
+                break;
+            }
+            case Op::MAP_PUT: {
+                // Stack: map, key, value
+                auto value = stack.pop();
+                auto key = stack.pop();
+                auto map = stack.pop();
+                ASSURE(map != 0, "Map: Access to uninitialized map");
+                reinterpret_cast<HashMap*>(map)->put(key, value);
+                break;
+            }
+            case Op::MAP_HAS: {
+                auto key = stack.pop();
+                auto map = stack.pop();
+                ASSURE(map != 0, "Map: Access to uninitialized map");
+                stack.push(reinterpret_cast<HashMap*>(map)->contains(key));
+                break;
+            }
+            case Op::MAP_DEL: {
+                auto key = stack.pop();
+                auto map = stack.pop();
+                ASSURE(map != 0, "Map: Access to uninitialized map");
+                stack.push(reinterpret_cast<HashMap*>(map)->remove(key));
+                break;
+            }
+            case Op::MAP_SIZE: {
+                auto map = stack.pop();
+                ASSURE(map != 0, "Map: Access to uninitialized map");
+                stack.push(reinterpret_cast<HashMap*>(map)->size());
+                break;
+            }
         }
     }
     return ProgramState::Paused;
 }
 
-ByteCodeVM::ByteCodeVM(const Program& program) :
+ByteCodeVM::ByteCodeVM(const Program& program, const ffi::LibraryOptions& libraryOptions) :
     idx{0ull},
     function_stack_base{0ull},
     return_value{0ull},
     stack{},
     program(program),
+    mappedImage{},
+    code{this->program.code.data()},
+    codeSize{this->program.code.size()},
+    data{this->program.data.getBytes().data()},
+    dataSize{this->program.data.size()},
+    debug{true},
+    ffiFunctions{libraryOptions},
+    callbacks{},
+    callbackError{nullptr},
+    maxInstructions{0} {
+    loadImports();
+}
+
+ByteCodeVM::ByteCodeVM(std::shared_ptr<const image::MappedImage> image,
+                       const ffi::LibraryOptions& libraryOptions) :
+    idx{0ull},
+    function_stack_base{0ull},
+    return_value{0ull},
+    stack{},
+    program{},
+    mappedImage{std::move(image)},
+    code{mappedImage->getSections().code},
+    codeSize{mappedImage->getSections().codeSize},
+    data{mappedImage->getSections().data},
+    dataSize{mappedImage->getSections().dataSize},
     debug{true},
-    ffiFunctions{},
-    ffiArgs{} {}
+    ffiFunctions{libraryOptions},
+    callbacks{},
+    callbackError{nullptr},
+    maxInstructions{0} {
+    program.imports = mappedImage->getSections().imports;
+    program.exports = mappedImage->getSections().exports;
+    loadImports();
+}
+
+void ByteCodeVM::loadImports() {
+    // Missing libraries or symbols fail here, before the program runs.
+    // All libraries are opened first, so the dynamic loader is done once
+    // symbols are looked up.
+    const auto& imports = program.imports;
+    for (const auto& import : imports) {
+        ffiFunctions.preload(import.library);
+    }
+    for (size_t i = 0; i < imports.size(); ++i) {
+        ffi::CallStatistics statistics;
+        statistics.library = imports[i].library;
+        statistics.symbol = imports[i].symbol;
+        ffiStatistics.push_back(statistics);
+
+        auto id = ffiFunctions.add(imports[i].library, imports[i].symbol,
+                                   ffi::Signature::decode(imports[i].signature));
+        ASSURE(id == i, "Function ids must match the import indices");
+    }
+}
+
+word_t ByteCodeVM::invoke(word_t address, const ffi::qword_t* args, size_t numArgs) {
+    // Same frame as CALL builds, the VM state of the interrupted
+    // instruction stays below it
+    auto interruptedIdx = idx;
+    auto depth = stack.size();
+    stack.push(returnToNative);
+    stack.push(function_stack_base);
+    function_stack_base = stack.size();
+    for (size_t i = 0; i < numArgs; ++i) {
+        stack.push(args[i]);
+    }
+    idx = address;
+
+    auto state = run(maxInstructions);
+    ASSURE(state == ProgramState::Returned, "ByteCodeVM: Callback did not return");
+
+    word_t result = stack.size() > depth ? stack.pop() : 0;
+    idx = interruptedIdx;
+    return result;
+}
+
+word_t ByteCodeVM::call(word_t address, const ffi::qword_t* args, size_t numArgs,
+                        size_t maxInstructions) {
+    this->maxInstructions = maxInstructions;
+    auto depth = stack.size();
+    auto base = function_stack_base;
+    auto interruptedIdx = idx;
+    try {
+        auto result = invoke(address, args, numArgs);
+        output.flush();
+        return result;
+    } catch (...) {
+        // Drop the frames of the failed call, later calls start clean
+        if (stack.size() > depth) {
+            stack.drop(stack.size() - depth);
+        }
+        function_stack_base = base;
+        idx = interruptedIdx;
+        callbackError = nullptr;
+        output.flush();
+        throw;
+    }
+}
+
+ffi::qword_t ByteCodeVM::dispatchCallback(void* context, const ffi::qword_t* args) {
+    auto* callback = static_cast<Callback*>(context);
+    auto* vm = callback->vm;
+    if (vm->callbackError) {
+        return 0; // Unwinding, the native code just has to return
+    }
+    try {
+        return vm->invoke(callback->address, args, callback->numArgs);
+    } catch (...) {
+        vm->callbackError = std::current_exception();
+        return 0;
+    }
+}
+
+void ByteCodeVM::setFfiProfiling(bool enabled) {
+    if (mappedImage && code == mappedImage->getSections().code) {
+        if (!enabled) {
+            return;
+        }
+        // The mapping is read-only, profiling runs a private copy
+        program.code.assign(code, code + codeSize);
+        code = program.code.data();
+    }
+
+    auto from = enabled ? Op::CALL_FFI : Op::CALL_FFI_PROFILED;
+    auto to = enabled ? Op::CALL_FFI_PROFILED : Op::CALL_FFI;
+    for (auto& inst : program.code) {
+        if (inst.op == from) {
+            inst.op = to;
+        }
+    }
+}
+
+std::string ByteCodeVM::ffiReport() const {
+    std::stringstream ss;
+    ss << "FFI calls:";
+    for (const auto& statistics : ffiStatistics) {
+        if (statistics.calls > 0) {
+            ss << "\n" << statistics.toString();
+        }
+    }
+    return ss.str();
+}
 
 std::string ByteCodeVM::execute(size_t maxInstructions) {
+    this->maxInstructions = maxInstructions;
     auto state = run(maxInstructions);
+    output.flush();
     if (state != ProgramState::Finished) {
         return "Program did not finish";
     }
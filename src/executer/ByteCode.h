@@ -1,19 +1,27 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <list>
 #include <vector>
 #include <map>
+#include <memory>
 #include <sstream>
 
 #include "../executer/ExternalFunctions.h"
 #include "../error/Exceptions.h"
 #include "Types.h"
 #include "Stack.h"
+#include "NativeHeap.h"
+#include "Strings.h"
+#include "HashMap.h"
+#include "OutputBuffer.h"
 
 namespace executor {
 
-enum class Op { 
+enum class Op : std::uint32_t {
     NOP, 
     LOCALS, 
     LOCALL, 
@@ -40,13 +48,50 @@ enum class Op {
     LOADW, 
     STOREW, 
     DUB,
-    REG_FFI, // TODO: Rename FFI_...
-    PUSH_FFI_WORD, 
-    PUSH_FFI_DWORD, 
-    PUSH_FFI_QWORD, 
-    PUSH_FFI_XWORD, 
     CALL_FFI,
-    DATA_ADDR
+    DATA_ADDR,
+    ALLOC8,
+    SIZE8,
+    LOADB,
+    STOREB,
+    MEMCPY,
+    MEMSET,
+    MEMCMP,
+    MEMCHR,
+    STR_LEN,
+    STR_CONCAT,
+    STR_SUB,
+    STR_EQ,
+    STR_NEQ,
+    STR_HASH,
+    STR_CPTR,
+    SB_NEW,
+    SB_APPEND,
+    SB_BUILD,
+    MAP_NEW,
+    MAP_GET,
+    MAP_PUT,
+    MAP_HAS,
+    MAP_DEL,
+    MAP_SIZE,
+    PRINT_STR,
+    FLUSH,
+    FADD,
+    FSUB,
+    FMUL,
+    FDIV,
+    FLT,
+    FGT,
+    FEQ,
+    FLTE,
+    FGTE,
+    FNEQ,
+    I2F,
+    F2I,
+    PRINT_FLOAT,
+    FN_NATIVE,
+    LOCALT, // LOCALS and LOCALL of the same local, see emitter::Peephole
+    CALL_FFI_PROFILED // Not emitted, see ByteCodeVM::setFfiProfiling
 };
 
 // TODO: ADD etc should be type specific, so IADD, FADD
@@ -74,9 +119,10 @@ class Data {
     using byte_t = unsigned char;
     static_assert(sizeof(byte_t) == 1);
     std::vector<byte_t> data;
+    std::map<std::string, size_t> interned; // Content -> index of the characters
 
     public:
-    Data(): data() {}
+    Data(): data(), interned() {}
 
     char* getString(size_t idx){
         if (idx >= data.size()) {
@@ -85,17 +131,58 @@ class Data {
         return reinterpret_cast<char*>(&data[idx]);
     }
 
+    // Layout of a string: [length: word_t][characters...][\0]
+    // Returns the index of the first character, see Strings.h
+    // Strings are interned, equal contents share one index.
     size_t addString(const std::string& str) {
-        size_t startIdx = data.size();
+        auto it = interned.find(str);
+        if (it != interned.end()) {
+            return it->second;
+        }
+
+        size_t lengthIdx = (data.size() + sizeof(word_t) - 1) / sizeof(word_t) * sizeof(word_t);
+        size_t startIdx = lengthIdx + sizeof(word_t);
         data.resize(startIdx + str.size() + 1); // +1 for null terminator
 
+        word_t length = str.size();
+        std::memcpy(&data[lengthIdx], &length, sizeof(word_t));
         for (size_t i = 0; i < str.size(); ++i) {
             data[startIdx + i] = static_cast<byte_t>(str[i]);
         }
         data[startIdx + str.size()] = 0; // Null terminator
+        interned.emplace(str, startIdx);
         return startIdx;
     }
 
+    // Content of the string whose characters start at idx, see addString
+    std::string readString(size_t idx) const {
+        word_t length = 0;
+        if (idx < sizeof(word_t) || idx > data.size()) {
+            throwConstraintViolated("Data: Index out of bounds");
+        }
+        std::memcpy(&length, &data[idx - sizeof(word_t)], sizeof(word_t));
+        if (length >= data.size() - idx) {
+            throwConstraintViolated("Data: Index out of bounds");
+        }
+        return std::string(reinterpret_cast<const char*>(&data[idx]), length);
+    }
+
+    size_t size() const { return data.size(); }
+
+    // True if addr points into the data segment, i.e. is an interned string
+    bool contains(word_t addr) const {
+        auto begin = reinterpret_cast<word_t>(data.data());
+        return addr >= begin && addr < begin + data.size();
+    }
+
+    // The whole segment, for images. Strings added to a loaded segment are
+    // not deduplicated against the loaded ones.
+    const std::vector<byte_t>& getBytes() const { return data; }
+    void setBytes(std::vector<byte_t> bytes) {
+        data = std::move(bytes);
+        interned.clear();
+    }
+
     void* getAddr(size_t idx) {
         if (idx >= data.size()) {
             throwConstraintViolated("Data: Index out of bounds");
@@ -104,16 +191,66 @@ class Data {
     }
 };
 
+// External function, resolved once when the program is loaded
+struct Import {
+    std::string library;
+    std::string symbol;
+    ffi::qword_t signature; // Encoded ffi::Signature
+};
+
+// Types of values the host passes to and gets from exported functions
+enum class ValueType : std::uint8_t {
+    Int,
+    Float,
+    Bool,
+    Void,
+    Other // Strings, structs, ..., not callable from the host
+};
+
+// Function declared at the top level of the program
+struct Export {
+    std::string name;
+    word_t address;
+    std::vector<ValueType> params;
+    ValueType result;
+    std::string type; // Full type, compared by the linker
+};
+
+// Function of another module, its address is pushed by the instruction
+struct Link {
+    size_t instruction;
+    std::string module;
+    std::string name;
+    std::string type; // Full type as declared by the import
+};
+
 struct Program {
     Data data;
     std::vector<Instruction> code;
+    std::vector<Import> imports; // Index is the function id
+    std::vector<Export> exports;
+
+    // For linking modules, see Runner. PUSH instructions of function
+    // addresses and import indices, jumps and DATA_ADDR are known by op.
+    std::vector<size_t> codeRefs;
+    std::vector<size_t> importRefs;
+    std::vector<Link> links; // Unresolved until linked
+
+    // Returns the index of the import, each symbol is imported once
+    size_t addImport(const std::string& library, const std::string& symbol,
+                     ffi::qword_t signature);
 };
 
 enum class ProgramState {
     Paused,
-    Finished
+    Finished,
+    Returned // To native code which called into the program
 };
 
+namespace image {
+class MappedImage;
+}
+
 class ByteCodeVM {
     private:
         word_t idx;
@@ -123,18 +260,73 @@ class ByteCodeVM {
         word_t return_value;
 
         Stack stack;
-        std::vector<word_t> heap;
+        NativeHeap nativeHeap;
+        std::vector<std::unique_ptr<strings::StringBuilder>> stringBuilders;
+        std::map<word_t, word_t> inlineStringPointers; // Inline string -> null terminated copy
+        std::vector<std::unique_ptr<HashMap>> maps;
+        OutputBuffer output;
         Program program;
+        // Code and data the VM runs, either of program or of a mapped image
+        std::shared_ptr<const image::MappedImage> mappedImage;
+        const Instruction* code;
+        size_t codeSize;
+        const unsigned char* data;
+        size_t dataSize;
         bool debug;
         ffi::ExternalFunctions ffiFunctions;
-        ffi::Arguments ffiArgs;
+
+        // Functions handed to native code, by address and signature
+        struct Callback {
+            ByteCodeVM* vm;
+            word_t address;
+            size_t numArgs;
+            void* thunk;
+        };
+        std::map<std::pair<word_t, word_t>, std::unique_ptr<Callback>> callbacks;
+        // Return address of frames entered from native code
+        static constexpr word_t returnToNative = ~word_t(0);
+        // Errors may not unwind through native frames, they are rethrown
+        // once the external function returns
+        std::exception_ptr callbackError;
+        size_t maxInstructions;
+        std::vector<ffi::CallStatistics> ffiStatistics; // By import index
 
     ProgramState run(size_t maxInstructions);
 
+    // Runs the function at address with the arguments on top of whatever
+    // the VM is doing, returns its result or 0
+    word_t invoke(word_t address, const ffi::qword_t* args, size_t numArgs);
+    static ffi::qword_t dispatchCallback(void* context, const ffi::qword_t* args);
+
+    void loadImports();
+    // True if addr points into the data segment, i.e. is an interned string
+    bool isData(word_t addr) const {
+        auto begin = reinterpret_cast<word_t>(data);
+        return addr >= begin && addr < begin + dataSize;
+    }
+
     public:
-    ByteCodeVM(const Program& program);
+    // Opens the libraries of all imports and resolves them
+    ByteCodeVM(const Program& program, const ffi::LibraryOptions& libraryOptions = {});
+    // Runs the code and data in place, without copying them
+    ByteCodeVM(std::shared_ptr<const image::MappedImage> image,
+               const ffi::LibraryOptions& libraryOptions = {});
     void setDebug(bool debug) { this->debug = debug; }
+    // Receives everything the program prints, stdout by default
+    void setOutputSink(OutputBuffer::Sink sink) { output.setSink(std::move(sink)); }
     std::string execute(size_t maxInstructions);
+    // Calls the function at address, for the host. The VM is unchanged
+    // afterwards, also if the call throws.
+    word_t call(word_t address, const ffi::qword_t* args, size_t numArgs, size_t maxInstructions);
+    const std::vector<Export>& getExports() const { return program.exports; }
+
+    // Measures every call of an external function. Swaps CALL_FFI for
+    // CALL_FFI_PROFILED in the code, so calls cost nothing extra when
+    // disabled.
+    void setFfiProfiling(bool enabled);
+    const std::vector<ffi::CallStatistics>& getFfiStatistics() const { return ffiStatistics; }
+    // Statistics of all called external functions
+    std::string ffiReport() const;
 
 };
 
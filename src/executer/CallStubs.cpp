@@ -0,0 +1,294 @@
+#include "CallStubs.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ffi {
+
+namespace {
+constexpr size_t pageSize = 4096;
+
+#ifdef WIN
+// Windows x64: rcx, rdx, r8, r9, the callee may use 32 bytes of shadow
+// space above the return address for them
+constexpr unsigned char integerRegisters[] = {1, 2, 8, 9};
+constexpr size_t shadowSpace = 32;
+#else
+// System V AMD64: rdi, rsi, rdx, rcx, r8, r9
+constexpr unsigned char integerRegisters[] = {7, 6, 2, 1, 8, 9};
+constexpr size_t shadowSpace = 0;
+// xmm0 to xmm7 for floats, independent of the integer registers
+constexpr size_t vectorRegisterArgs = 8;
+#endif
+constexpr size_t registerArgs = sizeof(integerRegisters) / sizeof(integerRegisters[0]);
+
+// All argument offsets fit into the signed 8 bit displacements used below
+static_assert(shadowSpace + 8 * Signature::maxArgs < 128);
+// Also the ones of the arguments a thunk finds on the stack of its caller
+static_assert(16 + shadowSpace + 8 * (Signature::maxArgs - registerArgs - 1) < 128);
+
+// Assigns the arguments to registers, pairs of (argument, register number).
+// Arguments without register go to the stack in order.
+struct Assignment {
+    std::vector<std::pair<size_t, size_t>> integer;
+    std::vector<std::pair<size_t, size_t>> vector;
+    std::vector<size_t> stack;
+};
+
+Assignment assignRegisters(const Signature& signature) {
+    Assignment result;
+    const auto& args = signature.args;
+#ifdef WIN
+    // The position decides the register. Floats also go into the integer
+    // register, variadic callees read them from there.
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i >= registerArgs) {
+            result.stack.push_back(i);
+            continue;
+        }
+        result.integer.emplace_back(i, integerRegisters[i]);
+        if (args[i] == arg_types::Float) result.vector.emplace_back(i, i);
+    }
+#else
+    // Each class takes the next free register of its own kind
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == arg_types::Float) {
+            if (result.vector.size() < vectorRegisterArgs) {
+                result.vector.emplace_back(i, result.vector.size());
+                continue;
+            }
+        } else if (result.integer.size() < registerArgs) {
+            result.integer.emplace_back(i, integerRegisters[result.integer.size()]);
+            continue;
+        }
+        result.stack.push_back(i);
+    }
+#endif
+    return result;
+}
+
+void appendQword(std::vector<unsigned char>& code, qword_t value) {
+    for (size_t i = 0; i < 8; ++i) {
+        code.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+}
+}  // namespace
+
+CallStubs::Stub CallStubs::get(qword_t encodedSignature) {
+    if (auto it = stubs.find(encodedSignature); it != stubs.end()) {
+        return it->second;
+    }
+    return get(Signature::decode(encodedSignature));
+}
+
+CallStubs::Stub CallStubs::get(const Signature& signature) {
+    auto encoded = signature.encode();
+    if (auto it = stubs.find(encoded); it != stubs.end()) {
+        return it->second;
+    }
+
+    std::vector<unsigned char> code;
+    auto append = [&code](std::initializer_list<unsigned char> bytes) {
+        code.insert(code.end(), bytes);
+    };
+
+    append({0x55});             // push rbp, aligns rsp to 16
+    append({0x48, 0x89, 0xE5}); // mov rbp, rsp
+#ifdef WIN
+    append({0x49, 0x89, 0xD3}); // mov r11, rdx (fn)
+    append({0x49, 0x89, 0xCA}); // mov r10, rcx (args)
+#else
+    append({0x49, 0x89, 0xF3}); // mov r11, rsi (fn)
+    append({0x49, 0x89, 0xFA}); // mov r10, rdi (args)
+#endif
+
+    auto assignment = assignRegisters(signature);
+    const auto& integerLoads = assignment.integer;
+    const auto& vectorLoads = assignment.vector;
+    const auto& stackArgs = assignment.stack;
+
+    // Arguments without register go to the stack in order, the first one at
+    // the lowest address. rsp is 16 byte aligned after the push, the frame
+    // keeps it that way for the call.
+    const size_t frame = (shadowSpace + 8 * stackArgs.size() + 15) / 16 * 16;
+    if (frame > 0) {
+        append({0x48, 0x83, 0xEC, static_cast<unsigned char>(frame)}); // sub rsp, frame
+    }
+    for (size_t slot = 0; slot < stackArgs.size(); ++slot) {
+        auto from = static_cast<unsigned char>(8 * stackArgs[slot]);
+        auto to = static_cast<unsigned char>(shadowSpace + 8 * slot);
+        append({0x49, 0x8B, 0x42, from});     // mov rax, [r10 + from]
+        append({0x48, 0x89, 0x44, 0x24, to}); // mov [rsp + to], rax
+    }
+
+    for (auto [arg, reg] : integerLoads) {
+        // Every integer class argument is loaded as a full qword, the callee
+        // only looks at the bits of its parameter type
+        // mov <reg>, [r10 + 8 * arg]
+        append({static_cast<unsigned char>(reg >= 8 ? 0x4D : 0x49), 0x8B,
+                static_cast<unsigned char>(0x42 | (reg & 7) << 3),
+                static_cast<unsigned char>(8 * arg)});
+    }
+    for (auto [arg, reg] : vectorLoads) {
+        // movsd xmm<reg>, [r10 + 8 * arg], floats are doubles
+        append({0xF2, 0x41, 0x0F, 0x10, static_cast<unsigned char>(0x42 | (reg << 3)),
+                static_cast<unsigned char>(8 * arg)});
+    }
+
+    // Variadic callees read the number of used vector registers from al
+    if (vectorLoads.empty()) {
+        append({0x31, 0xC0}); // xor eax, eax
+    } else {
+        append({0xB8, static_cast<unsigned char>(vectorLoads.size()), 0x00, 0x00, 0x00}); // mov eax, n
+    }
+    append({0x41, 0xFF, 0xD3}); // call r11
+
+    switch (signature.returnType) {
+        case ret_type::Void:
+            append({0x31, 0xC0}); // xor eax, eax
+            break;
+        case ret_type::Number:
+            append({0x48, 0x63, 0xC0}); // movsxd rax, eax, C int
+            break;
+        case ret_type::Bool:
+            append({0x0F, 0xB6, 0xC0}); // movzx eax, al
+            break;
+        case ret_type::Float:
+            append({0x66, 0x48, 0x0F, 0x7E, 0xC0}); // movq rax, xmm0
+            break;
+        default:
+            break; // Pointers are returned as they are
+    }
+
+    append({0x48, 0x89, 0xEC}); // mov rsp, rbp
+    append({0x5D});             // pop rbp
+    append({0xC3});             // ret
+
+    auto stub = emit(code);
+    stubs.emplace(encoded, stub);
+    return stub;
+}
+
+void* CallStubs::thunk(const Signature& signature, void* context, Dispatch dispatch) {
+    const auto& args = signature.args;
+    auto assignment = assignRegisters(signature);
+
+    std::vector<unsigned char> code;
+    auto append = [&code](std::initializer_list<unsigned char> bytes) {
+        code.insert(code.end(), bytes);
+    };
+    // Displacement of argument i in the array below rbp
+    auto slot = [&args](size_t i) {
+        return static_cast<unsigned char>(-static_cast<int>(8 * (args.size() - i)));
+    };
+
+    append({0x55});             // push rbp, aligns rsp to 16
+    append({0x48, 0x89, 0xE5}); // mov rbp, rsp
+    // The arguments are collected into an array right below rbp,
+    // the shadow space for the dispatch call goes below that
+    const unsigned int frame = (8 * args.size() + 15) / 16 * 16 + shadowSpace;
+    if (frame > 0) {
+        append({0x48, 0x81, 0xEC}); // sub rsp, frame
+        for (size_t i = 0; i < 4; ++i) code.push_back(static_cast<unsigned char>(frame >> (8 * i)));
+    }
+
+    for (auto [arg, reg] : assignment.integer) {
+        // mov [rbp + slot], <reg>
+        append({static_cast<unsigned char>(reg >= 8 ? 0x4C : 0x48), 0x89,
+                static_cast<unsigned char>(0x45 | (reg & 7) << 3), slot(arg)});
+    }
+    for (auto [arg, reg] : assignment.vector) {
+        // movsd [rbp + slot], xmm<reg>
+        append({0xF2, 0x0F, 0x11, static_cast<unsigned char>(0x45 | (reg << 3)), slot(arg)});
+    }
+    for (size_t s = 0; s < assignment.stack.size(); ++s) {
+        // Above the return address and the shadow space of the caller
+        auto from = static_cast<unsigned char>(16 + shadowSpace + 8 * s);
+        append({0x48, 0x8B, 0x45, from});                         // mov rax, [rbp + from]
+        append({0x48, 0x89, 0x45, slot(assignment.stack[s])}); // mov [rbp + slot], rax
+    }
+
+    // dispatch(context, args)
+#ifdef WIN
+    append({0x48, 0xB9}); // mov rcx, context
+    appendQword(code, reinterpret_cast<qword_t>(context));
+    append({0x48, 0x8D, 0x55, slot(0)}); // lea rdx, [rbp + slot]
+#else
+    append({0x48, 0xBF}); // mov rdi, context
+    appendQword(code, reinterpret_cast<qword_t>(context));
+    append({0x48, 0x8D, 0x75, slot(0)}); // lea rsi, [rbp + slot]
+#endif
+    append({0x48, 0xB8}); // mov rax, dispatch
+    appendQword(code, reinterpret_cast<qword_t>(dispatch));
+    append({0xFF, 0xD0}); // call rax
+
+    if (signature.returnType == ret_type::Float) {
+        append({0x66, 0x48, 0x0F, 0x6E, 0xC0}); // movq xmm0, rax
+    }
+
+    append({0x48, 0x89, 0xEC}); // mov rsp, rbp
+    append({0x5D});             // pop rbp
+    append({0xC3});             // ret
+
+    return reinterpret_cast<void*>(emit(code));
+}
+
+CallStubs::Stub CallStubs::emit(const std::vector<unsigned char>& code) {
+    ASSURE(code.size() <= pageSize, "Call stub too large");
+
+    // Pages are writable only while a stub is written into them
+    if (pages.empty() || pages.back().used + code.size() > pageSize) {
+#ifdef WIN
+        void* memory = VirtualAlloc(nullptr, pageSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        ASSURE(memory != nullptr, "Failed to allocate memory for call stubs");
+#else
+        void* memory = mmap(nullptr, pageSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ASSURE(memory != MAP_FAILED, "Failed to allocate memory for call stubs");
+#endif
+        pages.push_back({static_cast<unsigned char*>(memory), 0});
+    } else {
+#ifdef WIN
+        DWORD old;
+        VirtualProtect(pages.back().memory, pageSize, PAGE_READWRITE, &old);
+#else
+        mprotect(pages.back().memory, pageSize, PROT_READ | PROT_WRITE);
+#endif
+    }
+
+    auto& page = pages.back();
+    unsigned char* start = page.memory + page.used;
+    std::memcpy(start, code.data(), code.size());
+    // Keep stubs 16 byte aligned
+    page.used += (code.size() + 15) / 16 * 16;
+
+#ifdef WIN
+    DWORD old;
+    VirtualProtect(page.memory, pageSize, PAGE_EXECUTE_READ, &old);
+    FlushInstructionCache(GetCurrentProcess(), page.memory, pageSize);
+#else
+    ASSURE(mprotect(page.memory, pageSize, PROT_READ | PROT_EXEC) == 0,
+           "Failed to make call stubs executable");
+#endif
+
+    return reinterpret_cast<Stub>(start);
+}
+
+CallStubs::~CallStubs() {
+    for (const auto& page : pages) {
+#ifdef WIN
+        VirtualFree(page.memory, 0, MEM_RELEASE);
+#else
+        munmap(page.memory, pageSize);
+#endif
+    }
+}
+
+}  // namespace ffi
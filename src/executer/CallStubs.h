@@ -0,0 +1,53 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "ExternalFunctions.h"
+
+namespace ffi {
+
+/*
+ * Generates machine code trampolines which move the arguments from an
+ * array into the registers of the native calling convention, call the
+ * function and normalize the result according to the return type.
+ *
+ * A stub only depends on the signature, not on the function, so all
+ * functions with the same signature share one stub. Arguments which do not
+ * fit into registers are copied to the native stack.
+ *
+ * Thunks go the other way: native code calls them like a C function of the
+ * signature and they pass the arguments as an array to a dispatch function.
+ */
+class CallStubs {
+   public:
+    using Stub = qword_t (*)(const qword_t* args, void* fn);
+    using Dispatch = qword_t (*)(void* context, const qword_t* args);
+
+   private:
+    struct Page {
+        unsigned char* memory;
+        size_t used;
+    };
+
+    std::map<qword_t, Stub> stubs; // Encoded signature -> stub
+    std::vector<Page> pages;
+
+    Stub emit(const std::vector<unsigned char>& code);
+
+   public:
+    CallStubs() = default;
+    CallStubs(const CallStubs&) = delete;
+    CallStubs& operator=(const CallStubs&) = delete;
+    ~CallStubs();
+
+    // Generates the stub on first use
+    Stub get(const Signature& signature);
+    Stub get(qword_t encodedSignature);
+
+    // A new C function pointer for each call, the thunk is bound to the
+    // context. Lives as long as the CallStubs.
+    void* thunk(const Signature& signature, void* context, Dispatch dispatch);
+};
+
+}  // namespace ffi
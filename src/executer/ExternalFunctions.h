@@ -1,10 +1,13 @@
 #pragma once
 
 #include "../error/Exceptions.h"
+#include "Libraries.h"
 
+#include <array>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <iostream>
 
 namespace ffi {
@@ -42,53 +45,87 @@ namespace ret_type {
     constexpr type Ptr = 4;
 }
 
-struct arg_t {
-    arg_types::type type; // This cannot be smaller than qword_t
-    qword_t value; // Use the largest type
+/*
+ * Return and argument types of an external function. Everything a call
+ * stub depends on, it can be packed into a qword to travel as an
+ * instruction argument:
+ * bits 0-3 return type, bits 4-7 number of arguments, then 4 bits per
+ * argument type.
+ */
+struct Signature {
+    static constexpr size_t maxArgs = 14; // All argument types fit into the qword
+
+    ret_type::type returnType;
+    std::vector<arg_types::type> args;
+
+    Signature(ret_type::type returnType = ret_type::Void,
+              std::vector<arg_types::type> args = {});
+
+    qword_t encode() const;
+    static Signature decode(qword_t encoded);
 };
-static_assert(sizeof(arg_t) == 16);
-static_assert(sizeof(arg_t) == sizeof(qword_t) + sizeof(arg_types::type));
-
-class Arguments {
-    public:
-    Arguments();
-
-    void addWord(word_t value);
-    void addDWord(dword_t value);
-    void addQWord(qword_t value);
-    
-    void clear();
-
-    static constexpr size_t capacity = 6;
-    
-    size_t getSize() const { return size; }
-    const arg_t* getBuffer() const { return buffer; }
-
-    private:
-    size_t size;
-    arg_t buffer[capacity];
+
+class CallStubs;
+
+// Calls of one external function, time includes callbacks into the VM
+struct CallStatistics {
+    // Bucket 0 counts calls which took [0, 2) ns, bucket i > 0 [2^i, 2^(i+1)) ns,
+    // the last one everything slower
+    static constexpr size_t buckets = 40;
+
+    std::string library;
+    std::string symbol;
+    qword_t calls = 0;
+    qword_t totalNanoseconds = 0;
+    std::array<qword_t, buckets> histogram{};
+
+    void record(qword_t nanoseconds);
+    static size_t bucket(qword_t nanoseconds);
+    // Totals and the non-empty buckets, one per line
+    std::string toString() const;
 };
 
 struct ExternalFunction {
     std::string library;
     std::string name;
-    qword_t returnType;
+    Signature signature;
     void* functionPtr;
+    qword_t (*stub)(const qword_t* args, void* fn);
 };
 
 class ExternalFunctions {
    public:
-    ExternalFunctions();
+    explicit ExternalFunctions(LibraryOptions options = {});
+
+    // Opens the library ahead of the first add, to keep the loader out of
+    // the running program
+    void preload(const std::string& library);
+
+    // Resolves the function and prepares a call stub for its signature
+    size_t add(const std::string& library, const std::string& functionName, const Signature& signature);
+
+    // args holds one qword per parameter of the signature
+    qword_t call(size_t id, const qword_t* args) const {
+        ASSURE(id < functions.size(), "Function ID out of bounds");
+        const auto& function = functions[id];
+        return function.stub(args, function.functionPtr);
+    }
 
-    size_t add(const std::string& library, const std::string& functionName, qword_t returnType);
+    // Calls a variadic function, the stub is chosen by the signature of
+    // the actual arguments instead of the declared ones
+    qword_t call(size_t id, const qword_t* args, qword_t callSignature);
 
-    __attribute__((optimize("-O0"))) qword_t call(size_t id, const Arguments& args);
+    // Native function pointer of the signature, calls dispatch with the
+    // context and its arguments, one qword each. Valid as long as this.
+    void* thunk(const Signature& signature, void* context,
+                qword_t (*dispatch)(void* context, const qword_t* args));
 
     ~ExternalFunctions();
 
    private:
     std::vector<ExternalFunction> functions;
-    std::map<std::string, void*> libraries;
+    LibraryOptions options;
+    std::unique_ptr<CallStubs> stubs;
 };
 
 } // namespace ffi
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "HashMap.h"
+
+#include <algorithm>
+
+#include "../error/Exceptions.h"
+#include "Strings.h"
+
+namespace executor {
+
+HashMap::HashMap(KeyKind keyKind)
+    : keyKind(keyKind), ctrl(), keys(), values(), used(0), deleted(0) {}
+
+word_t HashMap::hash(word_t key) const {
+    word_t h = keyKind == KeyKind::String ? strings::hash(key) : key;
+
+    // Mix all bits into the low ones, consecutive ints would cluster otherwise
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+bool HashMap::equals(word_t a, word_t b) const {
+    if (a == b) return true;
+    return keyKind == KeyKind::String && strings::equals(a, b);
+}
+
+size_t HashMap::find(word_t key, word_t h) const {
+    if (ctrl.empty()) return NoSlot;
+
+    const size_t mask = ctrl.size() - 1;
+    const auto tag = static_cast<ctrl_t>(h & 0x7F);
+    // There is always an empty slot, see put
+    for (size_t i = (h >> 7) & mask;; i = (i + 1) & mask) {
+        if (ctrl[i] == Empty) return NoSlot;
+        if (ctrl[i] == tag && equals(keys[i], key)) return i;
+    }
+}
+
+void HashMap::rehash(size_t capacity) {
+    auto oldCtrl = std::move(ctrl);
+    auto oldKeys = std::move(keys);
+    auto oldValues = std::move(values);
+    ctrl.assign(capacity, Empty);
+    keys.assign(capacity, 0);
+    values.assign(capacity, 0);
+    deleted = 0;
+
+    const size_t mask = capacity - 1;
+    for (size_t slot = 0; slot < oldCtrl.size(); ++slot) {
+        if (oldCtrl[slot] == Empty || oldCtrl[slot] == Deleted) continue;
+
+        auto h = hash(oldKeys[slot]);
+        size_t i = (h >> 7) & mask;
+        while (ctrl[i] != Empty) i = (i + 1) & mask;
+        ctrl[i] = static_cast<ctrl_t>(h & 0x7F);
+        keys[i] = oldKeys[slot];
+        values[i] = oldValues[slot];
+    }
+}
+
+word_t HashMap::get(word_t key) const {
+    auto slot = find(key, hash(key));
+    ASSURE(slot != NoSlot, "Map: Key not found");
+    return values[slot];
+}
+
+void HashMap::put(word_t key, word_t value) {
+    // Keep the load at most 7/8, tombstones included
+    if ((used + deleted + 1) * 8 > ctrl.size() * 7) {
+        auto capacity = std::max(MinCapacity, ctrl.size());
+        if ((used + 1) * 2 > capacity) capacity *= 2;
+        rehash(capacity);
+    }
+
+    auto h = hash(key);
+    const size_t mask = ctrl.size() - 1;
+    const auto tag = static_cast<ctrl_t>(h & 0x7F);
+    size_t insertAt = NoSlot;
+    size_t i = (h >> 7) & mask;
+    for (;; i = (i + 1) & mask) {
+        if (ctrl[i] == Empty) break;
+        if (ctrl[i] == Deleted) {
+            if (insertAt == NoSlot) insertAt = i;
+        } else if (ctrl[i] == tag && equals(keys[i], key)) {
+            values[i] = value;
+            return;
+        }
+    }
+
+    if (insertAt == NoSlot) {
+        insertAt = i;
+    } else {
+        --deleted;
+    }
+    ctrl[insertAt] = tag;
+    keys[insertAt] = key;
+    values[insertAt] = value;
+    ++used;
+}
+
+bool HashMap::contains(word_t key) const {
+    return find(key, hash(key)) != NoSlot;
+}
+
+bool HashMap::remove(word_t key) {
+    auto slot = find(key, hash(key));
+    if (slot == NoSlot) return false;
+
+    // No probe sequence continues past an empty successor, so the slot can
+    // become empty instead of a tombstone
+    const size_t mask = ctrl.size() - 1;
+    if (ctrl[(slot + 1) & mask] == Empty) {
+        ctrl[slot] = Empty;
+    } else {
+        ctrl[slot] = Deleted;
+        ++deleted;
+    }
+    --used;
+    return true;
+}
+
+}  // namespace executor
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Types.h"
+
+namespace executor {
+
+/*
+ * Open addressing hash map from word to word with linear probing.
+ *
+ * Keys, values and one control byte per slot live in flat arrays. The
+ * control byte is Empty, Deleted or the lowest 7 bits of the hash, so most
+ * mismatches are rejected by looking at a single byte without touching the
+ * key array. String keys are hashed and compared by content.
+ */
+class HashMap {
+   public:
+    enum class KeyKind { Int, String };
+
+   private:
+    using ctrl_t = uint8_t;
+    static constexpr ctrl_t Empty = 0x80;
+    static constexpr ctrl_t Deleted = 0xFE;
+    static constexpr size_t NoSlot = static_cast<size_t>(-1);
+    static constexpr size_t MinCapacity = 16;
+
+    KeyKind keyKind;
+    std::vector<ctrl_t> ctrl;
+    std::vector<word_t> keys;
+    std::vector<word_t> values;
+    size_t used;      // Full slots
+    size_t deleted;   // Tombstones, count towards the load factor
+
+    word_t hash(word_t key) const;
+    bool equals(word_t a, word_t b) const;
+
+    // Slot of the key or NoSlot
+    size_t find(word_t key, word_t h) const;
+    void rehash(size_t capacity);
+
+   public:
+    explicit HashMap(KeyKind keyKind);
+
+    // Throws if the key does not exist
+    word_t get(word_t key) const;
+    void put(word_t key, word_t value);
+    bool contains(word_t key) const;
+    // Returns whether the key existed
+    bool remove(word_t key);
+    size_t size() const { return used; }
+};
+
+}  // namespace executor
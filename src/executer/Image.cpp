@@ -0,0 +1,321 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+
+#include "../error/Exceptions.h"
+
+#ifdef WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace executor {
+namespace image {
+
+namespace {
+
+constexpr size_t headerSize = 64;
+constexpr size_t codeAlignment = 64;
+constexpr size_t instructionSize = 32;
+
+// The code section is used as an array of Instruction
+static_assert(sizeof(Instruction) == instructionSize);
+static_assert(offsetof(Instruction, op) == 0 && sizeof(Op) == 4);
+static_assert(offsetof(Instruction, arg1) == 8 && offsetof(Instruction, arg2) == 16 &&
+              offsetof(Instruction, arg3) == 24);
+static_assert(sizeof(word_t) == 8);
+
+class ImageWriter {
+   public:
+    std::vector<unsigned char> bytes;
+
+    void u32(std::uint32_t value) {
+        for (size_t i = 0; i < 4; ++i) bytes.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+    void u64(std::uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) bytes.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+    void raw(const unsigned char* data, size_t size) { bytes.insert(bytes.end(), data, data + size); }
+    void str(const std::string& value) {
+        u64(value.size());
+        raw(reinterpret_cast<const unsigned char*>(value.data()), value.size());
+    }
+    void align(size_t alignment) {
+        bytes.resize((bytes.size() + alignment - 1) / alignment * alignment, 0);
+    }
+    void patch64(size_t offset, std::uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) bytes[offset + i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+};
+
+class ImageReader {
+   private:
+    const unsigned char* bytes;
+    size_t size;
+    size_t position;
+
+   public:
+    ImageReader(const unsigned char* bytes, size_t size, size_t position = 0)
+        : bytes(bytes), size(size), position(position) {}
+
+    const unsigned char* raw(size_t length) {
+        ASSURE(position <= size && length <= size - position, "Image: Unexpected end of image");
+        auto result = bytes + position;
+        position += length;
+        return result;
+    }
+    std::uint32_t u32() {
+        auto data = raw(4);
+        std::uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i) value |= std::uint32_t{data[i]} << (8 * i);
+        return value;
+    }
+    std::uint64_t u64() {
+        auto data = raw(8);
+        std::uint64_t value = 0;
+        for (size_t i = 0; i < 8; ++i) value |= std::uint64_t{data[i]} << (8 * i);
+        return value;
+    }
+    std::string str() {
+        auto length = u64();
+        auto data = raw(length);
+        return std::string(reinterpret_cast<const char*>(data), length);
+    }
+    bool done() const { return position == size; }
+};
+
+}  // namespace
+
+std::vector<unsigned char> serialize(const Program& program) {
+    ImageWriter writer;
+    writer.raw(reinterpret_cast<const unsigned char*>(magic), sizeof(magic));
+    writer.u32(version);
+    // Offsets and sizes are filled in below
+    writer.align(headerSize);
+
+    writer.align(codeAlignment);
+    auto codeOffset = writer.bytes.size();
+    for (const auto& inst : program.code) {
+        writer.u32(static_cast<std::uint32_t>(inst.op));
+        writer.u32(0);
+        writer.u64(inst.arg1);
+        writer.u64(inst.arg2);
+        writer.u64(inst.arg3);
+    }
+
+    writer.align(sizeof(word_t));
+    auto dataOffset = writer.bytes.size();
+    const auto& data = program.data.getBytes();
+    writer.raw(data.data(), data.size());
+
+    auto importsOffset = writer.bytes.size();
+    writer.u64(program.imports.size());
+    for (const auto& import : program.imports) {
+        writer.str(import.library);
+        writer.str(import.symbol);
+        writer.u64(import.signature);
+    }
+    writer.u64(program.exports.size());
+    for (const auto& exported : program.exports) {
+        writer.str(exported.name);
+        writer.u64(exported.address);
+        writer.u64(static_cast<std::uint64_t>(exported.result));
+        writer.u64(exported.params.size());
+        for (auto param : exported.params) {
+            writer.u64(static_cast<std::uint64_t>(param));
+        }
+        writer.str(exported.type);
+    }
+
+    writer.patch64(8, codeOffset);
+    writer.patch64(16, program.code.size());
+    writer.patch64(24, dataOffset);
+    writer.patch64(32, data.size());
+    writer.patch64(40, importsOffset);
+    writer.patch64(48, writer.bytes.size() - importsOffset);
+    return std::move(writer.bytes);
+}
+
+Sections parse(const unsigned char* bytes, size_t size) {
+    ImageReader header(bytes, size);
+    ASSURE(size >= headerSize, "Image: Not a bytecode image");
+    ASSURE(std::equal(magic, magic + sizeof(magic), header.raw(sizeof(magic))),
+           "Image: Not a bytecode image");
+    ASSURE(header.u32() == version, "Image: Unsupported image version");
+    auto codeOffset = header.u64();
+    auto codeSize = header.u64();
+    auto dataOffset = header.u64();
+    auto dataSize = header.u64();
+    auto importsOffset = header.u64();
+    auto importsSize = header.u64();
+
+    ASSURE(codeOffset % codeAlignment == 0 && dataOffset % sizeof(word_t) == 0,
+           "Image: Misaligned section");
+    ASSURE(codeSize <= size / instructionSize, "Image: Unexpected end of image");
+
+    Sections sections;
+    sections.code = reinterpret_cast<const Instruction*>(
+        ImageReader(bytes, size, codeOffset).raw(codeSize * instructionSize));
+    sections.codeSize = codeSize;
+    sections.data = ImageReader(bytes, size, dataOffset).raw(dataSize);
+    sections.dataSize = dataSize;
+
+    for (size_t i = 0; i < codeSize; ++i) {
+        // Profiling swaps instructions in the VM, images never contain them
+        ASSURE(static_cast<std::uint32_t>(sections.code[i].op) <
+                   static_cast<std::uint32_t>(Op::CALL_FFI_PROFILED),
+               "Image: Unknown instruction");
+    }
+
+    ASSURE(importsOffset == size - importsSize, "Image: Unexpected data after the image");
+    ImageReader imports(bytes, size, importsOffset);
+    auto importCount = imports.u64();
+    ASSURE(importCount <= importsSize / 24, "Image: Unexpected end of image");
+    for (std::uint64_t i = 0; i < importCount; ++i) {
+        Import import;
+        import.library = imports.str();
+        import.symbol = imports.str();
+        import.signature = imports.u64();
+        sections.imports.push_back(std::move(import));
+    }
+
+    auto valueType = [](std::uint64_t value) {
+        ASSURE(value <= static_cast<std::uint64_t>(ValueType::Other), "Image: Unknown value type");
+        return static_cast<ValueType>(value);
+    };
+    auto exportCount = imports.u64();
+    ASSURE(exportCount <= importsSize / 32, "Image: Unexpected end of image");
+    for (std::uint64_t i = 0; i < exportCount; ++i) {
+        Export exported;
+        exported.name = imports.str();
+        exported.address = imports.u64();
+        ASSURE(exported.address < codeSize, "Image: Export out of bounds");
+        exported.result = valueType(imports.u64());
+        auto paramCount = imports.u64();
+        ASSURE(paramCount <= importsSize / 8, "Image: Unexpected end of image");
+        for (std::uint64_t j = 0; j < paramCount; ++j) {
+            exported.params.push_back(valueType(imports.u64()));
+        }
+        exported.type = imports.str();
+        sections.exports.push_back(std::move(exported));
+    }
+    ASSURE(imports.done(), "Image: Unexpected data after the image");
+    return sections;
+}
+
+Program deserialize(const unsigned char* bytes, size_t size) {
+    auto sections = parse(bytes, size);
+
+    Program program;
+    program.code.assign(sections.code, sections.code + sections.codeSize);
+    program.data.setBytes(std::vector<unsigned char>(sections.data, sections.data + sections.dataSize));
+    for (const auto& import : sections.imports) {
+        program.addImport(import.library, import.symbol, import.signature);
+    }
+    ASSURE(program.imports.size() == sections.imports.size(), "Image: Duplicate imports");
+    program.exports = sections.exports;
+    return program;
+}
+
+void save(const Program& program, const std::string& path) {
+    static std::atomic<unsigned> counter{0};
+#ifdef WIN
+    auto process = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+    auto process = static_cast<unsigned long>(getpid());
+#endif
+
+    // Processes which map the old image keep its inode, the rename
+    // replaces the file atomically. Unique per process and call.
+    auto temporary = path + "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+    auto bytes = serialize(program);
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        ASSURE(stream.good(), "Image: Could not open the file for writing");
+        stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        stream.close();
+        if (!stream.good()) {
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            throwConstraintViolated("Image: Could not write the file");
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        throwConstraintViolated("Image: Could not replace the file");
+    }
+}
+
+Program load(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    ASSURE(stream.good(), "Image: Could not open the file");
+    std::vector<unsigned char> bytes(static_cast<size_t>(stream.tellg()));
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    ASSURE(stream.good(), "Image: Could not read the file");
+    return deserialize(bytes.data(), bytes.size());
+}
+
+MappedImage::MappedImage(const std::string& path) : memory(nullptr), size(0), sections{} {
+#ifdef WIN
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    ASSURE(file != INVALID_HANDLE_VALUE, "Image: Could not open the file");
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!memory) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throwConstraintViolated("Image: Could not map the file");
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSURE(fd >= 0, "Image: Could not open the file");
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        throwConstraintViolated("Image: Could not read the file");
+    }
+    size = static_cast<size_t>(status.st_size);
+    memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file
+    ASSURE(memory != MAP_FAILED, "Image: Could not map the file");
+#endif
+
+    try {
+        sections = parse(static_cast<const unsigned char*>(memory), size);
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+MappedImage::~MappedImage() { unmap(); }
+
+void MappedImage::unmap() {
+#ifdef WIN
+    UnmapViewOfFile(memory);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(memory, size);
+#endif
+}
+
+}  // namespace image
+}  // namespace executor
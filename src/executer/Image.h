@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ByteCode.h"
+
+namespace executor {
+
+/*
+ * Binary image of a Program, laid out so the VM can run it straight from a
+ * read-only memory mapping. All numbers are little endian, sections start
+ * at offsets given in the header:
+ *
+ *   header, 64 bytes: magic "MLBC", version: u32, then as u64 code offset,
+ *       instruction count, data offset, data size, symbols offset,
+ *       symbols size and a reserved zero
+ *   code, 64 byte aligned: instructions in memory layout, 32 bytes each:
+ *       op: u32, zero: u32, arg1-3: u64
+ *   data, 8 byte aligned: the data segment as is
+ *   symbols, the imports: count: u64, per import library: str, symbol: str,
+ *       signature: u64, with str as length: u64 and the characters,
+ *       then the exports: count: u64, per export name: str,
+ *       address: u64, result: u64, parameter count: u64, parameters: u64...
+ *       with types as ValueType, type: str
+ *
+ * Nothing needs relocation: calls and function values are instruction
+ * indices and DATA_ADDR takes offsets into the data segment. The version
+ * changes with every change of the layout or the instruction set.
+ */
+namespace image {
+
+constexpr char magic[4] = {'M', 'L', 'B', 'C'};
+constexpr std::uint32_t version = 6;
+
+std::vector<unsigned char> serialize(const Program& program);
+// Copies the image into a Program. Throws if the image is malformed or
+// of another version.
+Program deserialize(const unsigned char* bytes, size_t size);
+
+// Writes a temporary file and renames it over path, processes which map
+// the old image keep running on it
+void save(const Program& program, const std::string& path);
+Program load(const std::string& path);
+
+// Sections of a checked image, pointing into its bytes
+struct Sections {
+    const Instruction* code;
+    size_t codeSize;
+    const unsigned char* data;
+    size_t dataSize;
+    std::vector<Import> imports;
+    std::vector<Export> exports;
+};
+
+Sections parse(const unsigned char* bytes, size_t size);
+
+/*
+ * An image file mapped read-only into memory. Processes mapping the same
+ * file share its pages. Code and data are used in place, see ByteCodeVM.
+ */
+class MappedImage {
+   private:
+    void* memory;
+    size_t size;
+#ifdef WIN
+    void* file;
+    void* mapping;
+#endif
+    Sections sections;
+
+    void unmap();
+
+   public:
+    // Throws if the file can not be mapped or is no valid image
+    explicit MappedImage(const std::string& path);
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+    ~MappedImage();
+
+    const Sections& getSections() const { return sections; }
+};
+
+}  // namespace image
+}  // namespace executor
@@ -0,0 +1,101 @@
+#include "Libraries.h"
+
+#include "../error/Exceptions.h"
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#ifdef WIN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace ffi {
+
+namespace {
+std::mutex librariesMutex;
+// (name, search paths, bind now) -> handle, never closed
+std::map<std::tuple<std::string, std::vector<std::string>, bool>, void*> openLibraries;
+}  // namespace
+
+void* Libraries::open(const std::string& name, const LibraryOptions& options) {
+    std::lock_guard<std::mutex> lock(librariesMutex);
+    auto key = std::make_tuple(name, options.searchPaths, options.bindNow);
+    if (auto it = openLibraries.find(key); it != openLibraries.end()) {
+        return it->second;
+    }
+
+    void* handle = nullptr;
+#ifdef WIN
+    // Symbols are always bound when the library is loaded
+    for (const auto& dir : options.searchPaths) {
+        auto path = dir + "\\lib" + name + ".dll";
+        handle = LoadLibrary(path.c_str());
+        if (handle) break;
+    }
+    if (!handle) {
+        handle = LoadLibrary((name + ".dll").c_str());
+    }
+    if (!handle) {
+        std::cerr << "Error: Could not load library " << name << std::endl;
+        throwConstraintViolated("Failed to load library");
+    }
+#else
+    // Then try the system ones like libm. Their unversioned .so is often a
+    // linker script for the static linker, so also try the runtime name of
+    // glibc libraries.
+    std::vector<std::string> paths;
+    for (const auto& dir : options.searchPaths) {
+        paths.push_back(dir + "/lib" + name + ".so");
+    }
+    paths.push_back("lib" + name + ".so");
+    paths.push_back("lib" + name + ".so.6");
+
+    const int mode = options.bindNow ? RTLD_NOW : RTLD_LAZY;
+    for (const auto& path : paths) {
+        handle = dlopen(path.c_str(), mode);
+        if (handle) break;
+    }
+    if (!handle) {
+        std::cerr << "Error: " << dlerror() << std::endl;
+        throwConstraintViolated("Failed to load library");
+    }
+#endif
+
+    openLibraries.emplace(key, handle);
+    return handle;
+}
+
+void* Libraries::symbol(void* library, const std::string& name) {
+    ASSURE_NOT_NULL(library);
+#ifdef WIN
+    return reinterpret_cast<void*>(GetProcAddress(static_cast<HINSTANCE>(library), name.c_str()));
+#else
+    dlerror(); // Clear any existing error
+    void* address = dlsym(library, name.c_str());
+    if (const char* error = dlerror()) {
+        std::cerr << "Error: " << error << std::endl;
+        return nullptr;
+    }
+    return address;
+#endif
+}
+
+std::vector<std::string> Libraries::splitSearchPaths(const std::string& paths) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start <= paths.size()) {
+        auto end = paths.find(pathSeparator, start);
+        if (end == std::string::npos) end = paths.size();
+        if (end > start) {
+            result.push_back(paths.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+}  // namespace ffi
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace ffi {
+
+// How libraries of extern functions are found and bound
+struct LibraryOptions {
+    // Directories searched for lib<name>.so (lib<name>.dll) in order,
+    // before the system search paths of the dynamic loader
+    std::vector<std::string> searchPaths{"bin"};
+    // Resolve all symbols when the library is opened (RTLD_NOW) instead
+    // of on the first call (RTLD_LAZY)
+    bool bindNow = false;
+};
+
+/*
+ * Opens shared libraries for all VMs of the process. Handles are cached by
+ * name and options and stay loaded until the process ends, so running a
+ * program again does not pay for the dynamic loader.
+ */
+class Libraries {
+   public:
+    // Throws if the library can not be found
+    static void* open(const std::string& name, const LibraryOptions& options);
+
+    // Address of the symbol, nullptr if it does not exist
+    static void* symbol(void* library, const std::string& name);
+
+    // Separates the directories in a search path list, like PATH
+    static constexpr char pathSeparator =
+#ifdef WIN
+        ';';
+#else
+        ':';
+#endif
+    static std::vector<std::string> splitSearchPaths(const std::string& paths);
+};
+
+}  // namespace ffi
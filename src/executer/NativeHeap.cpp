@@ -0,0 +1,25 @@
+#include "NativeHeap.h"
+
+#include <cstdlib>
+
+#include "../error/Exceptions.h"
+
+namespace executor {
+
+NativeHeap::~NativeHeap() {
+    for (void* allocation : allocations) {
+        std::free(allocation);
+    }
+}
+
+void* NativeHeap::allocate(size_t bytes) {
+    // calloc never returns less alignment than max_align_t
+    void* memory = std::calloc(1, bytes == 0 ? 1 : bytes);
+    if (!memory) {
+        throwConstraintViolated("NativeHeap: Out of memory");
+    }
+    allocations.push_back(memory);
+    return memory;
+}
+
+}  // namespace executor
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Types.h"
+
+namespace executor {
+
+/*
+ * Owns raw memory handed out to running programs. Addresses are real
+ * pointers which stay valid until the heap is destroyed, so they can be
+ * passed to external functions without copying.
+ */
+class NativeHeap {
+   private:
+    std::vector<void*> allocations;
+
+   public:
+    NativeHeap() = default;
+    NativeHeap(const NativeHeap&) = delete;
+    NativeHeap& operator=(const NativeHeap&) = delete;
+    ~NativeHeap();
+
+    // Returns zero initialized memory, aligned for any scalar type
+    void* allocate(size_t bytes);
+};
+
+}  // namespace executor
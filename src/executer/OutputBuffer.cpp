@@ -0,0 +1,62 @@
+#include "OutputBuffer.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+
+#include "Strings.h"
+
+namespace executor {
+
+OutputBuffer::Sink OutputBuffer::stdoutSink() {
+    return [](const char* data, size_t length) {
+        std::fwrite(data, 1, length, stdout);
+        std::fflush(stdout);
+    };
+}
+
+OutputBuffer::OutputBuffer(Sink sink, size_t threshold)
+    : sink(std::move(sink)), buffer(), threshold(threshold) {
+    buffer.reserve(threshold);
+}
+
+OutputBuffer::~OutputBuffer() { flush(); }
+
+void OutputBuffer::setSink(Sink newSink) {
+    flush();
+    sink = std::move(newSink);
+}
+
+void OutputBuffer::write(const char* data, size_t length) {
+    buffer.append(data, length);
+    if (buffer.size() >= threshold) {
+        flush();
+    }
+}
+
+void OutputBuffer::writeInt(word_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits),
+                                static_cast<int64_t>(value));
+    write(digits, result.ptr - digits);
+}
+
+void OutputBuffer::writeFloat(double value) {
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    write(digits, result.ptr - digits);
+}
+
+void OutputBuffer::writeString(word_t s) {
+    write(strings::chars(s), strings::length(s));
+}
+
+void OutputBuffer::flush() {
+    if (buffer.empty()) return;
+    if (sink) {
+        sink(buffer.data(), buffer.size());
+    }
+    buffer.clear();
+}
+
+}  // namespace executor
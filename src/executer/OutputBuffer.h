@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "Types.h"
+
+namespace executor {
+
+/*
+ * Collects the output of print and hands it to the sink in large chunks.
+ * Flushes when the threshold is reached, on flush() and on destruction.
+ */
+class OutputBuffer {
+   public:
+    using Sink = std::function<void(const char* data, size_t length)>;
+
+    // Writes to stdout
+    static Sink stdoutSink();
+
+   private:
+    Sink sink;
+    std::string buffer;
+    size_t threshold;
+
+   public:
+    explicit OutputBuffer(Sink sink = stdoutSink(), size_t threshold = 8192);
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+    ~OutputBuffer();
+
+    // Flushes what was written to the previous sink
+    void setSink(Sink sink);
+
+    void write(const char* data, size_t length);
+    // Formats as signed integer
+    void writeInt(word_t value);
+    void writeString(word_t s);
+    // Shortest representation which reads back to the same value
+    void writeFloat(double value);
+    void writeLine() { write("\n", 1); }
+
+    bool empty() const { return buffer.empty(); }
+    void flush();
+};
+
+}  // namespace executor
@@ -1,22 +1,140 @@
 #include "Runner.h"
 
-Runner::Runner() : isBroken(false) {
-}
+#include "../core/CompilationCache.h"
+
+Runner::Runner(core::Mlang& mlang) : mlang(mlang), modules{}, errors{}, compilations(0) {}
 
 Runner::~Runner() {}
 
-bool Runner::getIsBroken() { return isBroken; }
+bool Runner::getIsBroken() { return !errors.empty(); }
+
+bool Runner::addModule(const std::string& name, const std::string& code) {
+    auto hash = core::CompilationCache::hash(code);
+    auto it = modules.find(name);
+    if (it != modules.end() && it->second.hash == hash) {
+        return true;
+    }
 
-bool Runner::addModule(const std::string& code) {
+    ++compilations;
+    Module module{hash, {}};
+    auto rs = mlang.compile(name, code, module.program, core::Mlang::Target::Module);
+    if (rs != core::Mlang::Result::Signal::Success) {
+        modules.erase(name);
+        errors.insert_or_assign(name, rs);
+        return false;
+    }
+    errors.erase(name);
+    modules.insert_or_assign(name, std::move(module));
     return true;
 }
 
-core::Mlang::Result Runner::run() {
-    if (isBroken) {
-        return core::Mlang::Result(core::Mlang::Result::Signal::Failure)
-            .addError("Module invalid");
+void Runner::removeModule(const std::string& name) {
+    modules.erase(name);
+    errors.erase(name);
+}
+
+core::Mlang::Result Runner::link(const std::string& entry, executor::Program& program) {
+    using executor::Op;
+    auto failure = [](const std::string& error) {
+        return core::Mlang::Result(core::Mlang::Result::Signal::Failure).addError(error);
+    };
+
+    if (!errors.empty()) {
+        auto rs = failure("Module invalid: " + errors.begin()->first);
+        for (const auto& error : errors.begin()->second.getErrors()) {
+            rs.addError(error);
+        }
+        return rs;
+    }
+    if (modules.find(entry) == modules.end()) {
+        return failure("Unknown entry module: " + entry);
+    }
+
+    // The entry module first, its code starts by calling its main
+    std::vector<const std::pair<const std::string, Module>*> order;
+    order.push_back(&*modules.find(entry));
+    for (const auto& module : modules) {
+        if (module.first != entry) {
+            order.push_back(&module);
+        }
+    }
+
+    program = executor::Program{};
+    std::map<std::string, std::vector<executor::Export>> exports; // By module, linked addresses
+    std::vector<size_t> codeBases;
+    for (const auto* named : order) {
+        const auto& name = named->first;
+        const auto& module = named->second.program;
+
+        auto codeBase = program.code.size();
+        codeBases.push_back(codeBase);
+
+        std::vector<size_t> importIdxs;
+        for (const auto& import : module.imports) {
+            importIdxs.push_back(program.addImport(import.library, import.symbol, import.signature));
+        }
+
+        for (auto inst : module.code) {
+            if (inst.op == Op::JUMP || inst.op == Op::JUMP_IF) {
+                inst.arg1 += codeBase;
+            } else if (inst.op == Op::DATA_ADDR) {
+                // Interned again, equal strings of all modules share one address
+                inst.arg1 = program.data.addString(module.data.readString(inst.arg1));
+            }
+            program.code.push_back(inst);
+        }
+        for (auto ref : module.codeRefs) {
+            program.code[codeBase + ref].arg1 += codeBase;
+            program.codeRefs.push_back(codeBase + ref);
+        }
+        for (auto ref : module.importRefs) {
+            auto& inst = program.code[codeBase + ref];
+            inst.arg1 = importIdxs.at(inst.arg1);
+            program.importRefs.push_back(codeBase + ref);
+        }
+
+        auto& moduleExports = exports[name];
+        for (auto exported : module.exports) {
+            exported.address += codeBase;
+            moduleExports.push_back(exported);
+        }
+    }
+    program.exports = exports[entry];
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (const auto& link : order[i]->second.program.links) {
+            auto name = link.module + "::" + link.name;
+            auto moduleIt = exports.find(link.module);
+            if (moduleIt == exports.end()) {
+                return failure("Unresolved import " + name + ", no module " + link.module);
+            }
+            const executor::Export* target = nullptr;
+            for (const auto& exported : moduleIt->second) {
+                if (exported.name == link.name) {
+                    target = &exported;
+                }
+            }
+            if (!target) {
+                return failure("Unresolved import " + name);
+            }
+            if (target->type != link.type) {
+                return failure("Import " + name + " has type " + link.type + ", the export " +
+                               target->type);
+            }
+            program.code[codeBases[i] + link.instruction].arg1 = target->address;
+            program.codeRefs.push_back(codeBases[i] + link.instruction);
+        }
     }
 
     return core::Mlang::Result(core::Mlang::Result::Signal::Success);
 }
 
+core::Mlang::Result Runner::run(const std::string& entry) {
+    executor::Program program;
+    auto rs = link(entry, program);
+    if (rs != core::Mlang::Result::Signal::Success) {
+        return rs;
+    }
+    executor::ByteCodeVM runner(program, mlang.settings.libraries);
+    return mlang.run(runner);
+}
@@ -1,21 +1,55 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <string>
 
 #include "../core/Mlang.h"
 #include "../error/Exceptions.h"
+#include "ByteCode.h"
 
+/*
+ * Runs programs of several modules. Every module is compiled on its own,
+ * functions of other modules are imported with their declared types:
+ *
+ *   let add = import math::add(a: Int, b: Int): Int;
+ *
+ * The linker lays out the modules one after another, resolves imports to
+ * the exported functions of the other modules and checks that the types
+ * match, including the fields of structs.
+ * Compiled modules are kept by a hash of their code, so changing one module
+ * compiles only that module again. Only the top level code of the entry
+ * module runs, the other modules provide functions.
+ */
 class Runner {
    private:
-    bool isBroken;
+    struct Module {
+        std::uint64_t hash;
+        executor::Program program;
+    };
+
+    core::Mlang& mlang;
+    std::map<std::string, Module> modules;
+    std::map<std::string, core::Mlang::Result> errors; // Of modules which failed to compile
+    size_t compilations;
 
    public:
-    Runner();
+    // Compiles and runs with the settings of mlang
+    explicit Runner(core::Mlang& mlang);
     ~Runner();
 
-    bool addModule(const std::string& code);
+    // Compiles the module unless the code did not change, false on errors
+    bool addModule(const std::string& name, const std::string& code);
+    void removeModule(const std::string& name);
 
+    // True while a module does not compile
     bool getIsBroken();
-    core::Mlang::Result run();
+    // Modules compiled so far, unchanged modules are not compiled again
+    size_t getCompilations() const { return compilations; }
+
+    // Links all modules into one program which starts with entry
+    core::Mlang::Result link(const std::string& entry, executor::Program& program);
+    core::Mlang::Result run(const std::string& entry);
 };
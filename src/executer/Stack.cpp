@@ -31,6 +31,20 @@ word_t Stack::lookback(size_t n) const{
     return impl[impl.size() - 1 - n];
 }
 
+const word_t* Stack::top(size_t n) const {
+    if (n > impl.size()) {
+        throwConstraintViolated("Stack::top out of bounds");
+    }
+    return impl.data() + impl.size() - n;
+}
+
+void Stack::drop(size_t n) {
+    if (n > impl.size()) {
+        throwConstraintViolated("Cannot drop more values than on the stack");
+    }
+    impl.resize(impl.size() - n);
+}
+
 bool Stack::empty() const {
     return impl.empty();
 }
@@ -22,6 +22,11 @@ public:
 
     word_t lookback(size_t n) const;
 
+    // The n topmost values in push order, valid until the next push
+    const word_t* top(size_t n) const;
+    // Removes the n topmost values
+    void drop(size_t n);
+
     // Indexed access for register-based VM
     word_t get(size_t index) const;
     void set(size_t index, word_t value);
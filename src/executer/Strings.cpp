@@ -0,0 +1,117 @@
+#include "Strings.h"
+
+#include <cstring>
+
+#include "../error/Exceptions.h"
+
+namespace executor {
+namespace strings {
+
+static_assert(sizeof(word_t) == maxInlineLength + 1);
+
+// Memory layout: [length: word_t][characters...][\0]
+// Returns the characters, the terminator is already set
+static char* allocateString(NativeHeap& heap, word_t length) {
+    auto* memory =
+        static_cast<word_t*>(heap.allocate(sizeof(word_t) + length + 1));
+    memory[0] = length;
+    return reinterpret_cast<char*>(memory + 1);
+}
+
+bool isInline(word_t s) { return (s & 1u) != 0u; }
+
+word_t length(word_t s) {
+    if (isInline(s)) {
+        return (s & 0xFFu) >> 1;
+    }
+    ASSURE(s != 0, "String: Access to uninitialized string");
+    return reinterpret_cast<const word_t*>(s)[-1];
+}
+
+const char* chars(const word_t& s) {
+    if (isInline(s)) {
+        // Little endian, the characters follow the tag byte
+        return reinterpret_cast<const char*>(&s) + 1;
+    }
+    ASSURE(s != 0, "String: Access to uninitialized string");
+    return reinterpret_cast<const char*>(s);
+}
+
+word_t create(NativeHeap& heap, const char* data, word_t length) {
+    if (length <= maxInlineLength) {
+        word_t s = (length << 1) | 1u;
+        std::memcpy(reinterpret_cast<char*>(&s) + 1, data, length);
+        return s;
+    }
+
+    char* characters = allocateString(heap, length);
+    std::memcpy(characters, data, length);
+    return reinterpret_cast<word_t>(characters);
+}
+
+word_t concat(NativeHeap& heap, word_t a, word_t b) {
+    auto lengthA = length(a);
+    auto lengthB = length(b);
+    if (lengthB == 0) return a;
+    if (lengthA == 0) return b;
+
+    auto total = lengthA + lengthB;
+    if (total <= maxInlineLength) {
+        char buffer[maxInlineLength];
+        std::memcpy(buffer, chars(a), lengthA);
+        std::memcpy(buffer + lengthA, chars(b), lengthB);
+        return create(heap, buffer, total);
+    }
+
+    char* characters = allocateString(heap, total);
+    std::memcpy(characters, chars(a), lengthA);
+    std::memcpy(characters + lengthA, chars(b), lengthB);
+    return reinterpret_cast<word_t>(characters);
+}
+
+word_t substring(NativeHeap& heap, word_t s, word_t start, word_t count) {
+    auto size = length(s);
+    ASSURE(start <= size && count <= size - start,
+           "String: Substring out of bounds");
+    if (start == 0 && count == size) return s;
+    return create(heap, chars(s) + start, count);
+}
+
+bool equals(word_t a, word_t b) {
+    if (a == b) return true;
+
+    // Inline strings are canonical, so different words mean different content
+    if (isInline(a) && isInline(b)) return false;
+
+    auto size = length(a);
+    if (size != length(b)) return false;
+    return std::memcmp(chars(a), chars(b), size) == 0;
+}
+
+word_t hash(word_t s) {
+    word_t result = 14695981039346656037ull;
+    const char* characters = chars(s);
+    for (word_t i = 0, size = length(s); i < size; ++i) {
+        result ^= static_cast<unsigned char>(characters[i]);
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+word_t toPointer(NativeHeap& heap, word_t s) {
+    if (!isInline(s)) return s;
+
+    auto size = length(s);
+    char* characters = allocateString(heap, size);
+    std::memcpy(characters, chars(s), size);
+    return reinterpret_cast<word_t>(characters);
+}
+
+void StringBuilder::append(word_t s) { buffer.append(chars(s), length(s)); }
+
+word_t StringBuilder::build(NativeHeap& heap) const {
+    return create(heap, buffer.data(), buffer.size());
+}
+
+}  // namespace strings
+}  // namespace executor
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+
+#include "NativeHeap.h"
+#include "Types.h"
+
+namespace executor {
+namespace strings {
+
+// A string value is a single word in one of two representations:
+//
+// - Inline: Strings up to maxInlineLength bytes live in the word itself.
+//   The lowest byte is (length << 1) | 1, the characters follow in the next
+//   bytes and unused bytes are zero. Creating them never allocates.
+//
+// - Pointer: The address of the characters. The length is stored in the
+//   word in front of them and a null terminator behind them. Literals in
+//   the data segment and strings on the native heap use this layout, so they
+//   can be passed to external functions as const char*.
+//
+// The lowest bit tells them apart, pointers are always word aligned.
+
+constexpr word_t maxInlineLength = 7;
+
+bool isInline(word_t s);
+
+word_t length(word_t s);
+
+// Characters of the string, not null terminated for inline strings. Needs
+// a reference as inline strings point into the word itself.
+const char* chars(const word_t& s);
+
+word_t create(NativeHeap& heap, const char* data, word_t length);
+
+word_t concat(NativeHeap& heap, word_t a, word_t b);
+
+word_t substring(NativeHeap& heap, word_t s, word_t start, word_t length);
+
+bool equals(word_t a, word_t b);
+
+// FNV-1a over the characters, equal strings have equal hashes regardless of
+// their representation
+word_t hash(word_t s);
+
+// Returns a null terminated copy for inline strings and s otherwise
+word_t toPointer(NativeHeap& heap, word_t s);
+
+/*
+ * Appends strings in amortized constant time and creates a string of the
+ * result on build
+ */
+class StringBuilder {
+   private:
+    std::string buffer;
+
+   public:
+    void append(word_t s);
+    word_t build(NativeHeap& heap) const;
+};
+
+}  // namespace strings
+}  // namespace executor
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 namespace executor {
 
 #ifdef WIN
@@ -10,4 +12,17 @@ using word_t = unsigned long;
 
 static_assert(sizeof(word_t) == 8);
 
+// Floats are doubles, stored bit for bit in a word
+inline double toFloat(word_t w) {
+    double d;
+    std::memcpy(&d, &w, sizeof(d));
+    return d;
+}
+
+inline word_t fromFloat(double d) {
+    word_t w;
+    std::memcpy(&w, &d, sizeof(w));
+    return w;
+}
+
 } // namespace executor
\ No newline at end of file
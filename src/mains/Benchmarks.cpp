@@ -0,0 +1,642 @@
+#include "../core/CompiledProgram.h"
+#include "../core/Mlang.h"
+#include "../error/Exceptions.h"
+#include "../executer/ByteCode.h"
+#include "../executer/Image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef WIN
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define RUN_BENCHMARK_LABEL(name) \
+    std::cout << "[ BENCH ] " << name << std::endl;
+
+/*
+ * Runs the program and prints the wall time. The result is checked so a
+ * broken feature does not show up as a fast benchmark.
+ */
+bool benchmark(const std::string& name, const std::string& code,
+               const std::string& expectedResult,
+               const std::function<void(core::Mlang::Settings&)>& configure = {}) {
+    RUN_BENCHMARK_LABEL(name);
+
+    core::Mlang mlang;
+    // Measure formatting and buffering, not the terminal
+    mlang.settings.outputSink = [](const char*, size_t) {};
+    if (configure) {
+        configure(mlang.settings);
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto rs = mlang.executeString(code);
+    auto end = std::chrono::steady_clock::now();
+
+    if (rs == core::Mlang::Result::Signal::Failure) {
+        std::cerr << "Error: " << rs.getErrorString() << std::endl;
+        return false;
+    }
+
+    if (rs.getResult() != expectedResult) {
+        std::cerr << "Expected: " << expectedResult
+                  << ", but got: " << rs.getResult() << std::endl;
+        return false;
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    std::cout << "[ TIME  ] " << name << ": " << ms.count() << " ms" << std::endl;
+    return true;
+}
+
+bool benchmarkStrings() {
+    bool ok = true;
+
+    // One million appends of a small string, linear in the total length
+    ok &= benchmark("string_builder_1m", R"(
+        let sb = builder();
+        let i = 0;
+        while (i < 1000000) {
+            append(sb, "ab");
+            i = i + 1;
+        }
+        ret length(build(sb));
+    )", "2000000");
+
+    // One million concatenations of small strings, stay inline and never allocate
+    ok &= benchmark("string_concat_small_1m", R"(
+        let total = 0;
+        let s = "";
+        let i = 0;
+        while (i < 1000000) {
+            s = "ab" + "cd";
+            total = total + length(s);
+            i = i + 1;
+        }
+        ret total;
+    )", "4000000");
+
+    return ok;
+}
+
+bool benchmarkOutput() {
+    return benchmark("print_int_1m", R"(
+        let i = 0;
+        while (i < 1000000) {
+            print(i);
+            i = i + 1;
+        }
+        ret i;
+    )", "1000000");
+}
+
+bool benchmarkFfi() {
+    // Dominated by the cost of a single external call
+    return benchmark("ffi_call_1m", R"(
+        let add = extern test::test_add(a: Int, b: Int): Int;
+        let sum = 0;
+        let i = 0;
+        while (i < 1000000) {
+            sum = add(sum, 1);
+            i = i + 1;
+        }
+        ret sum;
+    )", "1000000");
+}
+
+bool benchmarkFfiFloat() {
+    // Float arguments and returns through xmm registers, straight into libm
+    return benchmark("ffi_libm_sqrt_sin_1m", R"(
+        let sqrt = extern m::sqrt(x: Float): Float;
+        let sin = extern m::sin(x: Float): Float;
+        let total = 0.0;
+        let i = 0;
+        while (i < 1000000) {
+            let x = toFloat(i);
+            total = total + sqrt(x) + sin(x);
+            i = i + 1;
+        }
+        ret toInt(total);
+    )", "666666166");
+}
+
+bool benchmarkCallbacks() {
+    bool ok = true;
+
+    // Elements are 8 byte little endian integers below 2^24 in a blob
+    const std::string fill = R"(
+        let n = 100000;
+        let b = alloc8(8 * n);
+        let modulus = 65536 * 32768;
+        let x = 42;
+        let i = 0;
+        while (i < n) {
+            x = (x * 1103515245 + 12345) % modulus;
+            let v = x / 128;
+            set(b, 8 * i, v % 256);
+            set(b, 8 * i + 1, (v / 256) % 256);
+            set(b, 8 * i + 2, v / 65536);
+            i = i + 1;
+        }
+    )";
+    const std::string countSorted = R"(
+        let sorted = 0;
+        i = 1;
+        while (i < n) {
+            if (value(b, i - 1) <= value(b, i)) {
+                sorted = sorted + 1;
+            }
+            i = i + 1;
+        }
+        ret sorted;
+    )";
+    const std::string value = R"(
+        let value(b: Blob, i: Int) = get(b, 8 * i) + 256 * get(b, 8 * i + 1) + 65536 * get(b, 8 * i + 2);
+    )";
+
+    // libc sorts, every comparison is a call back into the VM
+    ok &= benchmark("ffi_qsort_callback_100k", R"(
+        struct Element {
+            let v: Int;
+        }
+        let qsort = extern c::qsort(base: Blob, count: Int, size: Int, compare: Fn<Element,Element,Int>): Void;
+        let less(a: Element, b: Element) = a.v - b.v;
+    )" + value + fill + R"(
+        qsort(b, n, 8, less);
+    )" + countSorted, "99999");
+
+    // The same sort in MLang, shell sort on the same data
+    ok &= benchmark("mlang_shell_sort_100k", value + fill + R"(
+        let tmp = alloc8(8);
+        let gap = n / 2;
+        while (gap > 0) {
+            i = gap;
+            while (i < n) {
+                copy(tmp, 0, b, 8 * i, 8);
+                let current = value(tmp, 0);
+                let j = i;
+                let moving = true;
+                while (moving) {
+                    moving = false;
+                    if (j >= gap) {
+                        if (value(b, j - gap) > current) {
+                            copy(b, 8 * j, b, 8 * (j - gap), 8);
+                            j = j - gap;
+                            moving = true;
+                        }
+                    }
+                }
+                copy(b, 8 * j, tmp, 0, 8);
+                i = i + 1;
+            }
+            gap = (gap * 5) / 11;
+            if (gap == 2) { gap = 1; }
+        }
+    )" + countSorted, "99999");
+
+    return ok;
+}
+
+bool benchmarkStartup() {
+    // A short script, the compiler takes longer than running it
+    const std::string source = R"(
+        struct Point {
+            let x: Int;
+            let y: Int;
+        }
+        let manhattan(a: Point, b: Point) = {
+            let dx = b.x - a.x;
+            let dy = b.y - a.y;
+            if (a.x > b.x) { dx = a.x - b.x; }
+            if (a.y > b.y) { dy = a.y - b.y; }
+            ret dx + dy;
+        };
+        let fib(n) = {
+            let a = 0;
+            let b = 1;
+            let i = 0;
+            while (i < n) {
+                let t = a + b;
+                a = b;
+                b = t;
+                i = i + 1;
+            }
+            ret a;
+        };
+        let p: Point;
+        let q: Point;
+        p.x = 1;
+        p.y = 2;
+        q.x = 7;
+        q.y = 11;
+        let m: Map<String, Int>;
+        put(m, "distance", manhattan(p, q));
+        put(m, "fib", fib(20));
+        let sb = builder();
+        append(sb, "distance ");
+        append(sb, "computed");
+        print(build(sb));
+        ret get(m, "distance") + get(m, "fib");
+    )";
+
+    auto dir = std::filesystem::temp_directory_path();
+    auto sourcePath = (dir / "mlang_startup.m").string();
+    auto imagePath = (dir / "mlang_startup.mbc").string();
+    std::ofstream(sourcePath) << source;
+
+    core::Mlang mlang;
+    mlang.settings.outputSink = [](const char*, size_t) {};
+    if (mlang.compileFile(sourcePath, imagePath) != core::Mlang::Result::Signal::Success) {
+        std::cerr << "Error: Failed to compile the startup benchmark" << std::endl;
+        return false;
+    }
+
+    // The whole invocation of mlang file.m vs mlang run file.mbc, 100 times
+    auto measure = [&mlang](const std::string& name,
+                            const std::function<core::Mlang::Result()>& execute) {
+        RUN_BENCHMARK_LABEL(name);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 100; ++i) {
+            auto rs = execute();
+            if (rs != core::Mlang::Result::Signal::Success || rs.getResult() != "6780") {
+                std::cerr << "Expected: 6780, but got: " << rs.getResult()
+                          << rs.getErrorString() << std::endl;
+                return false;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        std::cout << "[ TIME  ] " << name << ": " << us.count() / 100 << " us per run" << std::endl;
+        return true;
+    };
+
+    bool ok = true;
+    ok &= measure("startup_source_100x", [&] { return mlang.executeFile(sourcePath); });
+    ok &= measure("startup_image_100x", [&] { return mlang.executeImage(imagePath); });
+    return ok;
+}
+
+// The host calls a small function one million times on a compiled
+// program, compared to compiling and running the same call as a string
+// with the result parsed back, like executeString users do.
+bool benchmarkEmbedding() {
+    const std::string function = "let score(x: Int, y: Int) = (x * 3) + (y % 7);\n";
+    core::Mlang mlang;
+
+    RUN_BENCHMARK_LABEL("embedding_execute_string_1k");
+    std::int64_t expected = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::int64_t i = 0; i < 1000; ++i) {
+        auto rs = mlang.executeString(function + "ret score(" + std::to_string(i) + ", 5);");
+        if (rs != core::Mlang::Result::Signal::Success) {
+            std::cerr << "Error: " << rs.getErrorString() << std::endl;
+            return false;
+        }
+        expected += std::stoll(rs.getResult());
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    std::cout << "[ TIME  ] embedding_execute_string_1k: " << ns.count() / 1000 << " ns per call"
+              << std::endl;
+
+    RUN_BENCHMARK_LABEL("embedding_compiled_calls_1m");
+    std::unique_ptr<core::CompiledProgram> program;
+    if (mlang.compileProgram(function + "ret 0;", program) != core::Mlang::Result::Signal::Success) {
+        std::cerr << "Error: Failed to compile the embedding benchmark" << std::endl;
+        return false;
+    }
+    auto score = program->getFunction<std::int64_t(std::int64_t, std::int64_t)>("score");
+    std::int64_t sum = 0;
+    std::int64_t check = 0;
+    start = std::chrono::steady_clock::now();
+    for (std::int64_t i = 0; i < 1000000; ++i) {
+        auto result = score(i, 5);
+        sum += result;
+        if (i < 1000) {
+            check += result;
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    if (check != expected || sum != 1500000000000 - 1500000 + 5 * 1000000) {
+        std::cerr << "Expected: " << expected << ", but got: " << check << std::endl;
+        return false;
+    }
+    ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    std::cout << "[ TIME  ] embedding_compiled_calls_1m: " << ns.count() / 1000000
+              << " ns per call" << std::endl;
+    return true;
+}
+
+// Calls of one line functions in a loop, with and without inlining
+bool benchmarkInlining() {
+    const std::string code = R"(
+        let inc(x: Int) = x + 1;
+        let scale(x: Int, f: Int) = { let y = x * f; ret y + 1; };
+        let i = 0;
+        let sum = 0;
+        while (i < 10000000) {
+            sum = sum + scale(inc(i), 3);
+            i = inc(i);
+        }
+        ret sum;
+    )";
+    const std::string expected = "150000025000000";
+    bool ok = benchmark("calls_not_inlined_10m", code, expected,
+                        [](auto& settings) { settings.inlineFunctions = false; });
+    ok &= benchmark("calls_inlined_10m", code, expected);
+    return ok;
+}
+
+bool benchmarkLoopInvariants() {
+    const std::string code = R"(
+        struct Config {
+            let limit: Int;
+        }
+        let sum(cfg: Config, k: Int) = {
+            let i = 0;
+            let s = 0;
+            while (i < cfg.limit) {
+                s = s + k * k;
+                i = i + 1;
+            }
+            ret s;
+        };
+        let cfg: Config;
+        cfg.limit = 10000000;
+        ret sum(cfg, 3);
+    )";
+    const std::string expected = "90000000";
+    bool ok = benchmark("loop_invariants_not_hoisted_10m", code, expected,
+                        [](auto& settings) { settings.hoistInvariants = false; });
+    ok &= benchmark("loop_invariants_hoisted_10m", code, expected);
+    return ok;
+}
+
+// Compiles a generated function with 50k locals, each one read by the
+// next declaration. The compiler must not be quadratic in the locals.
+bool benchmarkCompilerLocals() {
+    const size_t locals = 50000;
+    std::string code = "let chain(x0: Int) = {\n";
+    std::int64_t expected = 1;
+    for (size_t i = 1; i < locals; ++i) {
+        code += "    let x" + std::to_string(i) + " = x" + std::to_string(i - 1) + " + " +
+                std::to_string(i % 7) + ";\n";
+        expected += i % 7;
+    }
+    code += "    ret x" + std::to_string(locals - 1) + ";\n};\nret chain(1);\n";
+    return benchmark("compile_locals_50k", code, std::to_string(expected));
+}
+
+// A measure of the programs the mfiles compile to without and with an
+// optimization, per changed file and in total
+bool reportCounts(const std::string& name, const std::string& unit,
+                  const std::function<size_t(const executor::Program&)>& measure,
+                  const std::function<void(core::Mlang::Settings&)>& disable) {
+    RUN_BENCHMARK_LABEL(name);
+    std::vector<std::string> files;
+    for (const auto& entry : std::filesystem::directory_iterator("mfiles")) {
+        if (entry.path().extension() == ".m") {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    size_t totals[2] = {};
+    for (const auto& file : files) {
+        std::ifstream stream(file);
+        std::stringstream code;
+        code << stream.rdbuf();
+
+        size_t sizes[2] = {};
+        bool compiled = true;
+        for (bool enabled : {false, true}) {
+            core::Mlang mlang;
+            if (!enabled) {
+                disable(mlang.settings);
+            }
+            executor::Program program;
+            try {
+                compiled &= mlang.compile(file, code.str(), program) == core::Mlang::Result::Signal::Success;
+            } catch (const MException&) {
+                compiled = false;
+            }
+            sizes[enabled] = measure(program);
+        }
+        if (!compiled) {
+            continue;
+        }
+        totals[false] += sizes[false];
+        totals[true] += sizes[true];
+        if (sizes[true] != sizes[false]) {
+            std::cout << "  " << file << ": " << sizes[false] << " -> " << sizes[true] << std::endl;
+        }
+    }
+    std::cout << "[ COUNT ] " << name << ": " << totals[false] << " -> " << totals[true] << " "
+              << unit << std::endl;
+    return totals[true] <= totals[false];
+}
+
+bool reportInstructionCounts(const std::string& name,
+                             const std::function<void(core::Mlang::Settings&)>& disable) {
+    return reportCounts("instructions_" + name, "instructions",
+                        [](const executor::Program& program) { return program.code.size(); },
+                        disable);
+}
+
+// Local slots of all functions, a function starts at a function address
+size_t frameSlots(const executor::Program& program) {
+    std::vector<size_t> starts;
+    for (auto ref : program.codeRefs) {
+        starts.push_back(program.code[ref].arg1);
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+    size_t slots = 0;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        size_t end = i + 1 < starts.size() ? starts[i + 1] : program.code.size();
+        size_t frame = 0;
+        for (size_t idx = starts[i]; idx < end; ++idx) {
+            if (program.code[idx].op == executor::Op::RET) {
+                frame = std::max<size_t>(frame, program.code[idx].arg2);
+            }
+        }
+        slots += frame;
+    }
+    return slots;
+}
+
+#ifndef WIN
+// Resident and file backed resident memory of this process in KB
+std::pair<long, long> residentMemory() {
+    long size = 0, resident = 0, shared = 0;
+    std::ifstream("/proc/self/statm") >> size >> resident >> shared;
+    auto pageKb = sysconf(_SC_PAGESIZE) / 1024;
+    return {resident * pageKb, shared * pageKb};
+}
+
+// Starts 50 processes at once, which load the image and run it. Each reports
+// the time until the VM is ready for the first instruction and how much
+// private memory it needed for it.
+bool measureImageProcesses(const std::string& name, const std::string& imagePath, bool mapped) {
+    RUN_BENCHMARK_LABEL(name);
+    constexpr int processes = 50;
+    int start[2], results[2];
+    if (pipe(start) != 0 || pipe(results) != 0) return false;
+
+    for (int i = 0; i < processes; ++i) {
+        if (fork() != 0) continue;
+        close(start[1]);
+        char go;
+        (void)!read(start[0], &go, 1); // Returns once the parent closes the pipe
+
+        long report[3] = {-1, 0, 0};
+        try {
+            auto before = residentMemory();
+            auto begin = std::chrono::steady_clock::now();
+            std::unique_ptr<executor::ByteCodeVM> vm;
+            if (mapped) {
+                vm = std::make_unique<executor::ByteCodeVM>(
+                    std::make_shared<const executor::image::MappedImage>(imagePath));
+            } else {
+                vm = std::make_unique<executor::ByteCodeVM>(executor::image::load(imagePath));
+            }
+            auto ready = std::chrono::steady_clock::now();
+            vm->setDebug(false);
+            if (vm->execute(0) == "1") {
+                auto after = residentMemory();
+                report[0] = std::chrono::duration_cast<std::chrono::microseconds>(ready - begin).count();
+                report[1] = (after.first - after.second) - (before.first - before.second);
+                report[2] = after.second - before.second;
+            }
+        } catch (...) {
+        }
+        (void)!write(results[1], report, sizeof(report));
+        _exit(0);
+    }
+
+    close(start[0]);
+    close(start[1]);
+    close(results[1]);
+    long totalUs = 0, totalPrivate = 0, totalShared = 0;
+    bool ok = true;
+    for (int i = 0; i < processes; ++i) {
+        long report[3];
+        if (read(results[0], report, sizeof(report)) != sizeof(report) || report[0] < 0) {
+            ok = false;
+            continue;
+        }
+        totalUs += report[0];
+        totalPrivate += report[1];
+        totalShared += report[2];
+    }
+    close(results[0]);
+    while (wait(nullptr) > 0) {
+    }
+
+    if (!ok) {
+        std::cerr << "Error: A process failed to run the image" << std::endl;
+        return false;
+    }
+    std::cout << "[ TIME  ] " << name << ": " << totalUs / processes
+              << " us to first instruction, " << totalPrivate / processes << " KB private, "
+              << totalShared / processes << " KB shared per process" << std::endl;
+    return true;
+}
+#endif
+
+bool benchmarkImageSharing() {
+#ifdef WIN
+    return true;
+#else
+    // 200k instructions, 6.4 MB of code
+    executor::Program program;
+    for (executor::word_t i = 0; i < 100000; ++i) {
+        program.code.push_back(executor::Instruction(executor::Op::PUSH, i));
+        program.code.push_back(executor::Instruction(executor::Op::POP));
+    }
+    program.code.push_back(executor::Instruction(executor::Op::PUSH, 1));
+    program.code.push_back(executor::Instruction(executor::Op::TERM));
+
+    auto imagePath = (std::filesystem::temp_directory_path() / "mlang_shared.mbc").string();
+    executor::image::save(program, imagePath);
+
+    bool ok = true;
+    ok &= measureImageProcesses("image_copy_50_processes", imagePath, false);
+    ok &= measureImageProcesses("image_mmap_50_processes", imagePath, true);
+    return ok;
+#endif
+}
+
+bool benchmarkMaps() {
+    bool ok = true;
+
+    for (const std::string n : {"1000", "100000", "10000000"}) {
+        ok &= benchmark("map_insert_" + n, R"(
+            let m: Map<Int, Int>;
+            let i = 0;
+            while (i < )" + n + R"() {
+                put(m, i * 7, i);
+                i = i + 1;
+            }
+            ret size(m);
+        )", n);
+
+        // Inserting is part of the time, half of the lookups miss
+        ok &= benchmark("map_insert_lookup_" + n, R"(
+            let m: Map<Int, Int>;
+            let i = 0;
+            while (i < )" + n + R"() {
+                put(m, i * 2, i);
+                i = i + 1;
+            }
+            let found = 0;
+            i = 0;
+            while (i < )" + n + R"() {
+                if (contains(m, i)) {
+                    found = found + 1;
+                }
+                i = i + 1;
+            }
+            ret found;
+        )", std::to_string(std::stoll(n) / 2));
+    }
+
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    try {
+        ok &= benchmarkStrings();
+        ok &= benchmarkOutput();
+        ok &= benchmarkFfi();
+        ok &= benchmarkFfiFloat();
+        ok &= benchmarkCallbacks();
+        ok &= benchmarkStartup();
+        ok &= benchmarkEmbedding();
+        ok &= benchmarkImageSharing();
+        ok &= benchmarkMaps();
+        ok &= benchmarkInlining();
+        ok &= benchmarkLoopInvariants();
+        ok &= benchmarkCompilerLocals();
+        ok &= reportInstructionCounts("constant_folding",
+                                      [](auto& settings) { settings.foldConstants = false; });
+        ok &= reportInstructionCounts("dead_code",
+                                      [](auto& settings) { settings.eliminateDeadCode = false; });
+        ok &= reportCounts("frame_slots", "local slots", frameSlots,
+                           [](auto& settings) { settings.reuseLocalSlots = false; });
+    } catch (const MException& e) {
+        std::cerr << "Benchmark failed with exception: " << e.show(true) << std::endl;
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,23 +1,54 @@
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #include "../core/Mlang.h"
 #include "../error/Exceptions.h"
+#include "../executer/Runner.h"
 #include "../application/ArgumentsParser.h"
 
+// Links the files as modules named like the files, the first one runs
+core::Mlang::Result executeModules(core::Mlang& mlang, const std::vector<std::string>& files) {
+    Runner runner(mlang);
+    for (const auto& file : files) {
+        std::ifstream stream(file);
+        if (!stream.good()) {
+            return core::Mlang::Result(core::Mlang::Result::Signal::Failure)
+                .addError("Could not open file: " + file);
+        }
+        std::stringstream content;
+        content << stream.rdbuf();
+        runner.addModule(std::filesystem::path(file).stem().string(), content.str());
+    }
+    return runner.run(std::filesystem::path(files.front()).stem().string());
+}
+
 int main(int argc, char** argv) {
-    ArgumentsParser args(argc, argv);
+    // mlang file.m                    compiles and runs the file
+    // mlang compile file.m -o file.mbc  writes the bytecode image
+    // mlang run file.mbc                runs an image
+    // mlang main.m math.m               links the modules and runs main
+    ArgumentsParser args(argc, argv, {"compile", "run"});
     if (!args.isSuccess()) {
         std::cerr << "Failed to parse arguments" << std::endl;
         return 1;
     }
 
+    const auto& command = args.getCommand();
     const auto& scriptFileOpt = args.getArgument(0);
     if (!scriptFileOpt) {
         std::cerr << "No script file provided" << std::endl;
         return 1;
     }
 
+    auto imageFile = args.getOption("o");
+    if (command == "compile" && imageFile.empty()) {
+        std::cerr << "No output file provided, use -o file.mbc" << std::endl;
+        return 1;
+    }
+
     std::string scriptFile = *scriptFileOpt;
 
     core::Mlang mlang;
@@ -34,10 +65,32 @@ int main(int argc, char** argv) {
     mlang.settings.showEmission = args.hasFlag("show-emission") || showAll;
     mlang.settings.showExecution = args.hasFlag("show-execution") || showAll;
     mlang.settings.maxInstructions = 0; // 0 means no limit
+    mlang.settings.profileFfi = args.hasFlag("profile-ffi");
+    mlang.settings.cacheDirectory = args.getOption("cache-dir");
+    mlang.settings.inlineFunctions = !args.hasFlag("no-inline");
+    mlang.settings.foldConstants = !args.hasFlag("no-fold");
+    mlang.settings.hoistInvariants = !args.hasFlag("no-licm");
+    mlang.settings.eliminateDeadCode = !args.hasFlag("no-dce");
+    mlang.settings.reuseLocalSlots = !args.hasFlag("no-slot-reuse");
+
+    // Own directories are searched before the default ones
+    auto libPaths = ffi::Libraries::splitSearchPaths(args.getOption("lib-path"));
+    auto& searchPaths = mlang.settings.libraries.searchPaths;
+    searchPaths.insert(searchPaths.begin(), libPaths.begin(), libPaths.end());
+
+    auto bind = args.getOption("bind", "lazy");
+    if (bind != "lazy" && bind != "now") {
+        std::cerr << "Unknown binding '" << bind << "', use --bind=lazy or --bind=now" << std::endl;
+        return 1;
+    }
+    mlang.settings.libraries.bindNow = bind == "now";
 
     int exitCode = 0;
     try {
-        auto rs = mlang.executeFile(scriptFile);
+        auto rs = command == "compile"             ? mlang.compileFile(scriptFile, imageFile)
+                  : command == "run"               ? mlang.executeImage(scriptFile)
+                  : args.getArguments().size() > 1 ? executeModules(mlang, args.getArguments())
+                                                   : mlang.executeFile(scriptFile);
         if (rs == core::Mlang::Result::Signal::Success) {
             const auto& result = rs.getResult();
 
@@ -55,6 +108,11 @@ int main(int argc, char** argv) {
         } else {
             std::cout << rs.getErrorString() << std::endl;
         }
+        if (args.hasFlag("show-cache")) {
+            const auto& cache = mlang.getCacheStatistics();
+            std::cerr << "Compilation cache: " << cache.hits << " hits, " << cache.misses
+                      << " misses, " << cache.failedStores << " failed stores" << std::endl;
+        }
     } catch (const MException& e) {
         std::cout << "Execution failed with exception: " << e.show(true)
                   << std::endl;
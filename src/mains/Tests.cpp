@@ -3,7 +3,13 @@
 #else
     #include "../executer/ExternalFunctions.h"
     #include "../executer/ByteCode.h"
+    #include "../executer/Image.h"
     #include "../core/Mlang.h"
+#include "../core/CompilationCache.h"
+#include "../core/CompiledProgram.h"
+#include "../executer/Runner.h"
+#include "../emitter/Peephole.h"
+    #include "../application/ArgumentsParser.h"
 #endif
 
 #include <iostream>
@@ -12,6 +18,7 @@
 #include <string>
 #include <optional>
 #include <filesystem>
+#include <functional>
 #include <vector>
 #include <algorithm>
 
@@ -120,7 +127,16 @@ void testFile(std::string path){
     mlang.settings.showTypeInference = true;
     mlang.settings.maxInstructions = 1000;
 
-    auto rs = mlang.executeFile(path);
+    // Runtime errors throw, they count as failure too
+    auto rs = core::Mlang::Result(core::Mlang::Result::Signal::Failure);
+    try {
+        rs = mlang.executeFile(path);
+    } catch (const MException& e) {
+        if (!expect_failure) {
+            throw;
+        }
+        rs.addError(e.show());
+    }
 
     if (rs == core::Mlang::Result::Signal::Failure){
         std::cout << "Error: " << rs.getErrorString() << std::endl;
@@ -135,6 +151,14 @@ void testFile(std::string path){
         EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
         EXPECT_TRUE_PRINT(compareResults(expectResult.value(), rs.getResult()),
             expectResult.value() << " != " << rs.getResult());
+
+        // Same result from the bytecode image
+        auto imagePath = (std::filesystem::temp_directory_path() / "mlang_test.mbc").string();
+        EXPECT_TRUE(mlang.compileFile(path, imagePath) == core::Mlang::Result::Signal::Success);
+        auto imageRs = mlang.executeImage(imagePath);
+        EXPECT_TRUE(imageRs == core::Mlang::Result::Signal::Success);
+        EXPECT_TRUE_PRINT(compareResults(expectResult.value(), imageRs.getResult()),
+            expectResult.value() << " != " << imageRs.getResult() << " (image)");
     } else {
         EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
     }
@@ -146,101 +170,84 @@ void testLibrary(){
     RUN_TEST_LABEL();
 
     ffi::ExternalFunctions externalFunctions;
+    auto ints = [](size_t n) {
+        return std::vector<ffi::arg_types::type>(n, ffi::arg_types::DWord);
+    };
 
-    auto test_ii_i = externalFunctions.add("test", "test_ii_i", ffi::ret_type::Number);
+    auto test_ii_i = externalFunctions.add("test", "test_ii_i", ffi::Signature(ffi::ret_type::Number, ints(2)));
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(10);
+        ffi::qword_t args[] = {5, 10};
         auto r = externalFunctions.call(test_ii_i, args);
         EXPECT_EQ(15, r);
     }
 
-    auto test_iii_i = externalFunctions.add("test", "test_iii_i", ffi::ret_type::Number);
+    auto test_iii_i = externalFunctions.add("test", "test_iii_i", ffi::Signature(ffi::ret_type::Number, ints(3)));
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(10);
-        args.addDWord(15);
+        ffi::qword_t args[] = {5, 10, 15};
         auto r = externalFunctions.call(test_iii_i, args);
         EXPECT_EQ(30, r);
     }
 
-    auto test_iiii_i = externalFunctions.add("test", "test_iiii_i", ffi::ret_type::Number);
+    auto test_iiii_i = externalFunctions.add("test", "test_iiii_i", ffi::Signature(ffi::ret_type::Number, ints(4)));
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(10);
-        args.addDWord(15);
-        args.addDWord(20);
+        ffi::qword_t args[] = {5, 10, 15, 20};
         auto r = externalFunctions.call(test_iiii_i, args);
         EXPECT_EQ(50, r);
     }
 
     std::cout << "Testing with 5 arguments..." << std::endl;
 
-    auto test_iiiii_i = externalFunctions.add("test", "test_iiiii_i", ffi::ret_type::Number);
+    auto test_iiiii_i = externalFunctions.add("test", "test_iiiii_i", ffi::Signature(ffi::ret_type::Number, ints(5)));
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(10);
-        args.addDWord(15);
-        args.addDWord(20);
-        args.addDWord(25);
+        ffi::qword_t args[] = {5, 10, 15, 20, 25};
         auto r = externalFunctions.call(test_iiiii_i, args);
         EXPECT_EQ(75, r);
     }
 
     std::cout << "Testing with 6 arguments..." << std::endl;
 
-    auto test_iiiiii_i = externalFunctions.add("test", "test_iiiiii_i", ffi::ret_type::Number);
+    auto test_iiiiii_i = externalFunctions.add("test", "test_iiiiii_i", ffi::Signature(ffi::ret_type::Number, ints(6)));
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(10);
-        args.addDWord(15);
-        args.addDWord(20);
-        args.addDWord(25);
-        args.addDWord(30);
+        ffi::qword_t args[] = {5, 10, 15, 20, 25, 30};
         auto r = externalFunctions.call(test_iiiiii_i, args);
         EXPECT_EQ(105, r);
     }
 
+    std::cout << "Testing negative results..." << std::endl;
+    {
+        ffi::qword_t args[] = {5, static_cast<ffi::qword_t>(-10)};
+        auto r = externalFunctions.call(test_ii_i, args);
+        EXPECT_EQ(static_cast<ffi::qword_t>(-5), r);
+    }
+
     std::cout << "Testing return boolean values..." << std::endl;
 
-    auto test_ii_b = externalFunctions.add("test", "test_ii_b", ffi::ret_type::Bool);
+    auto test_ii_b = externalFunctions.add("test", "test_ii_b", ffi::Signature(ffi::ret_type::Bool, ints(2)));
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(5);
+        ffi::qword_t args[] = {5, 5};
         auto r = externalFunctions.call(test_ii_b, args);
         EXPECT_EQ(1, r); // true
     }
 
     {
-        ffi::Arguments args;
-        args.addDWord(5);
-        args.addDWord(6);
+        ffi::qword_t args[] = {5, 6};
         auto r = externalFunctions.call(test_ii_b, args);
         EXPECT_EQ(0, r); // false
     }
 
-    auto test_bb_b = externalFunctions.add("test", "test_bb_b", ffi::ret_type::Bool);
+    auto test_bb_b = externalFunctions.add("test", "test_bb_b", ffi::Signature(ffi::ret_type::Bool, {ffi::arg_types::Word, ffi::arg_types::Word}));
     {
-        ffi::Arguments args;
-        args.addWord(1); // true
-        args.addWord(0); // false
+        ffi::qword_t args[] = {1, 0}; // true, false
         bool r = externalFunctions.call(test_bb_b, args);
         EXPECT_EQ(0, r); // false
     }
 
-    auto test_pp_p = externalFunctions.add("test", "test_pp_p", ffi::ret_type::Ptr);
+    auto test_pp_p = externalFunctions.add("test", "test_pp_p", ffi::Signature(ffi::ret_type::Ptr, {ffi::arg_types::QWord, ffi::arg_types::QWord}));
     {
-        ffi::Arguments args;
         std::string a = "Hello";
         std::string b = "World";
-        args.addQWord(reinterpret_cast<ffi::qword_t>(const_cast<char*>(a.c_str())));
-        args.addQWord(reinterpret_cast<ffi::qword_t>(const_cast<char*>(b.c_str())));
+        ffi::qword_t args[] = {reinterpret_cast<ffi::qword_t>(a.c_str()),
+                               reinterpret_cast<ffi::qword_t>(b.c_str())};
         auto r = reinterpret_cast<char*>(externalFunctions.call(test_pp_p, args));
         // compare strings
         EXPECT_TRUE(r != nullptr);
@@ -249,6 +256,90 @@ void testLibrary(){
         EXPECT_EQ(expected, result);
     }
 
+    std::cout << "Testing stack arguments..." << std::endl;
+    {
+        ffi::qword_t args[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, static_cast<ffi::qword_t>(-12)};
+        int expected = 1 * 1 + 2 * 2 + 3 * 3 + 4 * 4 + 5 * 5 + 6 * 6;
+        for (size_t n = 7; n <= 12; ++n) {
+            int weight = static_cast<int>(n);
+            expected += weight * static_cast<int>(args[n - 1]);
+            auto name = "test_" + std::to_string(n) + "i_i";
+            auto id = externalFunctions.add("test", name, ffi::Signature(ffi::ret_type::Number, ints(n)));
+            auto r = externalFunctions.call(id, args);
+            EXPECT_EQ(static_cast<ffi::qword_t>(expected), r);
+        }
+    }
+
+    {
+        // One stack argument needs padding to keep the stack aligned
+        auto id = externalFunctions.add("test", "test_stack_alignment", ffi::Signature(ffi::ret_type::Number, ints(7)));
+        ffi::qword_t args[] = {0, 0, 0, 0, 0, 0, 0};
+        EXPECT_EQ(1, externalFunctions.call(id, args));
+    }
+
+    std::cout << "Testing variadic functions..." << std::endl;
+    {
+        auto id = externalFunctions.add("test", "test_va_sum", ffi::Signature(ffi::ret_type::Number, ints(1)));
+        ffi::qword_t args[] = {10, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+        auto r = externalFunctions.call(id, args, ffi::Signature(ffi::ret_type::Number, ints(11)).encode());
+        EXPECT_EQ(55, r);
+
+        args[0] = 2;
+        r = externalFunctions.call(id, args, ffi::Signature(ffi::ret_type::Number, ints(3)).encode());
+        EXPECT_EQ(3, r);
+    }
+
+    std::cout << "Testing float arguments..." << std::endl;
+    {
+        auto toArg = [](double d) { return static_cast<ffi::qword_t>(executor::fromFloat(d)); };
+        auto toDouble = [](ffi::qword_t q) { return executor::toFloat(q); };
+        auto F = ffi::arg_types::Float;
+        auto I = ffi::arg_types::DWord;
+
+        auto test_dd_d = externalFunctions.add("test", "test_dd_d", ffi::Signature(ffi::ret_type::Float, {F, F}));
+        ffi::qword_t dd[] = {toArg(1.5), toArg(-4.0)};
+        EXPECT_EQ(-6.0, toDouble(externalFunctions.call(test_dd_d, dd)));
+
+        auto test_idid_d = externalFunctions.add("test", "test_idid_d", ffi::Signature(ffi::ret_type::Float, {I, F, I, F}));
+        ffi::qword_t idid[] = {3, toArg(0.5), 4, toArg(0.25)};
+        EXPECT_EQ(4.75, toDouble(externalFunctions.call(test_idid_d, idid)));
+
+        auto test_10d_d = externalFunctions.add("test", "test_10d_d", ffi::Signature(ffi::ret_type::Float, std::vector<ffi::arg_types::type>(10, F)));
+        ffi::qword_t ten[10];
+        for (size_t i = 0; i < 10; ++i) ten[i] = toArg(static_cast<double>(i + 1));
+        EXPECT_EQ(385.0, toDouble(externalFunctions.call(test_10d_d, ten)));
+
+        std::vector<ffi::arg_types::type> mixedTypes;
+        ffi::qword_t mixed[14];
+        for (size_t i = 0; i < 14; ++i) {
+            bool isFloat = i % 2 == 1;
+            mixedTypes.push_back(isFloat ? F : I);
+            mixed[i] = isFloat ? toArg(static_cast<double>(i + 1)) : i + 1;
+        }
+        auto test_mixed_stack = externalFunctions.add("test", "test_mixed_stack", ffi::Signature(ffi::ret_type::Float, mixedTypes));
+        EXPECT_EQ(1015.0, toDouble(externalFunctions.call(test_mixed_stack, mixed)));
+
+        auto test_va_dsum = externalFunctions.add("test", "test_va_dsum", ffi::Signature(ffi::ret_type::Float, {I}));
+        ffi::qword_t va[] = {3, toArg(0.5), toArg(1.25), toArg(2.0)};
+        auto r = externalFunctions.call(test_va_dsum, va, ffi::Signature(ffi::ret_type::Float, {I, F, F, F}).encode());
+        EXPECT_EQ(3.75, toDouble(r));
+    }
+
+    std::cout << "Testing signature encoding..." << std::endl;
+    {
+        ffi::Signature signature(ffi::ret_type::Bool, {ffi::arg_types::QWord, ffi::arg_types::Float});
+        auto decoded = ffi::Signature::decode(signature.encode());
+        EXPECT_EQ(signature.returnType, decoded.returnType);
+        EXPECT_TRUE(signature.args == decoded.args);
+    }
+
+    {
+        ffi::Signature signature(ffi::ret_type::Ptr, std::vector<ffi::arg_types::type>(ffi::Signature::maxArgs, ffi::arg_types::Float));
+        auto decoded = ffi::Signature::decode(signature.encode());
+        EXPECT_EQ(signature.returnType, decoded.returnType);
+        EXPECT_TRUE(signature.args == decoded.args);
+    }
+
     END_TEST_LABEL();
 }
 
@@ -266,6 +357,847 @@ void testExecutorData(){
 
     // Check that the strings are null-terminated
     EXPECT_EQ('\0', data.getString(idx)[11]);
+
+    // Equal contents are interned
+    auto size = data.size();
+    EXPECT_EQ(idx, data.addString("Hello World"));
+    EXPECT_EQ(size, data.size());
+    EXPECT_TRUE(data.contains(reinterpret_cast<executor::word_t>(data.getString(idx))));
+    END_TEST_LABEL();
+}
+
+void testStrings(){
+    RUN_TEST_LABEL();
+    executor::Data data;
+    executor::NativeHeap heap;
+
+    // Literals are length prefixed, so they are valid strings
+    auto literal = reinterpret_cast<executor::word_t>(data.getString(data.addString("abc")));
+    EXPECT_EQ(3u, executor::strings::length(literal));
+
+    auto small = executor::strings::create(heap, "abc", 3);
+    EXPECT_TRUE(executor::strings::isInline(small));
+    EXPECT_TRUE(executor::strings::equals(literal, small));
+    EXPECT_EQ(executor::strings::hash(literal), executor::strings::hash(small));
+
+    auto large = executor::strings::concat(heap, small, literal);
+    large = executor::strings::concat(heap, large, large);
+    EXPECT_FALSE(executor::strings::isInline(large));
+    EXPECT_EQ("abcabcabcabc", std::string(executor::strings::chars(large)));
+
+    auto part = executor::strings::substring(heap, large, 3, 3);
+    EXPECT_TRUE(executor::strings::equals(part, small));
+    EXPECT_EQ(small, part);
+
+    auto pointer = executor::strings::toPointer(heap, small);
+    EXPECT_EQ("abc", std::string(executor::strings::chars(pointer)));
+
+    executor::strings::StringBuilder builder;
+    builder.append(small);
+    builder.append(large);
+    EXPECT_EQ(15u, executor::strings::length(builder.build(heap)));
+    END_TEST_LABEL();
+}
+
+void testOutputBuffer(){
+    RUN_TEST_LABEL();
+    std::string captured;
+    size_t sinkCalls = 0;
+    {
+        executor::OutputBuffer output([&](const char* data, size_t length) {
+            captured.append(data, length);
+            ++sinkCalls;
+        }, 16);
+
+        output.writeInt(42);
+        output.writeLine();
+        output.writeInt(static_cast<executor::word_t>(-7));
+        output.writeLine();
+        EXPECT_EQ(0u, sinkCalls);
+
+        // Reaching the threshold flushes
+        output.write("0123456789", 10);
+        EXPECT_EQ(1u, sinkCalls);
+        EXPECT_EQ("42\n-7\n0123456789", captured);
+
+        output.write("end", 3);
+    }
+    // The destructor flushes the rest
+    EXPECT_EQ(2u, sinkCalls);
+    EXPECT_EQ("42\n-7\n0123456789end", captured);
+
+    captured.clear();
+    {
+        executor::OutputBuffer output([&](const char* data, size_t length) {
+            captured.append(data, length);
+        });
+        output.writeFloat(0.1);
+        output.writeLine();
+        output.writeFloat(-2.5);
+    }
+    EXPECT_EQ("0.1\n-2.5", captured);
+    END_TEST_LABEL();
+}
+
+void testImports(){
+    RUN_TEST_LABEL();
+    executor::Program program;
+    auto signature = ffi::Signature(ffi::ret_type::Number, {ffi::arg_types::QWord, ffi::arg_types::QWord}).encode();
+    EXPECT_EQ(0u, program.addImport("test", "test_add", signature));
+    EXPECT_EQ(1u, program.addImport("test", "mul", signature));
+    EXPECT_EQ(0u, program.addImport("test", "test_add", signature));
+    EXPECT_EQ(2u, program.imports.size());
+
+    bool conflictRejected = false;
+    try {
+        program.addImport("test", "test_add", ffi::Signature(ffi::ret_type::Number).encode());
+    } catch (const ConstraintViolatedException&) {
+        conflictRejected = true;
+    }
+    EXPECT_TRUE(conflictRejected);
+
+    // Missing symbols fail when loading, before anything runs
+    program.addImport("test", "does_not_exist", signature);
+    program.code.push_back(executor::Instruction(executor::Op::TERM));
+    bool loadFailed = false;
+    try {
+        executor::ByteCodeVM vm(program);
+    } catch (const ConstraintViolatedException&) {
+        loadFailed = true;
+    }
+    EXPECT_TRUE(loadFailed);
+    END_TEST_LABEL();
+}
+
+void testOutputSink(){
+    RUN_TEST_LABEL();
+    std::string captured;
+    core::Mlang mlang;
+    mlang.settings.outputSink = [&captured](const char* data, size_t length) {
+        captured.append(data, length);
+    };
+
+    auto rs = mlang.executeString(
+        "print(42);\n"
+        "print(\"Hello \" + \"World\");\n"
+        "flush();\n"
+        "print(1 == 2);\n"
+        "ret 0;");
+    EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
+    EXPECT_EQ("42\nHello World\n0\n", captured);
+    END_TEST_LABEL();
+}
+
+void testCallbacks(){
+    RUN_TEST_LABEL();
+    ffi::ExternalFunctions externalFunctions;
+
+    // Mixed arguments, the last ones come from the stack of the caller
+    using Mixed = long long (*)(long long, double, long long, long long, long long,
+                                long long, long long, double, long long, long long);
+    ffi::Signature mixed(ffi::ret_type::Number,
+                         {ffi::arg_types::QWord, ffi::arg_types::Float, ffi::arg_types::QWord,
+                          ffi::arg_types::QWord, ffi::arg_types::QWord, ffi::arg_types::QWord,
+                          ffi::arg_types::QWord, ffi::arg_types::Float, ffi::arg_types::QWord,
+                          ffi::arg_types::QWord});
+    long long calls = 0;
+    auto weighted = +[](void* context, const ffi::qword_t* args) -> ffi::qword_t {
+        ++*static_cast<long long*>(context);
+        long long r = 0;
+        for (size_t i = 0; i < 10; ++i) {
+            auto value = (i == 1 || i == 7) ? static_cast<long long>(executor::toFloat(args[i]))
+                                            : static_cast<long long>(args[i]);
+            r += static_cast<long long>(i + 1) * value;
+        }
+        return r;
+    };
+    auto fn = reinterpret_cast<Mixed>(externalFunctions.thunk(mixed, &calls, weighted));
+    // 1 + 2*2 + 3*3 + ... + 10*10 = 385
+    EXPECT_EQ(385, fn(1, 2.0, 3, 4, 5, 6, 7, 8.0, 9, 10));
+    EXPECT_EQ(1, calls);
+
+    using Halve = double (*)(double);
+    auto halve = +[](void*, const ffi::qword_t* args) -> ffi::qword_t {
+        return executor::fromFloat(executor::toFloat(args[0]) / 2);
+    };
+    auto halveFn = reinterpret_cast<Halve>(externalFunctions.thunk(
+        ffi::Signature(ffi::ret_type::Float, {ffi::arg_types::Float}), nullptr, halve));
+    EXPECT_TRUE(halveFn(5.0) == 2.5);
+
+    // Errors in a callback surface once the external function returned
+    core::Mlang mlang;
+    mlang.settings.maxInstructions = 1000;
+    bool failed = false;
+    try {
+        mlang.executeString(
+            "let call = extern test::test_apply(fn: Fn<Int,Int>, x: Int): Int;\n"
+            "let forever(x: Int) = { while (true) { x = x + 1; } ret x; };\n"
+            "ret call(forever, 1);");
+    } catch (const ConstraintViolatedException&) {
+        failed = true;
+    }
+    EXPECT_TRUE(failed);
+    END_TEST_LABEL();
+}
+
+void testLibraries(){
+    RUN_TEST_LABEL();
+    std::string separator(1, ffi::Libraries::pathSeparator);
+    auto paths = ffi::Libraries::splitSearchPaths("lib" + separator + separator + "bin" + separator);
+    EXPECT_EQ(2u, paths.size());
+    EXPECT_EQ("lib", paths[0]);
+    EXPECT_EQ("bin", paths[1]);
+    EXPECT_TRUE(ffi::Libraries::splitSearchPaths("").empty());
+
+    // Handles are shared by all users in the process
+    ffi::LibraryOptions options;
+    options.searchPaths = {"does_not_exist", "bin"};
+    auto handle = ffi::Libraries::open("test", options);
+    EXPECT_TRUE(handle != nullptr);
+    EXPECT_TRUE(handle == ffi::Libraries::open("test", options));
+    EXPECT_TRUE(ffi::Libraries::symbol(handle, "test_add") != nullptr);
+
+    options.bindNow = true;
+    EXPECT_TRUE(ffi::Libraries::open("test", options) != nullptr);
+
+    bool missingRejected = false;
+    try {
+        ffi::Libraries::open("does_not_exist", options);
+    } catch (const ConstraintViolatedException&) {
+        missingRejected = true;
+    }
+    EXPECT_TRUE(missingRejected);
+
+    core::Mlang mlang;
+    mlang.settings.libraries = options;
+    auto rs = mlang.executeString(
+        "let add = extern test::test_add(a: Int, b: Int): Int;\n"
+        "ret add(2, 3);");
+    EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
+    EXPECT_EQ("5", rs.getResult());
+    END_TEST_LABEL();
+}
+
+void testFfiProfiling(){
+    RUN_TEST_LABEL();
+    EXPECT_EQ(0u, ffi::CallStatistics::bucket(0));
+    EXPECT_EQ(0u, ffi::CallStatistics::bucket(1));
+    EXPECT_EQ(1u, ffi::CallStatistics::bucket(2));
+    EXPECT_EQ(9u, ffi::CallStatistics::bucket(1023));
+    EXPECT_EQ(10u, ffi::CallStatistics::bucket(1024));
+    EXPECT_EQ(ffi::CallStatistics::buckets - 1, ffi::CallStatistics::bucket(~0ull));
+    ffi::CallStatistics fast;
+    fast.library = "test";
+    fast.symbol = "fast";
+    fast.record(0);
+    EXPECT_EQ("test::fast: 1 calls, 0 ns total, 0 ns average\n  [0 ns, 2 ns): 1", fast.toString());
+
+    executor::Program program;
+    auto signature = ffi::Signature(ffi::ret_type::Number, {ffi::arg_types::QWord, ffi::arg_types::QWord}).encode();
+    program.addImport("test", "test_add", signature);
+    for (int i = 0; i < 3; ++i) {
+        program.code.push_back(executor::Instruction(executor::Op::PUSH, 2));
+        program.code.push_back(executor::Instruction(executor::Op::PUSH, 3));
+        program.code.push_back(executor::Instruction(executor::Op::PUSH, 0));
+        program.code.push_back(executor::Instruction(executor::Op::CALL_FFI, 2));
+        if (i > 0) program.code.push_back(executor::Instruction(executor::Op::ADD));
+    }
+    program.code.push_back(executor::Instruction(executor::Op::TERM));
+
+    for (bool enabled : {false, true}) {
+        executor::ByteCodeVM vm(program);
+        vm.setDebug(false);
+        vm.setFfiProfiling(enabled);
+        EXPECT_EQ("15", vm.execute(0));
+
+        const auto& statistics = vm.getFfiStatistics().at(0);
+        EXPECT_EQ("test_add", statistics.symbol);
+        EXPECT_EQ(enabled ? 3u : 0u, statistics.calls);
+        ffi::qword_t histogramCalls = 0;
+        for (auto count : statistics.histogram) histogramCalls += count;
+        EXPECT_EQ(statistics.calls, histogramCalls);
+        EXPECT_EQ(enabled, vm.ffiReport().find("test::test_add: 3 calls") != std::string::npos);
+    }
+    END_TEST_LABEL();
+}
+
+void testImage(){
+    RUN_TEST_LABEL();
+    executor::Program program;
+    auto str = program.data.addString("Hello");
+    program.addImport("test", "test_add", ffi::Signature(ffi::ret_type::Number, {ffi::arg_types::QWord}).encode());
+    program.code.push_back(executor::Instruction(executor::Op::DATA_ADDR, str));
+    program.code.push_back(executor::Instruction(executor::Op::STR_LEN));
+    program.code.push_back(executor::Instruction(executor::Op::PUSH, ~executor::word_t(0), 1, 2));
+    program.code.push_back(executor::Instruction(executor::Op::POP));
+    program.code.push_back(executor::Instruction(executor::Op::TERM));
+    program.exports.push_back({"f", 2, {executor::ValueType::Int, executor::ValueType::Float},
+                               executor::ValueType::Bool, "(int, float) -> bool"});
+
+    auto bytes = executor::image::serialize(program);
+    auto loaded = executor::image::deserialize(bytes.data(), bytes.size());
+    EXPECT_EQ(program.data.size(), loaded.data.size());
+    EXPECT_TRUE(program.data.getBytes() == loaded.data.getBytes());
+    EXPECT_EQ(instructionsToString(program.code, true), instructionsToString(loaded.code, true));
+    EXPECT_EQ(1u, loaded.imports.size());
+    EXPECT_EQ("test_add", loaded.imports[0].symbol);
+    EXPECT_EQ(program.imports[0].signature, loaded.imports[0].signature);
+    EXPECT_EQ(1u, loaded.exports.size());
+    EXPECT_EQ("f", loaded.exports[0].name);
+    EXPECT_EQ(2u, loaded.exports[0].address);
+    EXPECT_TRUE(program.exports[0].params == loaded.exports[0].params);
+    EXPECT_TRUE(executor::ValueType::Bool == loaded.exports[0].result);
+    EXPECT_EQ("(int, float) -> bool", loaded.exports[0].type);
+
+    executor::ByteCodeVM vm(loaded);
+    vm.setDebug(false);
+    EXPECT_EQ("5", vm.execute(0));
+
+    // Mapped images run in place
+    auto imagePath = (std::filesystem::temp_directory_path() / "mlang_test_image.mbc").string();
+    executor::image::save(program, imagePath);
+    auto mapped = std::make_shared<const executor::image::MappedImage>(imagePath);
+    const auto& sections = mapped->getSections();
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(sections.code) % 64);
+    EXPECT_EQ(program.code.size(), sections.codeSize);
+    EXPECT_EQ(instructionsToString(program.code, true),
+              instructionsToString(std::vector<executor::Instruction>(
+                  sections.code, sections.code + sections.codeSize), true));
+    for (bool profiling : {false, true}) {
+        executor::ByteCodeVM mappedVm(mapped);
+        mappedVm.setDebug(false);
+        mappedVm.setFfiProfiling(profiling);
+        EXPECT_EQ("5", mappedVm.execute(0));
+    }
+#ifndef WIN
+    // Saving over a mapped image does not change the mapping
+    executor::image::save(executor::Program(), imagePath);
+    executor::ByteCodeVM replacedVm(mapped);
+    replacedVm.setDebug(false);
+    EXPECT_EQ("5", replacedVm.execute(0));
+#endif
+
+    auto rejects = [](std::vector<unsigned char> image) {
+        try {
+            executor::image::deserialize(image.data(), image.size());
+        } catch (const ConstraintViolatedException&) {
+            return true;
+        }
+        return false;
+    };
+    auto truncated = bytes;
+    truncated.pop_back();
+    EXPECT_TRUE(rejects(truncated));
+    auto otherVersion = bytes;
+    otherVersion[4] += 1;
+    EXPECT_TRUE(rejects(otherVersion));
+    auto notAnImage = bytes;
+    notAnImage[0] = 'X';
+    EXPECT_TRUE(rejects(notAnImage));
+    auto trailing = bytes;
+    trailing.push_back(0);
+    EXPECT_TRUE(rejects(trailing));
+    END_TEST_LABEL();
+}
+
+void testCompilationCache(){
+    RUN_TEST_LABEL();
+    auto directory = std::filesystem::temp_directory_path() / "mlang_test_cache";
+    auto source = std::filesystem::temp_directory_path() / "mlang_test_cache.m";
+    std::filesystem::remove_all(directory);
+
+    auto write = [&](const std::string& code) {
+        std::ofstream stream(source, std::ios::trunc);
+        stream << code;
+    };
+    auto run = [&](core::Mlang& mlang) {
+        auto rs = mlang.executeFile(source.string());
+        EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
+        return rs.getResult();
+    };
+
+    core::Mlang mlang;
+    mlang.settings.cacheDirectory = directory.string();
+    write("let f(x: Int) = x * 2;\nret f(21);");
+    EXPECT_EQ("42", run(mlang));
+    EXPECT_EQ(0u, mlang.getCacheStatistics().hits);
+    EXPECT_EQ(1u, mlang.getCacheStatistics().misses);
+
+    // Other compiler versions and settings have their own entries
+    auto code = "ret 1;";
+    EXPECT_TRUE(mlang.cacheKey(code) == mlang.cacheKey(code, core::Mlang::compilerVersion));
+    EXPECT_TRUE(mlang.cacheKey(code) != mlang.cacheKey(code, core::Mlang::compilerVersion + 1));
+    core::Mlang unfolded;
+    unfolded.settings.foldConstants = false;
+    EXPECT_TRUE(mlang.cacheKey(code) != unfolded.cacheKey(code));
+
+    // Changes to the emitted bytecode need a new compilerVersion, or stale
+    // entries are reused. Bump it and update the fingerprint together.
+    const std::pair<std::uint32_t, std::uint64_t> fingerprint{2, 0xa9e5a66d70a1d4bdull};
+    executor::Program fixed;
+    EXPECT_TRUE(mlang.compile("fingerprint.m",
+                              "let square(x: Int) = x * x;\n"
+                              "let sum(n: Int, k: Int) = { let s = 0; let i = 0;\n"
+                              "    while (i < n) { let c = k * 2; s = s + c + i; i = i + 1; }\n"
+                              "    ret s; };\n"
+                              "let unused = 2 + 3;\n"
+                              "if (\"a\" == \"b\") { print(\"never\"); }\n"
+                              "{ let t = 1; print(t); }\n"
+                              "ret sum(4, 1 + 2) + square(3);",
+                              fixed) == core::Mlang::Result::Signal::Success);
+    auto emitted = core::CompilationCache::hash(executor::instructionsToString(fixed.code, true));
+    const auto& fixedData = fixed.data.getBytes();
+    emitted = core::CompilationCache::hash(std::string(fixedData.begin(), fixedData.end()), emitted);
+    EXPECT_TRUE(fingerprint == std::make_pair(core::Mlang::compilerVersion, emitted));
+
+    // A second compiler finds the entry
+    core::Mlang other;
+    other.settings.cacheDirectory = directory.string();
+    EXPECT_EQ("42", run(other));
+    EXPECT_EQ(1u, other.getCacheStatistics().hits);
+    EXPECT_EQ(0u, other.getCacheStatistics().misses);
+
+    // Changed sources are compiled again, no temporary files are left
+    write("let f(x: Int) = x * 3;\nret f(21);");
+    EXPECT_EQ("63", run(mlang));
+    EXPECT_EQ(2u, mlang.getCacheStatistics().misses);
+    size_t entries = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        EXPECT_EQ(".mbc", entry.path().extension().string());
+        ++entries;
+    }
+    EXPECT_EQ(2u, entries);
+
+    // Unreadable entries count as misses and are replaced
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::ofstream(entry.path(), std::ios::trunc) << "broken";
+    }
+    EXPECT_EQ("63", run(mlang));
+    EXPECT_EQ(3u, mlang.getCacheStatistics().misses);
+    EXPECT_EQ("63", run(mlang));
+    EXPECT_EQ(1u, mlang.getCacheStatistics().hits);
+
+#ifndef WIN
+    // Unwritable cache directories still run the compiled program
+    core::Mlang unwritable;
+    unwritable.settings.cacheDirectory = "/proc/mlang_test_cache";
+    EXPECT_EQ("63", run(unwritable));
+    EXPECT_EQ(1u, unwritable.getCacheStatistics().misses);
+    EXPECT_EQ(1u, unwritable.getCacheStatistics().failedStores);
+    EXPECT_EQ(0u, mlang.getCacheStatistics().failedStores);
+#endif
+
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove(source);
+    END_TEST_LABEL();
+}
+
+void testCompiledProgram(){
+    RUN_TEST_LABEL();
+    core::Mlang mlang;
+    mlang.settings.maxInstructions = 1000;
+    std::string printed;
+    mlang.settings.outputSink = [&](const char* data, size_t length) { printed.append(data, length); };
+
+    std::unique_ptr<core::CompiledProgram> program;
+    auto rs = mlang.compileProgram(
+        "let add(a: Int, b: Int) = a + b;\n"
+        "let scale(x: Float, factor: Float) = x * factor;\n"
+        "let isBig(x: Int) = x > 100;\n"
+        "let show(x: Int) = { print(x); };\n"
+        "let spin(x: Int) = { let i = 0; while (i < 1) { i = i * x; } ret i; };\n"
+        "ret 0;", program);
+    EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
+
+    auto add = program->getFunction<std::int64_t(std::int64_t, std::int64_t)>("add");
+    std::int64_t sum = 0;
+    for (std::int64_t i = 0; i < 100; ++i) {
+        sum += add(i, 1);
+    }
+    EXPECT_EQ(5050, sum);
+    EXPECT_EQ(-3, add(-5, 2));
+    EXPECT_EQ(7.5, (program->getFunction<double(double, double)>("scale")(2.5, 3.0)));
+    auto isBig = program->getFunction<bool(std::int64_t)>("isBig");
+    EXPECT_TRUE(isBig(101) && !isBig(100));
+    program->getFunction<void(std::int64_t)>("show")(42);
+    EXPECT_EQ("42\n", printed);
+
+    auto rejects = [&](auto lookup) {
+        try {
+            lookup();
+        } catch (const ConstraintViolatedException&) {
+            return true;
+        }
+        return false;
+    };
+    EXPECT_TRUE(program->hasFunction("add"));
+    EXPECT_TRUE(!program->hasFunction("missing"));
+    EXPECT_TRUE(rejects([&] { program->getFunction<std::int64_t(std::int64_t)>("missing"); }));
+    EXPECT_TRUE(rejects([&] { program->getFunction<double(std::int64_t, std::int64_t)>("add"); }));
+    EXPECT_TRUE(rejects([&] { program->getFunction<std::int64_t(std::int64_t)>("add"); }));
+
+    // A call over the instruction limit fails, later calls work
+    auto spin = program->getFunction<std::int64_t(std::int64_t)>("spin");
+    EXPECT_TRUE(rejects([&] { spin(1); }));
+    EXPECT_EQ(3, add(1, 2));
+    END_TEST_LABEL();
+}
+
+void testModules(){
+    RUN_TEST_LABEL();
+    core::Mlang mlang;
+    mlang.settings.maxInstructions = 1000;
+    std::string printed;
+    mlang.settings.outputSink = [&](const char* data, size_t length) { printed.append(data, length); };
+
+    Runner runner(mlang);
+    EXPECT_TRUE(runner.addModule("math",
+        "let add(a: Int, b: Int) = a + b;\n"
+        "let half(x: Float) = x / 2.0;\n"
+        "let greet(x: Int) = { print(\"math\"); ret x; };\n"
+        "ret 0;"));
+    EXPECT_TRUE(runner.addModule("main",
+        "let add = import math::add(a: Int, b: Int): Int;\n"
+        "let greet = import math::greet(x: Int): Int;\n"
+        "let twice(x: Int) = {\n"
+        "    let add = import math::add(a: Int, b: Int): Int;\n"
+        "    ret add(x, x);\n"
+        "};\n"
+        "print(\"main\");\n"
+        "ret add(twice(20), greet(2));"));
+    auto rs = runner.run("main");
+    EXPECT_TRUE(rs == core::Mlang::Result::Signal::Success);
+    EXPECT_EQ("42", rs.getResult());
+    EXPECT_EQ("main\nmath\n", printed);
+    EXPECT_EQ(2u, runner.getCompilations());
+
+    // Only the changed module is compiled again
+    EXPECT_TRUE(runner.addModule("main",
+        "let add = import math::add(a: Int, b: Int): Int;\n"
+        "ret add(1, 2);"));
+    EXPECT_TRUE(runner.addModule("math",
+        "let add(a: Int, b: Int) = a + b;\n"
+        "let half(x: Float) = x / 2.0;\n"
+        "let greet(x: Int) = { print(\"math\"); ret x; };\n"
+        "ret 0;"));
+    EXPECT_EQ(3u, runner.getCompilations());
+    EXPECT_EQ("3", runner.run("main").getResult());
+
+    // The linked program runs like any other
+    executor::Program program;
+    EXPECT_TRUE(runner.link("main", program) == core::Mlang::Result::Signal::Success);
+    EXPECT_TRUE(program.links.empty());
+    executor::ByteCodeVM vm(program);
+    vm.setDebug(false);
+    EXPECT_EQ("3", vm.execute(1000));
+
+    // Equal literals of different modules are equal strings
+    EXPECT_TRUE(runner.addModule("text",
+        "let name() = { ret \"shared\"; };\n"
+        "let other() = { ret \"only here\"; };\n"
+        "ret 0;"));
+    EXPECT_TRUE(runner.addModule("main",
+        "let name = import text::name(): String;\n"
+        "let other = import text::other(): String;\n"
+        "print(other());\n"
+        "if (name() == \"shared\") { ret 1; }\n"
+        "ret 0;"));
+    printed.clear();
+    EXPECT_EQ("1", runner.run("main").getResult());
+    EXPECT_EQ("only here\n", printed);
+    runner.removeModule("text");
+
+    auto fails = [&](const std::string& code) {
+        EXPECT_TRUE(runner.addModule("main", code));
+        return runner.run("main") == core::Mlang::Result::Signal::Failure;
+    };
+    EXPECT_TRUE(fails("let f = import math::missing(a: Int): Int; ret f(1);"));
+    EXPECT_TRUE(fails("let f = import other::add(a: Int, b: Int): Int; ret f(1, 2);"));
+    EXPECT_TRUE(fails("let f = import math::add(a: Int): Int; ret f(1);"));
+    EXPECT_TRUE(fails("let f = import math::half(x: Int): Int; ret f(1);"));
+
+    // Types the host can not pass are compared in full
+    EXPECT_TRUE(runner.addModule("text",
+        "struct Point { let x: Int; let y: Int; }\n"
+        "let len(s: String) = length(s);\n"
+        "let sum(p: Point) = p.x + p.y;\n"
+        "ret 0;"));
+    EXPECT_TRUE(runner.addModule("main",
+        "struct Point { let x: Int; let y: Int; }\n"
+        "let len = import text::len(s: String): Int;\n"
+        "let sum = import text::sum(p: Point): Int;\n"
+        "let p: Point;\n"
+        "p.x = 1;\n"
+        "p.y = 2;\n"
+        "ret len(\"four\") + sum(p);"));
+    EXPECT_EQ("7", runner.run("main").getResult());
+    EXPECT_TRUE(fails("let m: Map<Int, Int>;\n"
+                      "let len = import text::len(m: Map<Int, Int>): Int; ret len(m);"));
+    EXPECT_TRUE(fails("struct Point { let x: Int; let z: Int; }\n"
+                      "let p: Point;\n"
+                      "let sum = import text::sum(p: Point): Int; ret sum(p);"));
+    EXPECT_TRUE(fails("struct Point { let y: Int; let x: Int; }\n"
+                      "let p: Point;\n"
+                      "let sum = import text::sum(p: Point): Int; ret sum(p);"));
+    runner.removeModule("text");
+    EXPECT_TRUE(runner.run("unknown") == core::Mlang::Result::Signal::Failure);
+
+    // A broken module fails the program until it is fixed or removed
+    EXPECT_TRUE(!runner.addModule("broken", "ret ;;"));
+    EXPECT_TRUE(runner.getIsBroken());
+    EXPECT_TRUE(runner.run("main") == core::Mlang::Result::Signal::Failure);
+    runner.removeModule("broken");
+    EXPECT_TRUE(!runner.getIsBroken());
+
+    // Imports need the linker
+    EXPECT_TRUE(mlang.executeString("let f = import math::add(a: Int, b: Int): Int; ret f(1, 2);") ==
+                core::Mlang::Result::Signal::Failure);
+    END_TEST_LABEL();
+}
+
+// Programs compiled without and with an optimization, indexed by whether
+// it is enabled, and what they printed
+struct Optimized {
+    executor::Program programs[2];
+    std::string printed[2];
+};
+
+// Compiles and runs code without and with the optimization enable switches,
+// both must give the expected result and print the same
+Optimized compareOptimization(const std::string& code, const std::string& expected,
+                              const std::function<void(core::Mlang::Settings&, bool)>& enable) {
+    Optimized optimized;
+    for (bool enabled : {false, true}) {
+        core::Mlang mlang;
+        enable(mlang.settings, enabled);
+        auto& program = optimized.programs[enabled];
+        EXPECT_TRUE(mlang.compile("internal", code, program) == core::Mlang::Result::Signal::Success);
+        executor::ByteCodeVM vm(program);
+        vm.setDebug(false);
+        auto& printed = optimized.printed[enabled];
+        vm.setOutputSink([&printed](const char* data, size_t length) { printed.append(data, length); });
+        EXPECT_EQ(expected, vm.execute(1000));
+    }
+    EXPECT_EQ(optimized.printed[false], optimized.printed[true]);
+    return optimized;
+}
+
+void testConstantFolding(){
+    RUN_TEST_LABEL();
+    // Same result with and without folding, folded programs are shorter
+    auto compare = [](const std::string& code, const std::string& expected) {
+        auto optimized = compareOptimization(code, expected,
+                                             [](auto& settings, bool on) { settings.foldConstants = on; });
+        const auto& programs = optimized.programs;
+        EXPECT_TRUE_PRINT(programs[true].code.size() < programs[false].code.size(),
+                          code << ": " << programs[true].code.size() << " >= " << programs[false].code.size());
+    };
+    compare("ret 60 * 60 * 24;", "86400");
+    compare("let a = 3; let b = a * 4; ret b - 20;", "18446744073709551608"); // Wraps like the VM
+    compare("ret 1 - 2 < 5;", "0"); // Unsigned like the VM
+    compare("ret toInt(toFloat(7) / 2.0 * 3.0);", "10");
+    compare("let x = 2.5; ret x * 2.0 == 5.0;", "1");
+    compare("if (2 > 1) { ret 1; } else { ret 2; }", "1");
+    compare("let limit = 0; let n = 5; while (limit > 1) { n = n + 1; } ret n;", "5");
+
+    // Assigned locals and division by zero stay
+    core::Mlang mlang;
+    mlang.settings.eliminateDeadCode = false; // Keeps the unused function
+    executor::Program program;
+    EXPECT_TRUE(mlang.compile("internal", "let i = 1; i = i + 1; ret i + 2;", program) ==
+                core::Mlang::Result::Signal::Success);
+    EXPECT_TRUE(instructionsToString(program.code, false).find("ADD") != std::string::npos);
+    EXPECT_TRUE(mlang.compile("internal", "let f(x: Int) = x / 0; ret 0;", program) ==
+                core::Mlang::Result::Signal::Success);
+    EXPECT_TRUE(instructionsToString(program.code, false).find("DIV") != std::string::npos);
+    END_TEST_LABEL();
+}
+
+void testLoopInvariantCodeMotion(){
+    RUN_TEST_LABEL();
+    // Same result with and without the pass, hoisted is the number of
+    // executed instructions the pass saves at least
+    auto compare = [](const std::string& code, const std::string& expected, size_t hoisted) {
+        auto optimized = compareOptimization(code, expected,
+                                             [](auto& settings, bool on) { settings.hoistInvariants = on; });
+        size_t steps[2] = {};
+        for (bool hoist : {false, true}) {
+            // The fewest instructions the program finishes with
+            size_t low = 1, high = 1000;
+            while (low < high) {
+                size_t middle = (low + high) / 2;
+                executor::ByteCodeVM limited(optimized.programs[hoist]);
+                limited.setDebug(false);
+                limited.setOutputSink([](const char*, size_t) {});
+                if (limited.execute(middle) == expected) {
+                    high = middle;
+                } else {
+                    low = middle + 1;
+                }
+            }
+            steps[hoist] = low;
+        }
+        EXPECT_TRUE_PRINT(steps[true] + hoisted <= steps[false],
+                          code << ": " << steps[true] << " + " << hoisted << " > " << steps[false]);
+    };
+    // Parameters, folding would replace constant locals already
+    compare("let f(n: Int) = { let i = 0; while (i < n * 2) { i = i + 1; } ret i; }; ret f(5);", "10", 10);
+    compare("let f(n: Int) = { let i = 0; let s = 0; while (i < 4) { s = s + n * n; i = i + 1; } ret s; }; ret f(3);",
+            "36", 2);
+    compare("let f(a: Int) = { let i = 0; let s = 0; while (i < 3) { let j = 0; while (j < a * 2) { s = s + 1; "
+            "j = j + 1; } i = i + 1; } ret s; }; ret f(2);", "12", 9);
+    compare("struct C { let limit: Int; } let c: C; c.limit = 6; let i = 0; while (i < c.limit) { i = i + 1; } "
+            "ret i;", "6", 3);
+
+    // Assigned operands, field writes, calls and division stay in the loop
+    compare("let f(n: Int) = { let i = 0; while (i < n * 4) { n = n - 1; i = i + 1; } ret i; }; ret f(3);", "3", 0);
+    compare("struct C { let limit: Int; } let c: C; c.limit = 6; let i = 0; while (i < c.limit) { "
+            "i = i + 1; c.limit = 3; } ret i;", "3", 0);
+    compare("struct C { let limit: Int; } let f(c: C) = { c.limit = 3; ret 0; }; let c: C; c.limit = 6; "
+            "let i = 0; while (i < c.limit) { i = i + 1 + f(c); } ret i;", "3", 0);
+    compare("let f(d: Int) = { let i = 0; let s = 0; while (i > 0) { s = 10 / d; } ret s; }; ret f(0);", "0", 0);
+    END_TEST_LABEL();
+}
+
+void testInlining(){
+    RUN_TEST_LABEL();
+    // Same result with and without inlining, calls is the number of CALLs left
+    auto compare = [](const std::string& code, const std::string& expected, size_t calls) {
+        auto optimized = compareOptimization(code, expected,
+                                             [](auto& settings, bool on) { settings.inlineFunctions = on; });
+        const auto& program = optimized.programs[true];
+        auto left = std::count_if(program.code.begin(), program.code.end(),
+                                  [](const auto& inst) { return inst.op == executor::Op::CALL; });
+        EXPECT_EQ(calls + 1, static_cast<size_t>(left)); // The call of main
+    };
+    compare("let f(x: Int) = x + 2; ret f(3) * f(4);", "30", 0);
+    compare("let f(x: Int, y: Int) = { let s = x * y; ret s + x; }; let a = 4; ret f(a, a + 1);", "24", 0);
+    compare("let f(x: Int) = x + 2; let g(x: Int) = x * 3; ret g(f(1));", "9", 0);
+    compare("let f(x: Float) = x * 2.0; ret toInt(f(1.25));", "2", 0);
+    // Conditions of loops run again, arguments with effects and branches stay calls
+    compare("let f(x: Int) = x + 2; let i = 0; while (i < f(3)) { i = i + 1; } ret i;", "5", 1);
+    compare("let f(x: Int) = x + 2; let g(x: Int) = { print(x); ret x; }; ret f(g(1));", "3", 2);
+    compare("let f(x: Int) = { if (x > 1) { ret 1; } ret 2; }; ret f(5);", "1", 1);
+    END_TEST_LABEL();
+}
+
+void testDeadCodeElimination(){
+    RUN_TEST_LABEL();
+    // Same result with and without the pass, programs without dead code are shorter
+    auto compare = [](const std::string& code, const std::string& expected) {
+        auto optimized = compareOptimization(code, expected,
+                                             [](auto& settings, bool on) { settings.eliminateDeadCode = on; });
+        const auto& programs = optimized.programs;
+        EXPECT_TRUE_PRINT(programs[true].code.size() < programs[false].code.size(),
+                          code << ": " << programs[true].code.size() << " >= " << programs[false].code.size());
+    };
+    compare("let unused(x: Int) = x * 2; ret 3;", "3");
+    compare("let f(x: Int) = { ret x + 1; let y = x * 3; ret y; }; ret f(1);", "2");
+    compare("let f(x: Int) = { if (x > 1) { ret 1; } else { ret 2; } ret 3; }; ret f(5);", "1");
+    compare("let f(x: Int) = { let g(y: Int) = y; let h(y: Int) = y + 1; ret h(x); }; ret f(1);", "2");
+
+    // Functions which are used or exported stay
+    core::Mlang mlang;
+    mlang.settings.inlineFunctions = false; // Keeps the call
+    executor::Program program;
+    EXPECT_TRUE(mlang.compile("internal", "let used(x: Int) = x; let unused(x: Int) = x; ret used(1);",
+                              program) == core::Mlang::Result::Signal::Success);
+    EXPECT_EQ(1u, program.exports.size());
+    EXPECT_EQ("used", program.exports.front().name);
+    EXPECT_TRUE(mlang.compile("internal", "let unused(x: Int) = x; ret 0;", program,
+                              core::Mlang::Target::Library) == core::Mlang::Result::Signal::Success);
+    EXPECT_EQ(1u, program.exports.size());
+
+    std::unique_ptr<core::CompiledProgram> compiled;
+    EXPECT_TRUE(mlang.compileProgram("let twice(x: Int) = x * 2; ret 0;", compiled) ==
+                core::Mlang::Result::Signal::Success);
+    EXPECT_EQ(8, (compiled->getFunction<std::int64_t(std::int64_t)>("twice")(4)));
+    END_TEST_LABEL();
+}
+
+void testPeephole(){
+    RUN_TEST_LABEL();
+    using executor::Instruction;
+    using executor::Op;
+    executor::Program program;
+    program.code = {
+        Instruction(Op::PUSH, 4), Instruction(Op::CALL, 0), Instruction(Op::TERM),
+        Instruction(Op::NOP),
+        Instruction(Op::PUSH, 7), Instruction(Op::POP), // main
+        Instruction(Op::PUSH, 1), Instruction(Op::JUMP_IF, 10), Instruction(Op::JUMP, 10),
+        Instruction(Op::NOP),
+        Instruction(Op::JUMP, 11),
+        Instruction(Op::PUSH, 42), Instruction(Op::LOCALS, 0), Instruction(Op::LOCALL, 0),
+        Instruction(Op::RET, 0, 1, 1)};
+    program.codeRefs = {0};
+    program.exports.push_back(executor::Export{"main", 4, {}, executor::ValueType::Int, "() -> int"});
+
+    emitter::Peephole peephole;
+    peephole.run(program);
+    EXPECT_EQ(7u, peephole.getRemoved());
+    EXPECT_EQ("0: PUSH 3 \n1: CALL 0 \n2: TERM \n3: PUSH 1 \n4: JUMP_IF 5 \n5: PUSH 42 \n"
+              "6: LOCALT 0 \n7: RET 0 1 1 ",
+              instructionsToString(program.code, false));
+    EXPECT_EQ(3u, program.exports.front().address);
+    executor::ByteCodeVM vm(program);
+    vm.setDebug(false);
+    EXPECT_EQ("42", vm.execute(1000));
+
+    // Branches and loops leave no landing pads
+    core::Mlang mlang;
+    EXPECT_TRUE(mlang.compile("internal",
+                              "let i = 0; while (i < 10) { if (i > 5) { i = i + 2; } else { i = i + 1; } } ret i;",
+                              program) == core::Mlang::Result::Signal::Success);
+    EXPECT_TRUE(instructionsToString(program.code, false).find("NOP") == std::string::npos);
+    executor::ByteCodeVM loop(program);
+    loop.setDebug(false);
+    EXPECT_EQ("10", loop.execute(1000));
+    END_TEST_LABEL();
+}
+
+void testLocalSlots(){
+    RUN_TEST_LABEL();
+    // Same result with and without sharing slots, the frame of main is smaller
+    auto compare = [](const std::string& code, const std::string& expected, size_t frame) {
+        auto optimized = compareOptimization(code, expected,
+                                             [](auto& settings, bool on) { settings.reuseLocalSlots = on; });
+        size_t frames[2] = {};
+        for (bool reuse : {false, true}) {
+            const auto& program = optimized.programs[reuse];
+            EXPECT_TRUE(program.code.back().op == executor::Op::RET);
+            frames[reuse] = program.code.back().arg2;
+        }
+        EXPECT_TRUE_PRINT(frames[true] < frames[false], code << ": " << frames[true] << " >= " << frames[false]);
+        EXPECT_EQ(frame, frames[true]);
+        return optimized.printed[true];
+    };
+    EXPECT_EQ("4\n", compare("let c = 2; c = c * 1; if (c > 1) { let a = c * 2; print(a); } else { let b = c * 3; "
+                             "print(b); } ret c;", "2", 2));
+    compare("let i = 0; let s = 0; while (i < 3) { let t = i * 2; s = s + t; let u = s; i = i + 1; } ret s;",
+            "6", 3);
+    compare("let a = 1; a = a + 1; let b = a * 2; let c = b + 1; ret c;", "5", 1);
+    END_TEST_LABEL();
+}
+
+void testArgumentsParser(){
+    RUN_TEST_LABEL();
+    const char* argv[] = {"mlang", "compile", "file.m", "-o", "file.mbc", "--debug", "--bind=now"};
+    ArgumentsParser args(7, const_cast<char**>(argv), {"compile", "run"});
+    EXPECT_TRUE(args.isSuccess());
+    EXPECT_EQ("compile", args.getCommand());
+    EXPECT_EQ("file.m", args.getArgument(0).value());
+    EXPECT_EQ("file.mbc", args.getOption("o"));
+    EXPECT_EQ("now", args.getOption("bind"));
+    EXPECT_TRUE(args.hasFlag("debug"));
+
+    // Only the first argument can be a command
+    const char* plain[] = {"mlang", "file.m", "run"};
+    ArgumentsParser plainArgs(3, const_cast<char**>(plain), {"compile", "run"});
+    EXPECT_EQ("", plainArgs.getCommand());
+    EXPECT_EQ(2u, plainArgs.getArguments().size());
+
+    const char* missing[] = {"mlang", "compile", "file.m", "-o"};
+    EXPECT_TRUE(!ArgumentsParser(4, const_cast<char**>(missing), {"compile"}).isSuccess());
     END_TEST_LABEL();
 }
 
@@ -294,6 +1226,24 @@ int main() {
     suiteTestfiles();
     testLibrary();
     testExecutorData();
+    testImports();
+    testCallbacks();
+    testLibraries();
+    testFfiProfiling();
+    testImage();
+    testCompilationCache();
+    testCompiledProgram();
+    testModules();
+    testConstantFolding();
+    testLoopInvariantCodeMotion();
+    testInlining();
+    testDeadCodeElimination();
+    testPeephole();
+    testLocalSlots();
+    testArgumentsParser();
+    testStrings();
+    testOutputBuffer();
+    testOutputSink();
 
     return 0;
 }
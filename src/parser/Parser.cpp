@@ -221,6 +221,11 @@ std::shared_ptr<AST::Node> Parser::nrExpression() {
         return assignment();
     }
 
+    // b[i] = v
+    if (speculate(&Parser::indexAssignment, Parser::Rule::IndexAssignment)) {
+        return indexAssignment();
+    }
+
     // block
     if (speculate(&Parser::block, Parser::Rule::Block)) {
         return block();
@@ -236,6 +241,11 @@ std::shared_ptr<AST::Node> Parser::nrExpression() {
         return literal();
     }
 
+    // b[i]
+    if (speculate(&Parser::indexAccess, Parser::Rule::IndexAccess)) {
+        return indexAccess();
+    }
+
     // Struct access
     if (speculate(&Parser::structAccess, Parser::Rule::StructAccess)) {
         return structAccess();
@@ -270,8 +280,9 @@ std::shared_ptr<AST::Ret> Parser::ret() {
 }
 
 std::shared_ptr<AST::ExternFn> Parser::externFn() {
-    consumeOrFail(Token::Type::Keyword, "extern");
-
+    // extern library::symbol or import module::function
+    doOrFail(isNext(Token::Type::Keyword), "extern or import");
+    bool isImport = consume().getContent() == "import";
 
     doOrFail(speculate(&Parser::identifier, Parser::Rule::Identifier),
              "identifier");
@@ -286,14 +297,20 @@ std::shared_ptr<AST::ExternFn> Parser::externFn() {
     consumeOrFail('(', "(");
 
     std::vector<std::shared_ptr<AST::Identifier>> params;
+    bool isVariadic = false;
     if (!isNext(')')) {
-        // Identifier list is optional
-        doOrFail(identifierList(params), "list of identifiers");
+        // Identifier list is optional, a trailing ... marks a C varargs function
+        doOrFail(identifierList(params, &isVariadic), "list of identifiers");
     }
 
     consumeOrFail(')', ")");
 
     auto result = std::make_shared<AST::ExternFn>(function, library, params, getPosition());
+    result->setVariadic(isVariadic);
+    result->setImport(isImport);
+    if (isImport && isVariadic) {
+        fail("Imported functions can not be variadic");
+    }
 
     if(speculate(&Parser::typeAnnotation, Parser::Rule::TypeAnnotation)) {
         auto type = typeAnnotation();
@@ -341,8 +358,16 @@ bool Parser::argumentList(std::vector<std::shared_ptr<AST::Node>>& theList) {
 }
 
 bool Parser::identifierList(
-    std::vector<std::shared_ptr<AST::Identifier>>& theList) {
+    std::vector<std::shared_ptr<AST::Identifier>>& theList, bool* isVariadic) {
     do {
+        if (isVariadic && lookAhead_t(0) == Token::Type::Special &&
+            lookAhead(0).getContent() == "...") {
+            // Only allowed as the last entry
+            consume();
+            *isVariadic = true;
+            return true;
+        }
+
         if (speculate(&Parser::identifier, Parser::Rule::Identifier)) {
             auto ident = identifier();
             if (!ident) return false;
@@ -389,6 +414,55 @@ std::shared_ptr<AST::StructAccess> Parser::structAccess() {
     return std::make_shared<AST::StructAccess>(identifiers, getPosition());
 }
 
+std::shared_ptr<AST::Node> Parser::indexTarget() {
+    if (speculate(&Parser::structAccess, Parser::Rule::StructAccess)) {
+        return structAccess();
+    }
+
+    doOrFail(isNext(Token::Type::Identifier), "identifier");
+    return identifier();
+}
+
+// Syntax sugar: b[i] is get(b, i)
+std::shared_ptr<AST::Call> Parser::indexAccess() {
+    auto target = indexTarget();
+    doOrFail(target, "identifier");
+    const auto& pos = getPosition();
+
+    consumeOrFail('[', "[");
+    doOrFail(speculate(&Parser::expression, Parser::Rule::Expression),
+             "expression");
+    auto index = expression();
+    consumeOrFail(']', "]");
+
+    return std::make_shared<AST::Call>(
+        std::make_shared<AST::Identifier>("get", pos),
+        std::vector<std::shared_ptr<AST::Node>>{target, index}, pos);
+}
+
+// Syntax sugar: b[i] = v is set(b, i, v)
+std::shared_ptr<AST::Call> Parser::indexAssignment() {
+    auto target = indexTarget();
+    doOrFail(target, "identifier");
+    const auto& pos = getPosition();
+
+    consumeOrFail('[', "[");
+    doOrFail(speculate(&Parser::expression, Parser::Rule::Expression),
+             "expression");
+    auto index = expression();
+    consumeOrFail(']', "]");
+
+    consumeOrFail(Token::Type::Assignment, "=");
+
+    doOrFail(speculate(&Parser::expression, Parser::Rule::Expression),
+             "expression");
+    auto value = expression();
+
+    return std::make_shared<AST::Call>(
+        std::make_shared<AST::Identifier>("set", pos),
+        std::vector<std::shared_ptr<AST::Node>>{target, index, value}, pos);
+}
+
 std::shared_ptr<AST::Identifier> Parser::identifier() {
     doOrFail((isNext(Token::Type::Identifier) || isNext(Token::Type::Special)),
              "identifier or special");
@@ -397,6 +471,11 @@ std::shared_ptr<AST::Identifier> Parser::identifier() {
 }
 
 std::shared_ptr<AST::Literal> Parser::literal() {
+    // Before integer, which would only take the part before the period
+    if (speculate(&Parser::floating, Parser::Rule::Float)) {
+        return floating();
+    }
+
     if (speculate(&Parser::integer, Parser::Rule::Integer)) {
         return integer();
     }
@@ -421,6 +500,21 @@ std::shared_ptr<AST::Literal> Parser::integer() {
 }
 
 
+std::shared_ptr<AST::Literal> Parser::floating() {
+    // The tokenizer splits 1.5 into 1 . 5
+    doOrFail((lookAhead_t(0) == Token::Type::Number &&
+              lookAhead_t(1) == Token::Type::Period &&
+              lookAhead_t(2) == Token::Type::Number),
+             "floating point number");
+    auto integral = consume();
+    consume();
+    auto fraction = consume();
+
+    return std::make_shared<AST::Literal>(
+        integral.getContent() + "." + fraction.getContent(),
+        DataType::Primitive::Float, getPosition());
+}
+
 std::shared_ptr<AST::Literal> Parser::stringLiteral(){
     doOrFail(isNext(Token::Type::StringLiteral), "string");
     auto token = consume();
@@ -563,8 +657,19 @@ std::shared_ptr<AST::Declvar> Parser::variableDecl() {
 std::shared_ptr<AST::Identifier> Parser::typeAnnotation() {
     consumeOrFail(Token::Type::Colon, ":");
     doOrFail(isNext(Token::Type::Identifier), "identifier");
-    auto token = consume();
-    return std::make_shared<AST::Identifier>(token.getContent(), getPosition());
+    auto name = consume().getContent();
+
+    // Type arguments, like Map<Int, String>
+    if (consume('<')) {
+        name += "<";
+        do {
+            doOrFail(isNext(Token::Type::Identifier), "identifier");
+            name += consume().getContent() + ",";
+        } while (consume(Token::Type::Comma));
+        name.back() = '>';
+        consumeOrFail('>', ">");
+    }
+    return std::make_shared<AST::Identifier>(name, getPosition());
 }
 
 std::shared_ptr<AST::Declfn> Parser::functionDecl() {
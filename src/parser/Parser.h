@@ -31,6 +31,7 @@ class Parser {
         ArgumentList,
         Identifier,
         Integer,
+        Float,
         Boolean,
         StringLiteral,
         LeftHandValue,
@@ -44,7 +45,9 @@ class Parser {
         TypeAnnotation,
         UninitializedVarDecl,
         StructAccess,
-        ExternFn
+        ExternFn,
+        IndexAccess,
+        IndexAssignment
     };
 
     enum CacheResult { SUCCESS, FAILURE, MISS };
@@ -102,7 +105,8 @@ class Parser {
     bool isDone();
 
     bool argumentList(std::vector<std::shared_ptr<AST::Node>>& theList);
-    bool identifierList(std::vector<std::shared_ptr<AST::Identifier>>& theList);
+    bool identifierList(std::vector<std::shared_ptr<AST::Identifier>>& theList,
+                        bool* isVariadic = nullptr);
 
     std::vector<std::shared_ptr<AST::Node>> statementList();
 
@@ -118,6 +122,7 @@ class Parser {
     std::shared_ptr<AST::Identifier> identifier();
     std::shared_ptr<AST::Literal> literal();
     std::shared_ptr<AST::Literal> integer();
+    std::shared_ptr<AST::Literal> floating();
     std::shared_ptr<AST::Literal> stringLiteral();
     std::shared_ptr<AST::Call> infixCall();
     std::shared_ptr<AST::Assign> assignment();
@@ -132,6 +137,9 @@ class Parser {
     std::shared_ptr<AST::Identifier> typeAnnotation();
     std::shared_ptr<AST::Declvar> uninitializedVarDecl();
     std::shared_ptr<AST::StructAccess> structAccess();
+    std::shared_ptr<AST::Node> indexTarget();
+    std::shared_ptr<AST::Call> indexAccess();
+    std::shared_ptr<AST::Call> indexAssignment();
 
     std::map<size_t /*idx*/, std::map<Rule, CacheResult>> cache;
 
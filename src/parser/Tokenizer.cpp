@@ -12,11 +12,12 @@ bool isParen(char c) {
 }
 bool isNumeric(char c) { return c >= '0' && c <= '9'; }
 bool isAlphabetic(char c) {
-    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+    // Underscores are allowed in identifiers like find_byte
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
 }
 bool isAlphanumeric(char c) { return isNumeric(c) || isAlphabetic(c); }
 bool isSpecial(char c) {
-    if (isParen(c)) return false;
+    if (isParen(c) || c == '_') return false;
     return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
            (c >= '[' && c <= '_') || (c >= '{' && c <= '~');
 }
@@ -37,7 +38,7 @@ bool isPeriod(char c) {
 }  // namespace CharCategories
 
 bool isKeyword(const std::string& content) {
-    return content == "extern";
+    return content == "extern" || content == "import";
 }
 
 // TODO Put token in its own file
@@ -313,7 +314,10 @@ Tokenizer::Tokenizer(const std::string& theFile, const std::string& theInput)
             } else if (inStringLiteral == c) {
                 // End of string literal
                 inStringLiteral = 0;
-                pushBuffer(Token::Type::StringLiteral);
+                // Also push empty literals
+                tokens.emplace_back(Token::Type::StringLiteral, buffer, itsFile,
+                                    bufferStartLine, bufferStartColumn - 1u);
+                buffer.clear();
             } else /* different kind of quote */ {
                 // Already added to buffer above
             }
@@ -323,8 +327,9 @@ Tokenizer::Tokenizer(const std::string& theFile, const std::string& theInput)
         bool aAlphanumeric = CharCategories::isAlphanumeric(c);
         bool aSpecial = CharCategories::isSpecial(c);
 
-        // Parenthesis are their own tokens
-        if (CharCategories::isParen(c)) {
+        // Parenthesis, commas and terminators are their own tokens, so
+        // Map<Int, Int>; is not read as the operator >;
+        if (CharCategories::isParen(c) || CharCategories::isStatementTerminator(c) || c == ',') {
             pushBuffer();
             tokens.emplace_back(std::string(1, c), itsFile, line, column - 1u);
             continue;
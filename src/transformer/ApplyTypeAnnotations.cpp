@@ -6,6 +6,54 @@
 
 ApplyTypeAnnotations::ApplyTypeAnnotations(CollectTypes::TypesMap& types) : types{types} {}
 
+DataType ApplyTypeAnnotations::toDataType(const std::string& annotationText) {
+    if (types.find(annotationText) != types.end()) {
+        return types[annotationText];
+    }
+
+    // Map<Key,Value> as written by Parser::typeAnnotation
+    const std::string mapPrefix = "Map<";
+    if (annotationText.compare(0, mapPrefix.size(), mapPrefix) == 0 &&
+        annotationText.back() == '>') {
+        auto comma = annotationText.find(',');
+        if (comma == std::string::npos) {
+            return DataType::Primitive::Unknown;
+        }
+
+        auto key = toDataType(annotationText.substr(mapPrefix.size(), comma - mapPrefix.size()));
+        auto value = toDataType(annotationText.substr(comma + 1, annotationText.size() - comma - 2));
+        if ((key != DataType::Primitive::Int && key != DataType::Primitive::String) ||
+            value == DataType::Primitive::Unknown) {
+            return DataType::Primitive::Unknown;
+        }
+        return DataType(DataType::Map{std::make_shared<const DataType>(key),
+                                      std::make_shared<const DataType>(value)});
+    }
+
+    // Fn<Param,...,Return>, the type of functions passed to extern functions
+    const std::string fnPrefix = "Fn<";
+    if (annotationText.compare(0, fnPrefix.size(), fnPrefix) == 0 &&
+        annotationText.back() == '>') {
+        std::vector<DataType> types;
+        size_t start = fnPrefix.size();
+        while (start < annotationText.size()) {
+            auto end = annotationText.find_first_of(",>", start);
+            auto type = toDataType(annotationText.substr(start, end - start));
+            if (type == DataType::Primitive::Unknown) {
+                return DataType::Primitive::Unknown;
+            }
+            types.push_back(type);
+            start = end + 1;
+        }
+
+        auto ret = types.back();
+        types.pop_back();
+        return DataType(types, ret);
+    }
+
+    return DataType::toPrimitive(annotationText);
+}
+
 std::shared_ptr<AST::Node> ApplyTypeAnnotations::process(std::shared_ptr<AST::Node> node) {
     if (node->getType() == AST::NodeType::Declvar) {
         auto declvar = std::dynamic_pointer_cast<AST::Declvar>(node);
@@ -14,34 +62,26 @@ std::shared_ptr<AST::Node> ApplyTypeAnnotations::process(std::shared_ptr<AST::No
             auto identifier = declvar->getIdentifier();
             ASSURE_NOT_NULL(identifier);
 
-            if(types.find(annotationText) != types.end()) {
-                identifier->setDataType(types[annotationText], [this](auto& s) { this->addMessage(s); });
+            auto type = toDataType(annotationText);
+            if(type != DataType::Primitive::Unknown) {
+                identifier->setDataType(type, [this](auto& s) { this->addMessage(s); });
             } else {
-                DataType::Primitive primitive = DataType::toPrimitive(annotationText);
-                if(primitive != DataType::Primitive::Unknown) {
-                    identifier->setDataType(DataType(primitive), [this](auto& s) { this->addMessage(s); });
-                } else {
-                    std::string msg = "Invalid type annotation '" + annotationText +
-                                     "' for variable '" + identifier->getName() + "'";
-                    itsErrors.emplace_back(msg, declvar->getPosition());
-                }
+                std::string msg = "Invalid type annotation '" + annotationText +
+                                 "' for variable '" + identifier->getName() + "'";
+                itsErrors.emplace_back(msg, declvar->getPosition());
             }
         }
     } if (node->getType() == AST::NodeType::Identifier) {
         auto identifier = std::dynamic_pointer_cast<AST::Identifier>(node);
         if(identifier->hasTypeAnnotation()) {
             const auto& annotationText = identifier->getTypeAnnotation();
-            if(types.find(annotationText) != types.end()) {
-                identifier->setDataType(types[annotationText], [this](auto& s) { this->addMessage(s); });
+            auto type = toDataType(annotationText);
+            if(type != DataType::Primitive::Unknown) {
+                identifier->setDataType(type, [this](auto& s) { this->addMessage(s); });
             } else {
-                DataType::Primitive primitive = DataType::toPrimitive(annotationText);
-                if(primitive != DataType::Primitive::Unknown) {
-                    identifier->setDataType(DataType(primitive), [this](auto& s) { this->addMessage(s); });
-                } else {
-                    std::string msg = "Invalid type annotation '" + annotationText +
-                                     "' for identifier '" + identifier->getName() + "'";
-                    itsErrors.emplace_back(msg, identifier->getPosition());
-                }
+                std::string msg = "Invalid type annotation '" + annotationText +
+                                 "' for identifier '" + identifier->getName() + "'";
+                itsErrors.emplace_back(msg, identifier->getPosition());
             }
         }
     } if (node->getType() == AST::NodeType::ExternFn) {
@@ -54,17 +94,13 @@ std::shared_ptr<AST::Node> ApplyTypeAnnotations::process(std::shared_ptr<AST::No
         std::shared_ptr<DataType> returnType{nullptr};
         if (externFn->hasTypeAnnotation()) {
             const auto& annotationText = externFn->getTypeAnnotation();
-            if (types.find(annotationText) != types.end()) {
-                returnType = std::make_shared<DataType>(types[annotationText]); // TODO: Should just return shared_ptr
+            auto type = toDataType(annotationText);
+            if (type != DataType::Primitive::Unknown) {
+                returnType = std::make_shared<DataType>(type); // TODO: Should just return shared_ptr
             } else {
-                DataType::Primitive primitive = DataType::toPrimitive(annotationText);
-                if (primitive != DataType::Primitive::Unknown) {
-                    returnType = std::make_shared<DataType>(primitive);
-                } else {
-                    std::string msg = "Invalid return type annotation '" + annotationText +
-                                     "' for extern function";
-                    itsErrors.emplace_back(msg, externFn->getPosition());
-                }
+                std::string msg = "Invalid return type annotation '" + annotationText +
+                                 "' for extern function";
+                itsErrors.emplace_back(msg, externFn->getPosition());
             }
         }
 
@@ -83,7 +119,10 @@ std::shared_ptr<AST::Node> ApplyTypeAnnotations::process(std::shared_ptr<AST::No
         }
 
         if(returnType) {
-            externFn->setDataType(DataType(params, *returnType, true /* extern */), [this](auto& s) { this->addMessage(s); });
+            // Imported functions are VM functions of another module
+            auto type = externFn->isImport() ? DataType(params, *returnType)
+                                             : DataType(params, *returnType, true /* extern */, externFn->isVariadic());
+            externFn->setDataType(type, [this](auto& s) { this->addMessage(s); });
         }
     } else {
         followChildren(node);
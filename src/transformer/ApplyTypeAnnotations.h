@@ -23,4 +23,7 @@ class ApplyTypeAnnotations : private TreeWalker {
    private:
     CollectTypes::TypesMap& types;
     std::vector<TypeError> itsErrors;
+
+    // Unknown if the annotation names no valid type
+    DataType toDataType(const std::string& annotationText);
 };
@@ -14,6 +14,7 @@ std::shared_ptr<AST::Node> CollectTypes::process(std::shared_ptr<AST::Node> node
         if(types.find(structName) == types.end()) {
             bool isComplete = true;
             std::map<std::string, StructMember> fields;
+            size_t offset = 0;
             for(const auto& aMember : declStruct->getMembers())
             {
                 const auto& aMemberIdentifier = aMember->getIdentifier();
@@ -24,7 +25,8 @@ std::shared_ptr<AST::Node> CollectTypes::process(std::shared_ptr<AST::Node> node
                     isComplete = false;
                     break;
                 }
-                fields.emplace(aMemberName, StructMember{aMemberType, INVALID_OFFSET});
+                // Declaration order like C, every field takes one word
+                fields.emplace(aMemberName, StructMember{aMemberType, offset++});
             }
             if(isComplete) {
                 auto structType = DataType::Struct{structName, fields}; // MGDO this should not work
@@ -0,0 +1,284 @@
+#include "ConstantFolding.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+
+namespace transformer {
+
+namespace {
+
+// A literal as the VM holds it: Int and Bool as words, Float as double
+struct FoldValue {
+    DataType::Primitive kind;
+    std::uint64_t word;
+    double number;
+};
+
+bool toFoldValue(const std::shared_ptr<AST::Node>& node, FoldValue& value) {
+    if (!node || node->getType() != AST::NodeType::Literal) {
+        return false;
+    }
+    auto literal = std::dynamic_pointer_cast<AST::Literal>(node);
+    auto kind = literal->getDataType().getKind();
+    switch (kind) {
+        case DataType::Primitive::Int:
+            value = {kind, static_cast<std::uint64_t>(literal->getIntValue()), 0.0};
+            return true;
+        case DataType::Primitive::Bool:
+            value = {kind, literal->getBoolValue() ? 1u : 0u, 0.0};
+            return true;
+        case DataType::Primitive::Float:
+            value = {kind, 0, literal->getFloatValue()};
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::shared_ptr<AST::Literal> toLiteral(const FoldValue& value, const SourcePosition& position) {
+    std::string text;
+    if (value.kind == DataType::Primitive::Int) {
+        text = std::to_string(static_cast<std::int64_t>(value.word));
+    } else if (value.kind == DataType::Primitive::Bool) {
+        text = value.word ? "true" : "false";
+    } else {
+        // Enough digits to read back the same double
+        std::ostringstream stream;
+        stream << std::setprecision(17) << value.number;
+        text = stream.str();
+    }
+    return std::make_shared<AST::Literal>(text, DataType(value.kind), position);
+}
+
+FoldValue foldBool(bool value) { return {DataType::Primitive::Bool, value ? 1u : 0u, 0.0}; }
+
+// Same results as the instructions the emitter uses for the build-in,
+// false if it is not known or must fail at runtime
+bool evaluateBuildIn(const std::string& name, const std::vector<FoldValue>& args,
+                     FoldValue& result) {
+    using P = DataType::Primitive;
+    if (args.size() == 1) {
+        const auto& x = args[0];
+        if (name == "toFloat" && x.kind == P::Int) {
+            result = {P::Float, 0, static_cast<double>(static_cast<std::int64_t>(x.word))};
+            return true;
+        }
+        if (name == "toInt" && x.kind == P::Float && std::isfinite(x.number) &&
+            std::fabs(x.number) < 9.2e18) {
+            result = {P::Int, static_cast<std::uint64_t>(static_cast<std::int64_t>(x.number)), 0.0};
+            return true;
+        }
+        return false;
+    }
+    if (args.size() != 2 || args[0].kind != args[1].kind) {
+        return false;
+    }
+
+    const auto& l = args[0];
+    const auto& r = args[1];
+    if (l.kind == P::Int) {
+        // Unsigned like the VM, also for the comparisons
+        if (name == "+") result = {P::Int, l.word + r.word, 0.0};
+        else if (name == "-") result = {P::Int, l.word - r.word, 0.0};
+        else if (name == "*") result = {P::Int, l.word * r.word, 0.0};
+        else if (name == "/" && r.word != 0) result = {P::Int, l.word / r.word, 0.0};
+        else if (name == "%" && r.word != 0) result = {P::Int, l.word % r.word, 0.0};
+        else if (name == "<") result = foldBool(l.word < r.word);
+        else if (name == ">") result = foldBool(l.word > r.word);
+        else if (name == "<=") result = foldBool(l.word <= r.word);
+        else if (name == ">=") result = foldBool(l.word >= r.word);
+        else if (name == "==") result = foldBool(l.word == r.word);
+        else if (name == "!=") result = foldBool(l.word != r.word);
+        else return false;
+        return true;
+    }
+    if (l.kind == P::Float) {
+        if (name == "+") result = {P::Float, 0, l.number + r.number};
+        else if (name == "-") result = {P::Float, 0, l.number - r.number};
+        else if (name == "*") result = {P::Float, 0, l.number * r.number};
+        else if (name == "/") result = {P::Float, 0, l.number / r.number};
+        else if (name == "<") result = foldBool(l.number < r.number);
+        else if (name == ">") result = foldBool(l.number > r.number);
+        else if (name == "<=") result = foldBool(l.number <= r.number);
+        else if (name == ">=") result = foldBool(l.number >= r.number);
+        else if (name == "==") result = foldBool(l.number == r.number);
+        else if (name == "!=") result = foldBool(l.number != r.number);
+        else return false;
+        // Literals can not hold inf and nan
+        return result.kind != P::Float || std::isfinite(result.number);
+    }
+    if (l.kind == P::Bool) {
+        if (name == "==") result = foldBool(l.word == r.word);
+        else if (name == "!=") result = foldBool(l.word != r.word);
+        else if (name == "&&") result = foldBool(l.word && r.word);
+        else if (name == "||") result = foldBool(l.word || r.word);
+        else return false;
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+ConstantFolding::ConstantFolding() : assignments{}, constants{}, scopes{}, folded(0) {}
+
+std::shared_ptr<AST::Node> ConstantFolding::process(std::shared_ptr<AST::Node> node) {
+    if (!node || node->getType() != AST::NodeType::Function) {
+        return node;
+    }
+
+    auto function = std::dynamic_pointer_cast<AST::Function>(node);
+    assignments.clear();
+    constants.clear();
+    scopes.clear();
+    for (const auto& param : function->getHead()->getParameters()) {
+        ++assignments[param->getName()];
+    }
+    countAssignments(function->getBody());
+
+    scopes.emplace_back();
+    function->setBody(fold(function->getBody()));
+    scopes.clear();
+    return function;
+}
+
+void ConstantFolding::countAssignments(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return;
+    }
+    if (node->getType() == AST::NodeType::Declvar) {
+        ++assignments[std::dynamic_pointer_cast<AST::Declvar>(node)->getIdentifier()->getName()];
+    } else if (node->getType() == AST::NodeType::Assign) {
+        auto left = std::dynamic_pointer_cast<AST::Assign>(node)->getLeft();
+        if (left->getType() == AST::NodeType::Identifier) {
+            ++assignments[std::dynamic_pointer_cast<AST::Identifier>(left)->getName()];
+        }
+    }
+    for (const auto& child : node->getChildren()) {
+        countAssignments(child);
+    }
+}
+
+std::shared_ptr<AST::Node> ConstantFolding::foldBlock(const std::shared_ptr<AST::Block>& block) {
+    scopes.emplace_back();
+    std::vector<std::shared_ptr<AST::Node>> children;
+    for (const auto& child : block->getChildren()) {
+        children.push_back(fold(child));
+    }
+    block->setChildren(children);
+    for (const auto& name : scopes.back()) {
+        constants.erase(name);
+    }
+    scopes.pop_back();
+    return block;
+}
+
+std::shared_ptr<AST::Node> ConstantFolding::foldCall(const std::shared_ptr<AST::Call>& call) {
+    std::vector<FoldValue> args;
+    bool allConstant = true;
+    for (auto& arg : call->getArguments()) {
+        arg = fold(arg);
+        FoldValue value;
+        if (toFoldValue(arg, value)) {
+            args.push_back(value);
+        } else {
+            allConstant = false;
+        }
+    }
+
+    // Locals shadow the build-ins
+    const auto& name = call->getIdentifier()->getName();
+    FoldValue result;
+    if (!allConstant || assignments.count(name) > 0 || !evaluateBuildIn(name, args, result) ||
+        call->getDataType() != result.kind) {
+        return call;
+    }
+    ++folded;
+    return toLiteral(result, call->getPosition());
+}
+
+std::shared_ptr<AST::Node> ConstantFolding::fold(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return node;
+    }
+
+    // Bodies of branches and loops are scopes, also without brackets
+    auto foldScoped = [this](const std::shared_ptr<AST::Node>& body) {
+        auto block = std::make_shared<AST::Block>(std::vector<std::shared_ptr<AST::Node>>{body},
+                                                  body->getPosition());
+        foldBlock(block);
+        return block->getChildren().front();
+    };
+
+    switch (node->getType()) {
+        case AST::NodeType::Block:
+            return foldBlock(std::dynamic_pointer_cast<AST::Block>(node));
+        case AST::NodeType::Call:
+            return foldCall(std::dynamic_pointer_cast<AST::Call>(node));
+        case AST::NodeType::Identifier: {
+            auto it = constants.find(std::dynamic_pointer_cast<AST::Identifier>(node)->getName());
+            if (it == constants.end()) {
+                return node;
+            }
+            ++folded;
+            return std::make_shared<AST::Literal>(it->second->getStringValue(),
+                                                  it->second->getDataType(), node->getPosition());
+        }
+        case AST::NodeType::Ret: {
+            auto ret = std::dynamic_pointer_cast<AST::Ret>(node);
+            ret->setExpr(fold(ret->getExpr()));
+            return ret;
+        }
+        case AST::NodeType::Assign: {
+            auto assign = std::dynamic_pointer_cast<AST::Assign>(node);
+            assign->setRight(fold(assign->getRight()));
+            auto left = assign->getLeft();
+            FoldValue value;
+            if (left->getType() == AST::NodeType::Declvar && toFoldValue(assign->getRight(), value)) {
+                auto name = std::dynamic_pointer_cast<AST::Declvar>(left)->getIdentifier()->getName();
+                if (assignments[name] == 1) {
+                    constants[name] = std::dynamic_pointer_cast<AST::Literal>(assign->getRight());
+                    scopes.back().push_back(name);
+                }
+            }
+            return assign;
+        }
+        case AST::NodeType::If: {
+            auto branch = std::dynamic_pointer_cast<AST::If>(node);
+            branch->setCondition(fold(branch->getCondition()));
+            FoldValue condition;
+            if (toFoldValue(branch->getCondition(), condition) &&
+                condition.kind == DataType::Primitive::Bool) {
+                ++folded;
+                auto taken = condition.word ? branch->getPositive() : branch->getNegative();
+                if (!taken) {
+                    return std::make_shared<AST::Block>(node->getPosition());
+                }
+                return foldScoped(taken);
+            }
+            branch->setPositive(foldScoped(branch->getPositive()));
+            if (branch->getNegative()) {
+                branch->setNegative(foldScoped(branch->getNegative()));
+            }
+            return branch;
+        }
+        case AST::NodeType::While: {
+            auto loop = std::dynamic_pointer_cast<AST::While>(node);
+            loop->setCondition(fold(loop->getCondition()));
+            FoldValue condition;
+            if (toFoldValue(loop->getCondition(), condition) &&
+                condition.kind == DataType::Primitive::Bool && !condition.word) {
+                ++folded;
+                return std::make_shared<AST::Block>(node->getPosition());
+            }
+            loop->setBody(foldScoped(loop->getBody()));
+            return loop;
+        }
+        default:
+            return node;
+    }
+}
+
+}  // namespace transformer
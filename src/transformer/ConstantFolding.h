@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../ast/Node.h"
+#include "TreeWalker.h"
+
+namespace transformer {
+
+/*
+ * Evaluates what is known at compile time, runs on typed functions:
+ * - build-in arithmetic, comparison and boolean calls on literals become
+ *   literals, computed exactly like the VM does
+ * - locals assigned a literal once are replaced by the literal, in the
+ *   block of the declaration after the declaration
+ * - if and while with a literal condition are replaced by the taken branch
+ */
+class ConstantFolding : public TreeWalker {
+   private:
+    std::map<std::string, size_t> assignments; // Of the current function
+    std::map<std::string, std::shared_ptr<AST::Literal>> constants;
+    std::vector<std::vector<std::string>> scopes; // Constants by block
+    size_t folded;
+
+    void countAssignments(const std::shared_ptr<AST::Node>& node);
+    std::shared_ptr<AST::Node> fold(const std::shared_ptr<AST::Node>& node);
+    std::shared_ptr<AST::Node> foldCall(const std::shared_ptr<AST::Call>& call);
+    std::shared_ptr<AST::Node> foldBlock(const std::shared_ptr<AST::Block>& block);
+
+   public:
+    ConstantFolding();
+
+    // Folds the body of a function, other nodes are returned as they are
+    std::shared_ptr<AST::Node> process(std::shared_ptr<AST::Node> node) override;
+
+    // Calls, identifiers and branches replaced so far
+    size_t getFolded() const { return folded; }
+};
+
+}  // namespace transformer
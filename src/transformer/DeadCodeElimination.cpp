@@ -0,0 +1,157 @@
+#include "DeadCodeElimination.h"
+
+#include <set>
+#include <vector>
+
+namespace transformer {
+
+namespace {
+
+// Uses of identifiers in node, reads and assignments, declarations are no uses
+void collectUses(const std::shared_ptr<AST::Node>& node, std::map<std::string, size_t>& uses) {
+    if (!node || node->getType() == AST::NodeType::Declvar) {
+        return;
+    }
+    if (node->getType() == AST::NodeType::Identifier) {
+        ++uses[std::dynamic_pointer_cast<AST::Identifier>(node)->getName()];
+    }
+    for (const auto& child : node->getChildren()) {
+        collectUses(child, uses);
+    }
+}
+
+void collectFnPtrs(const std::shared_ptr<AST::Node>& node, std::vector<std::string>& ids) {
+    if (!node) {
+        return;
+    }
+    if (node->getType() == AST::NodeType::FnPtr) {
+        ids.push_back(std::dynamic_pointer_cast<AST::FnPtr>(node)->getId());
+    }
+    for (const auto& child : node->getChildren()) {
+        collectFnPtrs(child, ids);
+    }
+}
+
+}  // namespace
+
+DeadCodeElimination::DeadCodeElimination() : removedStatements(0), removedFunctions(0) {}
+
+void DeadCodeElimination::run(Functions& functions, std::map<std::string, std::string>& exports,
+                              bool keepExports) {
+    std::map<std::string, std::string> keep; // Locals of main holding kept functions
+    if (keepExports) {
+        keep = exports;
+    }
+
+    for (auto& fn : functions) {
+        removeUnreachable(fn.second->getBody());
+        std::map<std::string, size_t> uses;
+        collectUses(fn.second->getBody(), uses);
+        removeUnusedLocals(fn.second->getBody(), uses,
+                           fn.first == "main" ? keep : std::map<std::string, std::string>{});
+    }
+
+    std::set<std::string> reachable;
+    std::vector<std::string> pending{"main"};
+    while (!pending.empty()) {
+        auto id = pending.back();
+        pending.pop_back();
+        auto it = functions.find(id);
+        if (it == functions.end() || !reachable.insert(id).second) {
+            continue;
+        }
+        collectFnPtrs(it->second->getBody(), pending);
+    }
+
+    for (auto it = functions.begin(); it != functions.end();) {
+        if (reachable.count(it->first) == 0) {
+            ++removedFunctions;
+            it = functions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = exports.begin(); it != exports.end();) {
+        it = reachable.count(it->second) == 0 ? exports.erase(it) : std::next(it);
+    }
+}
+
+bool DeadCodeElimination::removeUnreachable(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return false;
+    }
+    switch (node->getType()) {
+        case AST::NodeType::Ret:
+            return true;
+        case AST::NodeType::Block: {
+            auto block = std::dynamic_pointer_cast<AST::Block>(node);
+            auto children = block->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (removeUnreachable(children[i])) {
+                    removedStatements += children.size() - i - 1;
+                    children.resize(i + 1);
+                    block->setChildren(children);
+                    return true;
+                }
+            }
+            return false;
+        }
+        case AST::NodeType::If: {
+            auto branch = std::dynamic_pointer_cast<AST::If>(node);
+            bool positive = removeUnreachable(branch->getPositive());
+            bool negative = removeUnreachable(branch->getNegative());
+            return positive && negative;
+        }
+        case AST::NodeType::While: {
+            // The body may not run at all
+            removeUnreachable(std::dynamic_pointer_cast<AST::While>(node)->getBody());
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+void DeadCodeElimination::removeUnusedLocals(const std::shared_ptr<AST::Node>& node,
+                                             const std::map<std::string, size_t>& uses,
+                                             const std::map<std::string, std::string>& keep) {
+    if (!node) {
+        return;
+    }
+    if (node->getType() == AST::NodeType::If) {
+        auto branch = std::dynamic_pointer_cast<AST::If>(node);
+        removeUnusedLocals(branch->getPositive(), uses, keep);
+        removeUnusedLocals(branch->getNegative(), uses, keep);
+        return;
+    }
+    if (node->getType() == AST::NodeType::While) {
+        removeUnusedLocals(std::dynamic_pointer_cast<AST::While>(node)->getBody(), uses, keep);
+        return;
+    }
+    if (node->getType() != AST::NodeType::Block) {
+        return;
+    }
+
+    auto block = std::dynamic_pointer_cast<AST::Block>(node);
+    std::vector<std::shared_ptr<AST::Node>> children;
+    for (const auto& child : block->getChildren()) {
+        if (child->getType() == AST::NodeType::Assign) {
+            auto assign = std::dynamic_pointer_cast<AST::Assign>(child);
+            auto valueType = assign->getRight()->getType();
+            if (assign->getLeft()->getType() == AST::NodeType::Declvar &&
+                (valueType == AST::NodeType::FnPtr || valueType == AST::NodeType::Literal)) {
+                auto name = std::dynamic_pointer_cast<AST::Declvar>(assign->getLeft())
+                                ->getIdentifier()->getName();
+                if (uses.count(name) == 0 && keep.count(name) == 0) {
+                    ++removedStatements;
+                    continue;
+                }
+            }
+        }
+        removeUnusedLocals(child, uses, keep);
+        children.push_back(child);
+    }
+    block->setChildren(children);
+}
+
+}  // namespace transformer
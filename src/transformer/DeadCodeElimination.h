@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "../ast/Node.h"
+
+namespace transformer {
+
+/*
+ * Removes what can not run or is never used, on typed functions:
+ * - statements after a statement which always returns
+ * - locals holding a function or a literal which are never used
+ * - functions not reachable from main over function references, exported
+ *   functions are reachable if they are kept
+ */
+class DeadCodeElimination {
+   public:
+    using Functions = std::map<std::string, std::shared_ptr<AST::Function>>;
+
+   private:
+    size_t removedStatements;
+    size_t removedFunctions;
+
+    // Removes the dead statements of blocks, true if node always returns
+    bool removeUnreachable(const std::shared_ptr<AST::Node>& node);
+    void removeUnusedLocals(const std::shared_ptr<AST::Node>& node, const std::map<std::string, size_t>& uses,
+                            const std::map<std::string, std::string>& keep);
+
+   public:
+    DeadCodeElimination();
+
+    // exports maps names to function ids, unreachable ones are removed
+    void run(Functions& functions, std::map<std::string, std::string>& exports, bool keepExports);
+
+    size_t getRemovedStatements() const { return removedStatements; }
+    size_t getRemovedFunctions() const { return removedFunctions; }
+};
+
+}  // namespace transformer
@@ -2,38 +2,11 @@
 
 #include <algorithm>
 
-InfereIdentifierTypes::InfereIdentifierTypes() {
-    stack.push_back({});
-
-#define DEF_BUILD_IN(NAME, TYPE)                                               \
-    stack.back().emplace(                                                      \
-        NAME, DataType({DataType::Primitive::TYPE, DataType::Primitive::TYPE}, \
-                       DataType::Primitive::TYPE))
-
-#define DEF_BUILD_IN_2(NAME, TYPE, RTYPE)                                      \
-    stack.back().emplace(                                                      \
-        NAME, DataType({DataType::Primitive::TYPE, DataType::Primitive::TYPE}, \
-                       DataType::Primitive::RTYPE))
-
-    // Add std function types in first stack frame
-    DEF_BUILD_IN("-", Int);
-    DEF_BUILD_IN("+", Int);
-    DEF_BUILD_IN("/", Int);
-    DEF_BUILD_IN("*", Int);
-
-    DEF_BUILD_IN_2("<", Int, Bool);
-    DEF_BUILD_IN_2(">", Int, Bool);
-    DEF_BUILD_IN_2(">=", Int, Bool);
-    DEF_BUILD_IN_2("<=", Int, Bool);
-
-    DEF_BUILD_IN("||", Bool);
-    DEF_BUILD_IN("&&", Bool);
-    DEF_BUILD_IN("==", Bool);
-    DEF_BUILD_IN("!=", Bool);
-
-    DEF_BUILD_IN("==", String);
-    DEF_BUILD_IN("!=", String);
+#include "../ast/BuiltIns.h"
 
+InfereIdentifierTypes::InfereIdentifierTypes() {
+    // Build-in functions are resolved by name and argument types in
+    // builtins::resolve after the scopes have been searched
     stack.push_back({});
 }
 
@@ -227,9 +200,8 @@ std::shared_ptr<AST::Node> InfereIdentifierTypes::process(std::shared_ptr<AST::N
             }
         }
 
-        // TODO: Central place. This is for print. Build-ins
-        if (name == "print" && argumentTypes.empty()) {
-            type = DataType({}, DataType::Primitive::None);  // None?
+        if (type == DataType::Primitive::Unknown) {
+            type = builtins::resolve(name, argumentTypes);
         }
 
         if (type != DataType::Primitive::Unknown) {
@@ -38,7 +38,9 @@ std::shared_ptr<AST::Node> InfereParameterTypes::process(
         // functions
         if (call->getIdentifier()->getDataType() !=
             DataType::Primitive::Unknown) {
-            // Type already determined
+            // Type already determined, arguments may still call functions
+            // with unknown parameters
+            followChildren(node);
             return node;
         }
 
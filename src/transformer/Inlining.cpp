@@ -0,0 +1,366 @@
+#include "Inlining.h"
+
+#include "../ast/BuiltIns.h"
+#include "Scopes.h"
+
+namespace transformer {
+
+namespace {
+
+size_t countInlineNodes(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return 0;
+    }
+    size_t count = 1;
+    for (const auto& child : node->getChildren()) {
+        count += countInlineNodes(child);
+    }
+    return count;
+}
+
+std::shared_ptr<AST::Identifier> renameIdentifier(const std::shared_ptr<AST::Identifier>& identifier,
+                                                  const std::map<std::string, std::string>& renames) {
+    auto it = renames.find(identifier->getName());
+    auto copy = std::make_shared<AST::Identifier>(it == renames.end() ? identifier->getName() : it->second,
+                                                  identifier->getPosition());
+    copy->setDataType(identifier->getDataType(), [](const std::string&) {});
+    return copy;
+}
+
+// Copies an expression, literals and function pointers are shared
+std::shared_ptr<AST::Node> cloneRenamed(const std::shared_ptr<AST::Node>& node,
+                                        const std::map<std::string, std::string>& renames) {
+    switch (node->getType()) {
+        case AST::NodeType::Identifier:
+            return renameIdentifier(std::dynamic_pointer_cast<AST::Identifier>(node), renames);
+        case AST::NodeType::Call: {
+            auto call = std::dynamic_pointer_cast<AST::Call>(node);
+            std::vector<std::shared_ptr<AST::Node>> args;
+            for (const auto& arg : call->getArguments()) {
+                args.push_back(cloneRenamed(arg, renames));
+            }
+            return std::make_shared<AST::Call>(renameIdentifier(call->getIdentifier(), renames), args,
+                                               call->getPosition());
+        }
+        case AST::NodeType::StructAccess: {
+            // Only the first identifier is a local, the others are fields
+            auto access = std::dynamic_pointer_cast<AST::StructAccess>(node);
+            std::vector<std::shared_ptr<AST::Identifier>> identifiers;
+            for (const auto& identifier : access->getIdentifiers()) {
+                identifiers.push_back(renameIdentifier(identifier, identifiers.empty() ? renames
+                                                                   : std::map<std::string, std::string>{}));
+            }
+            auto copy = std::make_shared<AST::StructAccess>(identifiers, access->getPosition());
+            copy->setDataType(access->getDataType(), [](const std::string&) {});
+            return copy;
+        }
+        default:
+            return node;
+    }
+}
+
+// Only expressions, no control flow, declarations of functions or externs
+bool isInlineExpression(const std::shared_ptr<AST::Node>& node) {
+    switch (node->getType()) {
+        case AST::NodeType::Identifier:
+        case AST::NodeType::Literal:
+        case AST::NodeType::FnPtr:
+        case AST::NodeType::StructAccess:
+            return true;
+        case AST::NodeType::Call:
+            for (const auto& arg : std::dynamic_pointer_cast<AST::Call>(node)->getArguments()) {
+                if (!isInlineExpression(arg)) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool refersTo(const std::shared_ptr<AST::Node>& node, const std::string& id) {
+    if (!node) {
+        return false;
+    }
+    if (node->getType() == AST::NodeType::FnPtr && std::dynamic_pointer_cast<AST::FnPtr>(node)->getId() == id) {
+        return true;
+    }
+    for (const auto& child : node->getChildren()) {
+        if (refersTo(child, id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+Inlining::Inlining(size_t budget)
+    : budget(budget), inlined(0), fresh(0), functions(nullptr), inlinable{}, assignments{}, targets{} {}
+
+void Inlining::run(Functions& theFunctions) {
+    functions = &theFunctions;
+
+    // Decided before any body changes, so inlined code is not inlined again
+    inlinable.clear();
+    for (const auto& fn : theFunctions) {
+        inlinable[fn.first] = checkInlinable(fn.first);
+    }
+
+    for (auto& fn : theFunctions) {
+        auto& function = fn.second;
+        assignments.clear();
+        targets.clear();
+        for (const auto& param : function->getHead()->getParameters()) {
+            ++assignments[param->getName()];
+        }
+        collectTargets(function->getBody());
+        for (auto it = targets.begin(); it != targets.end();) {
+            it = assignments[it->first] == 1 ? std::next(it) : targets.erase(it);
+        }
+        if (targets.empty()) {
+            continue;
+        }
+
+        if (function->getBody()->getType() != AST::NodeType::Block) {
+            function->setBody(std::make_shared<AST::Block>(
+                std::vector<std::shared_ptr<AST::Node>>{function->getBody()},
+                function->getBody()->getPosition()));
+        }
+        processBlock(std::dynamic_pointer_cast<AST::Block>(function->getBody()));
+    }
+    functions = nullptr;
+}
+
+bool Inlining::checkInlinable(const std::string& id) const {
+    const auto& function = functions->at(id);
+    auto body = function->getBody();
+    if (countInlineNodes(body) > budget || refersTo(body, id)) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<AST::Node>> statements{body};
+    if (body->getType() == AST::NodeType::Block) {
+        statements = std::dynamic_pointer_cast<AST::Block>(body)->getChildren();
+    }
+    if (statements.empty()) {
+        return false;
+    }
+
+    std::set<std::string> locals;
+    for (const auto& param : function->getHead()->getParameters()) {
+        locals.insert(param->getName());
+    }
+    for (size_t i = 0; i + 1 < statements.size(); ++i) {
+        if (statements[i]->getType() != AST::NodeType::Assign) {
+            return false;
+        }
+        auto assign = std::dynamic_pointer_cast<AST::Assign>(statements[i]);
+        if (assign->getLeft()->getType() != AST::NodeType::Declvar || !isPure(assign->getRight(), locals)) {
+            return false;
+        }
+        auto name = std::dynamic_pointer_cast<AST::Declvar>(assign->getLeft())->getIdentifier()->getName();
+        if (!locals.insert(name).second) {
+            return false;
+        }
+    }
+
+    if (statements.back()->getType() != AST::NodeType::Ret) {
+        return false;
+    }
+    auto result = std::dynamic_pointer_cast<AST::Ret>(statements.back())->getExpr();
+    if (!result || !isInlineExpression(result)) {
+        return false;
+    }
+    auto type = result->getDataType();
+    return type != DataType::Primitive::None && type != DataType::Primitive::Void;
+}
+
+bool Inlining::isPure(const std::shared_ptr<AST::Node>& node, const std::set<std::string>& locals) {
+    switch (node->getType()) {
+        case AST::NodeType::Identifier:
+        case AST::NodeType::Literal:
+        case AST::NodeType::FnPtr:
+            return true;
+        case AST::NodeType::Call: {
+            auto call = std::dynamic_pointer_cast<AST::Call>(node);
+            const auto& name = call->getIdentifier()->getName();
+            if (locals.count(name) > 0 || !builtins::isPure(name)) {
+                return false;
+            }
+            for (const auto& arg : call->getArguments()) {
+                if (!isPure(arg, locals)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool Inlining::callsHidden(const std::shared_ptr<AST::Node>& node, const std::set<std::string>& locals) const {
+    if (!node) {
+        return false;
+    }
+    if (node->getType() == AST::NodeType::Call &&
+        locals.count(std::dynamic_pointer_cast<AST::Call>(node)->getIdentifier()->getName()) > 0) {
+        return true;
+    }
+    for (const auto& child : node->getChildren()) {
+        if (callsHidden(child, locals)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Inlining::collectTargets(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return;
+    }
+    if (node->getType() == AST::NodeType::Declvar) {
+        ++assignments[std::dynamic_pointer_cast<AST::Declvar>(node)->getIdentifier()->getName()];
+    } else if (node->getType() == AST::NodeType::Assign) {
+        auto assign = std::dynamic_pointer_cast<AST::Assign>(node);
+        auto left = assign->getLeft();
+        if (left->getType() == AST::NodeType::Identifier) {
+            ++assignments[std::dynamic_pointer_cast<AST::Identifier>(left)->getName()];
+        } else if (left->getType() == AST::NodeType::Declvar &&
+                   assign->getRight()->getType() == AST::NodeType::FnPtr) {
+            auto name = std::dynamic_pointer_cast<AST::Declvar>(left)->getIdentifier()->getName();
+            targets[name] = std::dynamic_pointer_cast<AST::FnPtr>(assign->getRight())->getId();
+        }
+    }
+    for (const auto& child : node->getChildren()) {
+        collectTargets(child);
+    }
+}
+
+std::set<std::string> Inlining::callerLocals() const {
+    std::set<std::string> locals;
+    for (const auto& assignment : assignments) {
+        locals.insert(assignment.first);
+    }
+    return locals;
+}
+
+void Inlining::processBlock(const std::shared_ptr<AST::Block>& block) {
+    auto blocks = [this](const std::shared_ptr<AST::Block>& body) { processBlock(body); };
+    std::vector<std::shared_ptr<AST::Node>> children;
+    for (auto child : block->getChildren()) {
+        std::vector<std::shared_ptr<AST::Node>> prelude;
+        bool keep = true;
+        switch (child->getType()) {
+            case AST::NodeType::Assign: {
+                auto assign = std::dynamic_pointer_cast<AST::Assign>(child);
+                assign->setRight(inlineCalls(assign->getRight(), prelude));
+                break;
+            }
+            case AST::NodeType::Ret: {
+                auto ret = std::dynamic_pointer_cast<AST::Ret>(child);
+                if (ret->getExpr()) {
+                    ret->setExpr(inlineCalls(ret->getExpr(), prelude));
+                }
+                break;
+            }
+            case AST::NodeType::Call:
+                // An unused result without calls has no effect
+                child = inlineCalls(child, prelude);
+                keep = child->getType() == AST::NodeType::Call;
+                break;
+            case AST::NodeType::If: {
+                auto branch = std::dynamic_pointer_cast<AST::If>(child);
+                branch->setCondition(inlineCalls(branch->getCondition(), prelude));
+                branch->setPositive(processScoped(branch->getPositive(), blocks));
+                if (branch->getNegative()) {
+                    branch->setNegative(processScoped(branch->getNegative(), blocks));
+                }
+                break;
+            }
+            case AST::NodeType::While: {
+                // The condition runs in every iteration, it stays as it is
+                auto loop = std::dynamic_pointer_cast<AST::While>(child);
+                loop->setBody(processScoped(loop->getBody(), blocks));
+                break;
+            }
+            case AST::NodeType::Block:
+                processBlock(std::dynamic_pointer_cast<AST::Block>(child));
+                break;
+            default:
+                break;
+        }
+        children.insert(children.end(), prelude.begin(), prelude.end());
+        if (keep) {
+            children.push_back(child);
+        }
+    }
+    block->setChildren(children);
+}
+
+std::shared_ptr<AST::Node> Inlining::inlineCalls(const std::shared_ptr<AST::Node>& node,
+                                                 std::vector<std::shared_ptr<AST::Node>>& prelude) {
+    if (!node || node->getType() != AST::NodeType::Call) {
+        return node;
+    }
+
+    auto call = std::dynamic_pointer_cast<AST::Call>(node);
+    for (auto& arg : call->getArguments()) {
+        arg = inlineCalls(arg, prelude);
+    }
+
+    auto target = targets.find(call->getIdentifier()->getName());
+    if (target == targets.end() || !inlinable[target->second]) {
+        return call;
+    }
+    auto locals = callerLocals();
+    for (const auto& arg : call->getArguments()) {
+        if (!isPure(arg, locals)) {
+            return call;
+        }
+    }
+    const auto& callee = functions->at(target->second);
+    if (callsHidden(callee->getBody(), locals)) {
+        return call;
+    }
+    return inlineCall(call, callee, prelude);
+}
+
+std::shared_ptr<AST::Node> Inlining::inlineCall(const std::shared_ptr<AST::Call>& call,
+                                                const std::shared_ptr<AST::Function>& callee,
+                                                std::vector<std::shared_ptr<AST::Node>>& prelude) {
+    const auto& position = call->getPosition();
+    auto suffix = "$" + std::to_string(++fresh);
+    std::map<std::string, std::string> renames;
+    auto declare = [&](const std::string& name, const DataType& type, std::shared_ptr<AST::Node> value) {
+        auto identifier = std::make_shared<AST::Identifier>(name + suffix, position);
+        identifier->setDataType(type, [](const std::string&) {});
+        prelude.push_back(std::make_shared<AST::Assign>(
+            std::make_shared<AST::Declvar>(identifier, position), value, position));
+        renames[name] = name + suffix;
+    };
+
+    const auto& params = callee->getHead()->getParameters();
+    const auto& args = call->getArguments();
+    for (size_t i = 0; i < params.size(); ++i) {
+        declare(params[i]->getName(), params[i]->getDataType(), args[i]);
+    }
+
+    auto body = callee->getBody();
+    std::vector<std::shared_ptr<AST::Node>> statements{body};
+    if (body->getType() == AST::NodeType::Block) {
+        statements = std::dynamic_pointer_cast<AST::Block>(body)->getChildren();
+    }
+    for (size_t i = 0; i + 1 < statements.size(); ++i) {
+        auto assign = std::dynamic_pointer_cast<AST::Assign>(statements[i]);
+        auto identifier = std::dynamic_pointer_cast<AST::Declvar>(assign->getLeft())->getIdentifier();
+        declare(identifier->getName(), identifier->getDataType(), cloneRenamed(assign->getRight(), renames));
+    }
+
+    ++inlined;
+    return cloneRenamed(std::dynamic_pointer_cast<AST::Ret>(statements.back())->getExpr(), renames);
+}
+
+}  // namespace transformer
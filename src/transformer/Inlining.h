@@ -0,0 +1,64 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../ast/Node.h"
+
+namespace transformer {
+
+/*
+ * Substitutes small functions into their call sites, on typed functions.
+ * A function is inlined if its body is only declarations of locals with
+ * side effect free values and a return with a value, and if it does not
+ * take more than the budget of nodes. The arguments, which must be free of
+ * side effects as well, and the locals of the function become fresh locals
+ * declared before the statement of the call:
+ *
+ *   let f(x: Int) = x + 2;     ->    let x$1 = a;
+ *   let b = f(a);                    let b = x$1 + 2;
+ *
+ * Only calls through locals assigned a function once are inlined, calls in
+ * while conditions are not, and inlined code is not inlined again.
+ */
+class Inlining {
+   public:
+    using Functions = std::map<std::string, std::shared_ptr<AST::Function>>;
+
+   private:
+    size_t budget;
+    size_t inlined;
+    size_t fresh;
+    const Functions* functions;
+    std::map<std::string, bool> inlinable;  // By function id
+    std::map<std::string, size_t> assignments;  // Of the caller
+    std::map<std::string, std::string> targets;  // Local of the caller -> function id
+
+    bool checkInlinable(const std::string& id) const;
+    // Build-in calls on values, locals hide build-ins of the same name
+    static bool isPure(const std::shared_ptr<AST::Node>& node, const std::set<std::string>& locals);
+    // Calls a build-in which a local of the caller hides
+    bool callsHidden(const std::shared_ptr<AST::Node>& node, const std::set<std::string>& locals) const;
+    void collectTargets(const std::shared_ptr<AST::Node>& node);
+    std::set<std::string> callerLocals() const;
+    void processBlock(const std::shared_ptr<AST::Block>& block);
+    std::shared_ptr<AST::Node> inlineCalls(const std::shared_ptr<AST::Node>& node,
+                                           std::vector<std::shared_ptr<AST::Node>>& prelude);
+    std::shared_ptr<AST::Node> inlineCall(const std::shared_ptr<AST::Call>& call,
+                                          const std::shared_ptr<AST::Function>& callee,
+                                          std::vector<std::shared_ptr<AST::Node>>& prelude);
+
+   public:
+    // budget is the largest number of nodes of an inlined function body
+    explicit Inlining(size_t budget = 32);
+
+    void run(Functions& functions);
+
+    // Calls replaced so far
+    size_t getInlined() const { return inlined; }
+};
+
+}  // namespace transformer
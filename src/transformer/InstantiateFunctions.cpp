@@ -19,6 +19,10 @@ InstantiateFunctions::getFunctions() {
     return functions;
 }
 
+const std::map<std::string, std::string>& InstantiateFunctions::getExports() const {
+    return exports;
+}
+
 std::shared_ptr<AST::Node> InstantiateFunctions::process(
     std::shared_ptr<AST::Node> node) {
     depth++;
@@ -41,6 +45,9 @@ std::shared_ptr<AST::Node> InstantiateFunctions::process(
             auto fn =
                 std::make_shared<AST::Function>(declfn, assign->getRight());
             functions[uniqId] = fn;
+            if (depth == 1) {
+                exports[declfn->getIdentifier()->getName()] = uniqId;
+            }
 
             // Update assignment
             assign->setLeft(
@@ -17,11 +17,14 @@
 class InstantiateFunctions : private TreeWalker {
    private:
     std::map<std::string, std::shared_ptr<AST::Function>> functions;
+    std::map<std::string, std::string> exports;
     size_t depth;
 
    public:
     InstantiateFunctions(std::shared_ptr<AST::Node> node);
     std::map<std::string, std::shared_ptr<AST::Function>>& getFunctions();
+    // Functions declared at the top level, name -> unique id
+    const std::map<std::string, std::string>& getExports() const;
 
    private:
     std::shared_ptr<AST::Node> process(std::shared_ptr<AST::Node> node);
@@ -0,0 +1,216 @@
+#include "LoopInvariantCodeMotion.h"
+
+#include "../ast/BuiltIns.h"
+#include "Scopes.h"
+
+namespace transformer {
+
+LoopInvariantCodeMotion::LoopInvariantCodeMotion() : locals{}, hoisted(0), fresh(0) {}
+
+std::shared_ptr<AST::Node> LoopInvariantCodeMotion::process(std::shared_ptr<AST::Node> node) {
+    if (!node || node->getType() != AST::NodeType::Function) {
+        return node;
+    }
+
+    auto function = std::dynamic_pointer_cast<AST::Function>(node);
+    locals.clear();
+    for (const auto& param : function->getHead()->getParameters()) {
+        locals.insert(param->getName());
+    }
+    collectLocals(function->getBody());
+    auto blocks = [this](const std::shared_ptr<AST::Block>& body) { processBlock(body); };
+    function->setBody(processScoped(function->getBody(), blocks));
+    return function;
+}
+
+void LoopInvariantCodeMotion::collectLocals(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return;
+    }
+    if (node->getType() == AST::NodeType::Declvar) {
+        locals.insert(std::dynamic_pointer_cast<AST::Declvar>(node)->getIdentifier()->getName());
+    }
+    for (const auto& child : node->getChildren()) {
+        collectLocals(child);
+    }
+}
+
+void LoopInvariantCodeMotion::collectLoop(const std::shared_ptr<AST::Node>& node, Loop& loop) const {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case AST::NodeType::Declvar:
+            loop.assigned.insert(std::dynamic_pointer_cast<AST::Declvar>(node)->getIdentifier()->getName());
+            break;
+        case AST::NodeType::Assign: {
+            auto left = std::dynamic_pointer_cast<AST::Assign>(node)->getLeft();
+            if (left->getType() == AST::NodeType::Identifier) {
+                loop.assigned.insert(std::dynamic_pointer_cast<AST::Identifier>(left)->getName());
+            } else if (left->getType() == AST::NodeType::StructAccess) {
+                loop.writesMemory = true;
+            }
+            break;
+        }
+        case AST::NodeType::Call: {
+            // Functions and externs may write through pointers
+            const auto& name = std::dynamic_pointer_cast<AST::Call>(node)->getIdentifier()->getName();
+            if (locals.count(name) > 0 || !builtins::isReadOnly(name)) {
+                loop.writesMemory = true;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    for (const auto& child : node->getChildren()) {
+        collectLoop(child, loop);
+    }
+}
+
+bool LoopInvariantCodeMotion::isInvariant(const std::shared_ptr<AST::Node>& node, const Loop& loop,
+                                          bool readsMemory) const {
+    switch (node->getType()) {
+        case AST::NodeType::Literal:
+            return true;
+        case AST::NodeType::Identifier:
+            return loop.assigned.count(std::dynamic_pointer_cast<AST::Identifier>(node)->getName()) == 0;
+        case AST::NodeType::StructAccess: {
+            auto access = std::dynamic_pointer_cast<AST::StructAccess>(node);
+            return readsMemory && !loop.writesMemory &&
+                   loop.assigned.count(access->getIdentifiers().front()->getName()) == 0;
+        }
+        case AST::NodeType::Call: {
+            auto call = std::dynamic_pointer_cast<AST::Call>(node);
+            const auto& name = call->getIdentifier()->getName();
+            if (locals.count(name) > 0 || !builtins::isPure(name)) {
+                return false;
+            }
+            for (const auto& arg : call->getArguments()) {
+                if (!isInvariant(arg, loop, readsMemory)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void LoopInvariantCodeMotion::processBlock(const std::shared_ptr<AST::Block>& block) {
+    auto blocks = [this](const std::shared_ptr<AST::Block>& body) { processBlock(body); };
+    std::vector<std::shared_ptr<AST::Node>> children;
+    for (const auto& child : block->getChildren()) {
+        switch (child->getType()) {
+            case AST::NodeType::Block:
+                processBlock(std::dynamic_pointer_cast<AST::Block>(child));
+                break;
+            case AST::NodeType::If: {
+                auto branch = std::dynamic_pointer_cast<AST::If>(child);
+                branch->setPositive(processScoped(branch->getPositive(), blocks));
+                if (branch->getNegative()) {
+                    branch->setNegative(processScoped(branch->getNegative(), blocks));
+                }
+                break;
+            }
+            case AST::NodeType::While: {
+                // Inner loops first, what they hoist may be invariant here as well
+                auto loop = std::dynamic_pointer_cast<AST::While>(child);
+                loop->setBody(processScoped(loop->getBody(), blocks));
+
+                Loop info;
+                collectLoop(loop, info);
+                std::vector<std::shared_ptr<AST::Node>> preheader;
+                // The condition runs at least once, its fields can be read before
+                loop->setCondition(hoist(loop->getCondition(), info, true, preheader));
+                hoistStatements(loop->getBody(), info, preheader);
+                children.insert(children.end(), preheader.begin(), preheader.end());
+                break;
+            }
+            default:
+                break;
+        }
+        children.push_back(child);
+    }
+    block->setChildren(children);
+}
+
+void LoopInvariantCodeMotion::hoistStatements(const std::shared_ptr<AST::Node>& node, const Loop& loop,
+                                              std::vector<std::shared_ptr<AST::Node>>& preheader) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case AST::NodeType::Block:
+            for (const auto& child : std::dynamic_pointer_cast<AST::Block>(node)->getChildren()) {
+                hoistStatements(child, loop, preheader);
+            }
+            break;
+        case AST::NodeType::Assign: {
+            auto assign = std::dynamic_pointer_cast<AST::Assign>(node);
+            assign->setRight(hoist(assign->getRight(), loop, false, preheader));
+            break;
+        }
+        case AST::NodeType::Ret: {
+            auto ret = std::dynamic_pointer_cast<AST::Ret>(node);
+            if (ret->getExpr()) {
+                ret->setExpr(hoist(ret->getExpr(), loop, false, preheader));
+            }
+            break;
+        }
+        case AST::NodeType::Call:
+            // Without consumer only the arguments are worth computing
+            for (auto& arg : std::dynamic_pointer_cast<AST::Call>(node)->getArguments()) {
+                arg = hoist(arg, loop, false, preheader);
+            }
+            break;
+        case AST::NodeType::If: {
+            auto branch = std::dynamic_pointer_cast<AST::If>(node);
+            branch->setCondition(hoist(branch->getCondition(), loop, false, preheader));
+            hoistStatements(branch->getPositive(), loop, preheader);
+            hoistStatements(branch->getNegative(), loop, preheader);
+            break;
+        }
+        case AST::NodeType::While: {
+            auto inner = std::dynamic_pointer_cast<AST::While>(node);
+            inner->setCondition(hoist(inner->getCondition(), loop, false, preheader));
+            hoistStatements(inner->getBody(), loop, preheader);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+std::shared_ptr<AST::Node> LoopInvariantCodeMotion::hoist(const std::shared_ptr<AST::Node>& node,
+                                                          const Loop& loop, bool readsMemory,
+                                                          std::vector<std::shared_ptr<AST::Node>>& preheader) {
+    auto type = node->getType();
+    if (type != AST::NodeType::Call && type != AST::NodeType::StructAccess) {
+        return node;
+    }
+
+    if (isInvariant(node, loop, readsMemory)) {
+        const auto& position = node->getPosition();
+        auto name = "licm$" + std::to_string(++fresh);
+        auto declared = std::make_shared<AST::Identifier>(name, position);
+        declared->setDataType(node->getDataType(), [](const std::string&) {});
+        preheader.push_back(std::make_shared<AST::Assign>(
+            std::make_shared<AST::Declvar>(declared, position), node, position));
+
+        auto identifier = std::make_shared<AST::Identifier>(name, position);
+        identifier->setDataType(node->getDataType(), [](const std::string&) {});
+        ++hoisted;
+        return identifier;
+    }
+
+    if (type == AST::NodeType::Call) {
+        for (auto& arg : std::dynamic_pointer_cast<AST::Call>(node)->getArguments()) {
+            arg = hoist(arg, loop, readsMemory, preheader);
+        }
+    }
+    return node;
+}
+
+}  // namespace transformer
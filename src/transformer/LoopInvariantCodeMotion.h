@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../ast/Node.h"
+#include "TreeWalker.h"
+
+namespace transformer {
+
+/*
+ * Moves computations which give the same value in every iteration in front
+ * of while loops, runs on typed functions:
+ *
+ *   while (i < n * 2) { ... }    ->    let licm$1 = n * 2;
+ *                                      while (i < licm$1) { ... }
+ *
+ * Hoisted are build-in arithmetic and comparison calls whose operands are
+ * literals or locals not assigned in the loop. Struct fields are hoisted
+ * from the condition if the loop does not write memory, that is it has no
+ * field assignments and no calls of functions, externs or build-ins which
+ * write.
+ */
+class LoopInvariantCodeMotion : public TreeWalker {
+   private:
+    struct Loop {
+        std::set<std::string> assigned;
+        bool writesMemory = false;
+    };
+
+    std::set<std::string> locals;  // Of the current function, hide build-ins
+    size_t hoisted;
+    size_t fresh;
+
+    void collectLocals(const std::shared_ptr<AST::Node>& node);
+    void collectLoop(const std::shared_ptr<AST::Node>& node, Loop& loop) const;
+    bool isInvariant(const std::shared_ptr<AST::Node>& node, const Loop& loop, bool readsMemory) const;
+
+    void processBlock(const std::shared_ptr<AST::Block>& block);
+    // Replaces invariant expressions of the statements in node by temporaries
+    void hoistStatements(const std::shared_ptr<AST::Node>& node, const Loop& loop,
+                         std::vector<std::shared_ptr<AST::Node>>& preheader);
+    std::shared_ptr<AST::Node> hoist(const std::shared_ptr<AST::Node>& node, const Loop& loop,
+                                     bool readsMemory, std::vector<std::shared_ptr<AST::Node>>& preheader);
+
+   public:
+    LoopInvariantCodeMotion();
+
+    // Processes the body of a function, other nodes are returned as they are
+    std::shared_ptr<AST::Node> process(std::shared_ptr<AST::Node> node) override;
+
+    // Expressions moved out of loops so far
+    size_t getHoisted() const { return hoisted; }
+};
+
+}  // namespace transformer
@@ -0,0 +1,18 @@
+#include "Scopes.h"
+
+namespace transformer {
+
+std::shared_ptr<AST::Node> processScoped(
+    const std::shared_ptr<AST::Node>& body,
+    const std::function<void(const std::shared_ptr<AST::Block>&)>& processBlock) {
+    if (body->getType() == AST::NodeType::Block) {
+        processBlock(std::dynamic_pointer_cast<AST::Block>(body));
+        return body;
+    }
+    auto block = std::make_shared<AST::Block>(std::vector<std::shared_ptr<AST::Node>>{body},
+                                              body->getPosition());
+    processBlock(block);
+    return block->getChildren().size() == 1 ? block->getChildren().front() : block;
+}
+
+}  // namespace transformer
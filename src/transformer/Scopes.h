@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "../ast/Node.h"
+
+namespace transformer {
+
+/*
+ * Bodies of if and while are scopes, also without brackets. Runs
+ * processBlock on the body as a block of its own and returns the body to
+ * set, which is only wrapped in a block if statements were added to it.
+ */
+std::shared_ptr<AST::Node> processScoped(
+    const std::shared_ptr<AST::Node>& body,
+    const std::function<void(const std::shared_ptr<AST::Block>&)>& processBlock);
+
+}  // namespace transformer
@@ -1,5 +0,0 @@
-#pragma once
-
-#include "../transformer/CollectTypes.h"
-
-void updateOffsets(CollectTypes::TypesMap& types);
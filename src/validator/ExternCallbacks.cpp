@@ -0,0 +1,33 @@
+#include "ExternCallbacks.h"
+
+namespace validator {
+
+void ExternCallbacks::check(const std::shared_ptr<AST::Node>& node) {
+    if (!node) {
+        return;
+    }
+
+    if (node->getType() == AST::NodeType::Call) {
+        auto call = std::dynamic_pointer_cast<AST::Call>(node);
+        const auto& fnDataType = call->getIdentifier()->getDataType();
+        if (fnDataType.isFunction() && fnDataType.getFunction().isExtern) {
+            for (const auto& arg : call->getArguments()) {
+                auto argType = arg->getDataType();
+                if (argType.isFunction() && argType.getFunction().isExtern) {
+                    itsErrors.emplace_back("Extern functions can not be passed to extern functions",
+                                           arg->getPosition());
+                }
+            }
+        }
+    }
+
+    for (const auto& child : node->getChildren()) {
+        check(child);
+    }
+}
+
+void ExternCallbacks::validate(std::shared_ptr<AST::Function> function) {
+    check(function->getBody());
+}
+
+}  // namespace validator
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+
+#include "../ast/Node.h"
+#include "Validator.h"
+
+namespace validator {
+
+/*
+ * Validator that checks the functions passed to extern functions. Native
+ * code calls them back through the VM, so they must be MLang functions and
+ * not extern functions themselves.
+ */
+class ExternCallbacks : public Validator {
+   private:
+    void check(const std::shared_ptr<AST::Node>& node);
+
+   public:
+    ExternCallbacks() : Validator() {}
+
+    void validate(std::shared_ptr<AST::Function> function) override;
+};
+
+}  // namespace validator